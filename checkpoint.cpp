@@ -0,0 +1,369 @@
+/*
+
+MIT License
+
+Copyright(c) 2016-2025 Judd Niemann
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files(the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include "checkpoint.h"
+#include "engine.h"
+#include "fen.h"
+#include "search.h"
+#include "tablegroup.h"
+#include "utils.h"
+#include "zobristkeyset.h"
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <filesystem>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace juddperft {
+
+namespace fs = std::filesystem;
+
+// JournalTask : one unit of work - the position after one or two moves from the root
+struct JournalTask
+{
+	ChessPosition Q;
+	int nMoves{0};
+	std::string name;	// the moves, in co-ordinate notation, separated by commas (eg e2e4,e7e5)
+};
+
+// JournalEntry : one completed task, as recorded in the journal
+struct JournalEntry
+{
+	size_t index{0};
+	std::string name;
+	nodecount_t count{0};
+};
+
+struct Journal
+{
+	std::string fen;
+	int depth{0};
+	int levels{0};
+	uint64_t seed{0};
+	std::vector<JournalEntry> entries;
+	bool complete{false};
+	uint64_t validBytes{0};		// length of the journal, up to the end of the last complete line
+
+	bool create(const std::string& path)
+	{
+		FILE* f = fopen(path.c_str(), "w");
+		if (f == nullptr) {
+			return false;
+		}
+
+		fprintf(f, "juddperft-journal 1\nfen %s\ndepth %d\nlevels %d\nseed %" PRIx64 "\n", fen.c_str(), depth, levels, seed);
+		validBytes = ftell(f);
+		bool ok = Utils::flushToDisk(f);
+		ok = (fclose(f) == 0) && ok;
+		if (ok) {
+			Utils::syncDirectory(fs::path(path).parent_path().string());
+		}
+		return ok;
+	}
+
+	// load() : read the journal. If the last line is incomplete (ie the process died while writing it), it is ignored
+	bool load(const std::string& path)
+	{
+		FILE* f = fopen(path.c_str(), "rb");
+		if (f == nullptr) {
+			return false;
+		}
+
+		std::string contents;
+		char buffer[4096];
+		size_t n;
+		while ((n = fread(buffer, 1, sizeof(buffer), f)) > 0) {
+			contents.append(buffer, n);
+		}
+		fclose(f);
+
+		int version = 0;
+		size_t pos = 0;
+		while (pos < contents.size()) {
+			const size_t eol = contents.find('\n', pos);
+			if (eol == std::string::npos) {
+				break; // (incomplete line)
+			}
+
+			const std::string line = contents.substr(pos, eol - pos);
+			char name[256];
+			JournalEntry entry;
+			if (pos == 0) {
+				if (sscanf(line.c_str(), "juddperft-journal %d", &version) != 1 || version != 1) {
+					return false;
+				}
+			} else if (line.compare(0, 4, "fen ") == 0) {
+				fen = line.substr(4);
+			} else if (sscanf(line.c_str(), "depth %d", &depth) == 1 || sscanf(line.c_str(), "levels %d", &levels) == 1) {
+				// (nothing more to do)
+			} else if (sscanf(line.c_str(), "seed %" SCNx64, &seed) == 1) {
+				// (nothing more to do)
+			} else if (sscanf(line.c_str(), "done %zu %255s %" SCNu64, &entry.index, name, &entry.count) == 3) {
+				entry.name = name;
+				entries.push_back(entry);
+			} else if (line.compare(0, 9, "complete ") == 0) {
+				complete = true;
+			} else {
+				break; // (damaged line: ignore it, and anything after it)
+			}
+
+			pos = eol + 1;
+			validBytes = pos;
+		}
+
+		return (version == 1) && !fen.empty() && (depth >= 2) && (depth < PERFT_DEPTH_KEYS) && (levels == 1 || levels == 2);
+	}
+};
+
+// moveName() : a move in co-ordinate notation
+static std::string moveName(const ChessMove& m)
+{
+	char buffer[32] = {0};
+	printMove(m, CoOrdinate, buffer);
+	buffer[strcspn(buffer, "\r\n")] = '\0';
+	return buffer;
+}
+
+// makeTasks() : split P into tasks, levels moves deep (the order of the tasks is the order the moves are generated in)
+static std::vector<JournalTask> makeTasks(const ChessPosition& P, int levels)
+{
+	std::vector<JournalTask> tasks;
+
+	ChessMove movelist[MOVELIST_SIZE];
+	MoveGenerator::generateMoves(P, movelist);
+	for (unsigned int i = 0; i < move_count(movelist); i++) {
+		JournalTask task;
+		task.Q = P;
+		task.Q.performMove(movelist[i]).switchSides();
+		task.nMoves = 1;
+		task.name = moveName(movelist[i]);
+
+		ChessMove replies[MOVELIST_SIZE];
+		unsigned int nReplies = 0;
+		if (levels == 2) {
+			MoveGenerator::generateMoves(task.Q, replies);
+			nReplies = move_count(replies);
+		}
+
+		if (nReplies == 0) {
+			tasks.push_back(task);
+		}
+
+		for (unsigned int j = 0; j < nReplies; j++) {
+			JournalTask reply = task;
+			reply.Q.performMove(replies[j]).switchSides();
+			reply.nMoves = 2;
+			reply.name += "," + moveName(replies[j]);
+			tasks.push_back(reply);
+		}
+	}
+
+	return tasks;
+}
+
+// runJournal() : do all the tasks not already recorded in the journal
+static bool runJournal(ChessPosition& P, Journal& journal, const CheckpointOptions& options, nodecount_t& nNodes)
+{
+	const std::string snapshotPath = options.journalPath + ".tables";
+	std::error_code ec;
+	if (fs::exists(snapshotPath, ec)) {
+		if (TableGroup::loadSnapshot(snapshotPath)) {
+			printf("Loaded hash tables from %s\n", snapshotPath.c_str());
+		} else {
+			printf("Unable to load hash tables from %s; ignoring it\n", snapshotPath.c_str());
+		}
+		P.calculateHash(); // (the snapshot may have brought a different zobrist seed with it)
+	}
+
+	ChessPosition G = P;
+	G.dontDetectChecks = 1;
+	std::vector<JournalTask> tasks = makeTasks(G, journal.levels);
+
+	// account for what has already been done:
+	std::vector<char> done(tasks.size(), 0);
+	nodecount_t total = 0;
+	for (const JournalEntry& entry : journal.entries) {
+		if (entry.index >= tasks.size() || entry.name != tasks[entry.index].name) {
+			printf("Journal %s doesn't match this position (task %zu: %s)\n", options.journalPath.c_str(), entry.index, entry.name.c_str());
+			return false;
+		}
+		if (!done[entry.index]) {
+			done[entry.index] = 1;
+			total += entry.count;
+		}
+	}
+
+	std::vector<size_t> pending;
+	for (size_t i = 0; i < tasks.size(); i++) {
+		if (!done[i]) {
+			pending.push_back(i);
+		}
+	}
+
+	if (!journal.entries.empty()) {
+		printf("Resuming: %zu of %zu tasks already done\n", tasks.size() - pending.size(), tasks.size());
+	}
+
+	// drop any incomplete last line, and append from there
+	if (fs::file_size(options.journalPath, ec) > journal.validBytes) {
+		fs::resize_file(options.journalPath, journal.validBytes, ec);
+	}
+
+	FILE* f = fopen(options.journalPath.c_str(), "a");
+	if (f == nullptr) {
+		printf("Unable to write to journal %s\n", options.journalPath.c_str());
+		return false;
+	}
+
+	unsigned int nThreads = std::min(std::thread::hardware_concurrency(), std::min(theEngine.nNumCores, static_cast<unsigned int>(MAX_THREADS)));
+	nThreads = std::max(1u, std::min(nThreads, static_cast<unsigned int>(pending.size())));
+	std::atomic<size_t> nextTask{0};
+	std::mutex journalMutex;
+	std::condition_variable cv;
+	size_t completed = 0;
+	bool ioError = false;
+	int progressDots = 0;
+
+	std::vector<std::thread> threads;
+	for (unsigned int t = 0; t < nThreads && !pending.empty(); t++) {
+		threads.emplace_back([&] {
+			for (size_t i = nextTask++; i < pending.size(); i = nextTask++) {
+				const JournalTask& task = tasks[pending[i]];
+				nodecount_t count = 0;
+				perftFast(task.Q, journal.depth - task.nMoves, count);
+
+				std::lock_guard<std::mutex> lock(journalMutex);
+				fprintf(f, "done %zu %s %" PRIu64 "\n", pending[i], task.name.c_str(), count);
+				ioError = !Utils::flushToDisk(f) || ioError;
+				total += count;
+				completed++;
+				std::cout << ".";								// show progress
+				progressDots++;
+				cv.notify_one();
+			}
+		});
+	}
+
+	// wait for the tasks to finish, snapshotting the tables periodically (if requested)
+	{
+		const auto allDone = [&] { return completed == pending.size(); };
+		std::unique_lock<std::mutex> lock(journalMutex);
+		while (!allDone()) {
+			if (options.snapshotMinutes <= 0) {
+				cv.wait(lock, allDone);
+			} else if (!cv.wait_for(lock, std::chrono::minutes(options.snapshotMinutes), allDone)) {
+				lock.unlock(); // (workers carry on while the snapshot is being written)
+				if (!TableGroup::saveSnapshot(snapshotPath)) {
+					printf("\nUnable to save table snapshot %s\n", snapshotPath.c_str());
+				}
+				lock.lock();
+			}
+		}
+	}
+
+	for (auto & th : threads) {
+		th.join();
+	}
+
+	// rub-out the progress dots
+	for (int c = 0; c < progressDots; c++) {
+		std::cout << "\b \b";
+	}
+
+	if (!journal.complete) {
+		fprintf(f, "complete %" PRIu64 "\n", total);
+	}
+	ioError = !Utils::flushToDisk(f) || ioError;
+	ioError = (fclose(f) != 0) || ioError;
+	if (ioError) {
+		printf("Warning: I/O error writing journal %s\n", options.journalPath.c_str());
+	}
+
+	nNodes = total;
+	return true;
+}
+
+bool perftCheckpointed(const ChessPosition& P, int depth, const CheckpointOptions& options, nodecount_t& nNodes)
+{
+	nNodes = 0;
+	if (depth < 2) { // (nothing worth journalling)
+		perftFastMT(P, depth, nNodes);
+		return true;
+	}
+
+	char fen[1024] = {0};
+	writeFen(fen, &P);
+
+	Journal journal;
+	std::error_code ec;
+	if (fs::exists(options.journalPath, ec)) {
+		if (!journal.load(options.journalPath) || journal.fen != fen || journal.depth != depth) {
+			printf("Journal %s belongs to a different (or damaged) job. Use resume to continue it, or choose another file\n", options.journalPath.c_str());
+			return false;
+		}
+	} else {
+		journal.fen = fen;
+		journal.depth = depth;
+		journal.levels = (depth >= 3) ? 2 : 1;
+		journal.seed = zobristKeys.getSeed();
+		if (!journal.create(options.journalPath)) {
+			printf("Unable to create journal %s\n", options.journalPath.c_str());
+			return false;
+		}
+	}
+
+	ChessPosition Q = P;
+	return runJournal(Q, journal, options, nNodes);
+}
+
+bool perftResume(const CheckpointOptions& options, ChessPosition* pP, int* pDepth, nodecount_t& nNodes)
+{
+	nNodes = 0;
+
+	Journal journal;
+	if (!journal.load(options.journalPath)) {
+		printf("Unable to read journal %s\n", options.journalPath.c_str());
+		return false;
+	}
+
+	ChessPosition P;
+	readFen(&P, journal.fen.c_str());
+	const bool ok = runJournal(P, journal, options, nNodes);
+	*pP = P;
+	*pDepth = journal.depth;
+	return ok;
+}
+
+} // namespace juddperft
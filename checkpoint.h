@@ -0,0 +1,76 @@
+/*
+
+MIT License
+
+Copyright(c) 2016-2025 Judd Niemann
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files(the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+//////////////////////////////////////////////
+// checkpoint.h								//
+// Defines:									//
+// Journalled (crash-resumable) perft		//
+//////////////////////////////////////////////
+
+#ifndef _CHECKPOINT_H
+#define _CHECKPOINT_H 1
+
+#include "chessposition.h"
+#include "movegen.h"
+
+#include <string>
+
+namespace juddperft {
+
+// A journalled perft splits the job into tasks (one per pair of root move + reply, or one per root move for depth 2),
+// and appends the result of each task to a journal file as soon as it completes (flushed to disk each time).
+// If the job is interrupted, it can be continued from the journal, without redoing any completed task.
+//
+// Journal format (text):
+//
+// juddperft-journal 1
+// fen <fen of root position>
+// depth <depth>
+// levels <1 | 2>								(number of moves per task)
+// seed <zobrist seed>						(for information: the seed in use when the journal was started)
+// done <task index> <moves> <count>			(one line per completed task, in order of completion; moves are comma-separated)
+// complete <total>							(once all tasks are done)
+//
+// Optionally, the hash tables are also snapshotted to <journal>.tables every snapshotMinutes minutes,
+// so that a resumed job doesn't start with cold tables (see TableGroup::saveSnapshot())
+
+struct CheckpointOptions
+{
+	std::string journalPath;
+	int snapshotMinutes{0};		// 0 = don't snapshot tables
+};
+
+// perftCheckpointed() : perft of P, journalled to options.journalPath.
+// If the journal already exists (for the same position and depth), the job carries on from where it left off.
+bool perftCheckpointed(const ChessPosition& P, int depth, const CheckpointOptions& options, nodecount_t& nNodes);
+
+// perftResume() : carry on with the job recorded in options.journalPath (position and depth are read from the journal)
+// *pP and *pDepth receive the position and depth of the job
+bool perftResume(const CheckpointOptions& options, ChessPosition* pP, int* pDepth, nodecount_t& nNodes);
+
+} // namespace juddperft
+
+#endif // _CHECKPOINT_H
@@ -3,6 +3,9 @@
 
 #include "movegen.h"
 
+#include <algorithm>
+#include <cassert>
+
 namespace juddperft {
 
 //////////////////////////////////////////////
@@ -18,6 +21,10 @@ ChessPosition::ChessPosition()
 	flags = 0;
 
 	ChessPosition::hk = 0;
+#if defined(CP_CANONICAL_HASH)
+	hkMirror = 0;
+#endif
+	calculateDerivedBitboards();
 }
 
 ChessPosition& ChessPosition::setupStartPosition()
@@ -31,6 +38,7 @@ ChessPosition& ChessPosition::setupStartPosition()
 	whiteCanCastle = 1;
 	blackCanCastleLong = 1;
 	whiteCanCastleLong = 1;
+	assert(flags == CASTLING_RIGHTS_MASK);
 	blackForfeitedCastle = 0;
 	whiteForfeitedCastle = 0;
 	blackForfeitedCastleLong = 0;
@@ -44,6 +52,18 @@ ChessPosition& ChessPosition::setupStartPosition()
 	calculateMaterial();
 
 	ChessPosition::calculateHash();
+	calculateDerivedBitboards();
+
+	return *this;
+}
+
+ChessPosition& ChessPosition::calculateDerivedBitboards()
+{
+#if defined(CP_DERIVED_BITBOARDS)
+	Occupied = A | B | C;
+	White = Occupied & ~D;
+	Kings = A & B & C;
+#endif
 
 	return *this;
 }
@@ -51,32 +71,161 @@ ChessPosition& ChessPosition::setupStartPosition()
 ChessPosition & ChessPosition::calculateHash()
 {
 	hk = 0;
+#if defined(CP_CANONICAL_HASH)
+	hkMirror = 0;
+#endif
 
 	for (unsigned int q = 0; q < 64; q++) {
 		piece_t piece = getPieceAtSquare(q);
 		if (piece & 0x7) {
-			ChessPosition::hk ^= zobristKeys.zkPieceOnSquare[piece][q];
+			hashPiece(piece, q);
 		}
 	}
 
 	if (blackToMove)
-		ChessPosition::hk ^= zobristKeys.zkBlackToMove;
+		hk ^= zobristKeys.zkBlackToMove;
+#if defined(CP_CANONICAL_HASH)
+	else
+		hkMirror ^= zobristKeys.zkBlackToMove; // (the mirror image has the other side to move)
+#endif
 
 	if (whiteCanCastle)
-		ChessPosition::hk ^= zobristKeys.zkWhiteCanCastle;
+		hashKey(zobristKeys.zkWhiteCanCastle, zobristKeys.zkBlackCanCastle);
 
 	if (whiteCanCastleLong)
-		ChessPosition::hk ^= zobristKeys.zkWhiteCanCastleLong;
+		hashKey(zobristKeys.zkWhiteCanCastleLong, zobristKeys.zkBlackCanCastleLong);
 
 	if (blackCanCastle)
-		ChessPosition::hk ^= zobristKeys.zkBlackCanCastle;
+		hashKey(zobristKeys.zkBlackCanCastle, zobristKeys.zkWhiteCanCastle);
 
 	if (blackCanCastleLong)
-		ChessPosition::hk ^= zobristKeys.zkBlackCanCastleLong;
+		hashKey(zobristKeys.zkBlackCanCastleLong, zobristKeys.zkWhiteCanCastleLong);
 
 	return *this;
 }
 
+#if defined(CP_CANONICAL_HASH)
+// calculateLeftRightCanonicalHash() : for positions with no pawns and no castling rights, where the left-right mirror images
+// (files a <-> h etc) are equivalent too: return the lowest of k (the lower of hk and hkMirror), and the hash keys
+// of the left-right mirror image and its colour-flipped counterpart. These are calculated from scratch
+// (there are few enough pieces on the board by then for this to be cheap)
+HashKey ChessPosition::calculateLeftRightCanonicalHash(HashKey k) const
+{
+	HashKey hkLR = 0;
+	HashKey hkLRMirror = 0;
+	for (Bitboard X = A | B | C; X; X &= (X - 1)) {
+		const unsigned int q = getSquareIndex(X);
+		const piece_t piece = getPieceAtSquare(q);
+		hkLR ^= zobristKeys.zkPieceOnSquare[piece][q ^ 7];
+		hkLRMirror ^= zobristKeys.zkPieceOnSquare[piece ^ 8][q ^ 63];
+	}
+
+	if (blackToMove) {
+		hkLR ^= zobristKeys.zkBlackToMove;
+	} else {
+		hkLRMirror ^= zobristKeys.zkBlackToMove;
+	}
+
+	return std::min(k, std::min(hkLR, hkLRMirror));
+}
+#endif
+
+// flipVertical() : mirror a Bitboard top-to-bottom (rank 1 <-> rank 8 etc)
+static inline Bitboard flipVertical(Bitboard b)
+{
+#if defined(_MSC_VER)
+	return _byteswap_uint64(b);
+#else
+	return __builtin_bswap64(b);
+#endif
+}
+
+ChessPosition& ChessPosition::flipColours()
+{
+	const Bitboard W = (A | B | C) & ~D; // white pieces become black ones
+	A = flipVertical(A);
+	B = flipVertical(B);
+	C = flipVertical(C);
+	D = flipVertical(W);
+
+	const uint32_t wcc = whiteCanCastle, wccl = whiteCanCastleLong;
+	const uint32_t wfc = whiteForfeitedCastle, wfcl = whiteForfeitedCastleLong;
+	const uint32_t wdc = whiteDidCastle, wdcl = whiteDidCastleLong;
+	const uint32_t wic = whiteIsInCheck, wis = whiteIsStalemated, wim = whiteIsCheckmated;
+
+	whiteCanCastle = blackCanCastle;
+	whiteCanCastleLong = blackCanCastleLong;
+	whiteForfeitedCastle = blackForfeitedCastle;
+	whiteForfeitedCastleLong = blackForfeitedCastleLong;
+	whiteDidCastle = blackDidCastle;
+	whiteDidCastleLong = blackDidCastleLong;
+	whiteIsInCheck = blackIsInCheck;
+	whiteIsStalemated = blackIsStalemated;
+	whiteIsCheckmated = blackIsCheckmated;
+
+	blackCanCastle = wcc;
+	blackCanCastleLong = wccl;
+	blackForfeitedCastle = wfc;
+	blackForfeitedCastleLong = wfcl;
+	blackDidCastle = wdc;
+	blackDidCastleLong = wdcl;
+	blackIsInCheck = wic;
+	blackIsStalemated = wis;
+	blackIsCheckmated = wim;
+
+	blackToMove ^= 1;
+
+	calculateDerivedBitboards();
+	return *this;
+}
+
+// flipHorizontal() : mirror a Bitboard left-to-right (a-file <-> h-file etc)
+static inline Bitboard flipHorizontal(Bitboard b)
+{
+	b = ((b >> 1) & 0x5555555555555555ull) | ((b & 0x5555555555555555ull) << 1);
+	b = ((b >> 2) & 0x3333333333333333ull) | ((b & 0x3333333333333333ull) << 2);
+	b = ((b >> 4) & 0x0f0f0f0f0f0f0f0full) | ((b & 0x0f0f0f0f0f0f0f0full) << 4);
+	return b;
+}
+
+// mix64() : the splitmix64 finaliser (every input bit affects every output bit)
+static inline uint64_t mix64(uint64_t x)
+{
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+	return x ^ (x >> 31);
+}
+
+HashKey ChessPosition::calculateVerificationKey() const
+{
+	ChessPosition Q = *this;
+
+#if defined(CP_CANONICAL_HASH)
+	// hash whichever orientation of the position getCanonicalHash() chose, so that mirror images get the same key
+	const HashKey k = getCanonicalHash();
+	if (k != hk) {
+		if (k != hkMirror) {
+			// one of the left-right mirror images
+			Q.A = flipHorizontal(A);
+			Q.B = flipHorizontal(B);
+			Q.C = flipHorizontal(C);
+			Q.D = flipHorizontal(D);
+			Q.calculateHash();
+		}
+		if (k != Q.hk) {
+			Q.flipColours();
+		}
+	}
+#endif
+
+	const ZobristKey* salt = zobristKeys.zkVerify;
+	uint64_t v = mix64(Q.A ^ salt[0]);
+	v = mix64(v ^ Q.B ^ salt[1]);
+	v = mix64(v ^ Q.C ^ salt[2]);
+	v = mix64(v ^ Q.D ^ salt[3]);
+	return mix64(v ^ (static_cast<uint64_t>(Q.blackToMove) << 32) ^ (Q.flags & CASTLING_RIGHTS_MASK) ^ salt[4]);
+}
+
 int ChessPosition::calculateMaterial() const
 {
 	int material = 0;
@@ -109,9 +258,12 @@ ChessPosition& ChessPosition::performMove(const ChessMove& m)
 	B &= ~EnPassant;
 	C &= ~EnPassant;
 	D &= ~EnPassant;
+	removeDerived(EnPassant);
 
-	const unsigned long epSquareIdx = getSquareIndex(EnPassant);
-	hk ^= zobristKeys.zkPieceOnSquare[WENPASSANT][epSquareIdx]; // Remove EP from nEPSquare
+	if (EnPassant) {
+		// (the EP square, if any, was left by the opponent's double pawn move)
+		hashPiece(m.blackToMove ? WENPASSANT : BENPASSANT, getSquareIndex(EnPassant)); // Remove EP from EP square
+	}
 
 	switch (m.piece) {
 	case BKING:
@@ -146,10 +298,11 @@ ChessPosition& ChessPosition::performMove(const ChessMove& m)
 			B ^= 0x0a00000000000000;
 			C ^= 0x0f00000000000000;
 			D ^= 0x0f00000000000000;
+			castleDerived(0x0f00000000000000, 0x0a00000000000000, true);
 
-			hk ^= zobristKeys.zkDoBlackCastle;
+			hashKey(zobristKeys.zkDoBlackCastle, zobristKeys.zkDoWhiteCastle);
 			if (blackCanCastleLong) {
-				hk ^= zobristKeys.zkBlackCanCastleLong;	// flip black castling long
+				hashKey(zobristKeys.zkBlackCanCastleLong, zobristKeys.zkWhiteCanCastleLong);	// flip black castling long
 			}
 
 			blackDidCastle = 1;
@@ -163,10 +316,11 @@ ChessPosition& ChessPosition::performMove(const ChessMove& m)
 			B ^= 0x2800000000000000;
 			C ^= 0xb800000000000000;
 			D ^= 0xb800000000000000;
+			castleDerived(0xb800000000000000, 0x2800000000000000, true);
 
-			hk ^= zobristKeys.zkDoBlackCastleLong;
+			hashKey(zobristKeys.zkDoBlackCastleLong, zobristKeys.zkDoWhiteCastleLong);
 			if (blackCanCastle) {
-				hk ^= zobristKeys.zkBlackCanCastle;	// conditionally flip black castling
+				hashKey(zobristKeys.zkBlackCanCastle, zobristKeys.zkWhiteCanCastle);	// conditionally flip black castling
 			}
 
 			blackDidCastleLong = 1;
@@ -178,11 +332,11 @@ ChessPosition& ChessPosition::performMove(const ChessMove& m)
 		// ordinary king move; Black could have castled,
 		// but chose to move the King in a non-castling move
 		if (blackCanCastle) {
-			hk ^= zobristKeys.zkBlackCanCastle;	// flip black castling
+			hashKey(zobristKeys.zkBlackCanCastle, zobristKeys.zkWhiteCanCastle);	// flip black castling
 		}
 
 		if (blackCanCastleLong) {
-			hk ^= zobristKeys.zkBlackCanCastleLong;	// flip black castling long
+			hashKey(zobristKeys.zkBlackCanCastleLong, zobristKeys.zkWhiteCanCastleLong);	// flip black castling long
 		}
 
 		blackForfeitedCastle = 1;
@@ -197,10 +351,11 @@ ChessPosition& ChessPosition::performMove(const ChessMove& m)
 			B ^= 0x000000000000000a;
 			C ^= 0x000000000000000f;
 			D &= 0xfffffffffffffff0;	// clear colour of e1, f1, g1, h1 (make white)
+			castleDerived(0x000000000000000f, 0x000000000000000a, false);
 
-			hk ^= zobristKeys.zkDoWhiteCastle;
+			hashKey(zobristKeys.zkDoWhiteCastle, zobristKeys.zkDoBlackCastle);
 			if (whiteCanCastleLong) {
-				hk ^= zobristKeys.zkWhiteCanCastleLong;	// conditionally flip white castling long
+				hashKey(zobristKeys.zkWhiteCanCastleLong, zobristKeys.zkBlackCanCastleLong);	// conditionally flip white castling long
 			}
 
 			whiteDidCastle = 1;
@@ -214,10 +369,11 @@ ChessPosition& ChessPosition::performMove(const ChessMove& m)
 			B ^= 0x0000000000000028;
 			C ^= 0x00000000000000b8;
 			D &= 0xffffffffffffff07;	// clear colour of a1, b1, c1, d1, e1 (make white)
+			castleDerived(0x00000000000000b8, 0x0000000000000028, false);
 
-			hk ^= zobristKeys.zkDoWhiteCastleLong;
+			hashKey(zobristKeys.zkDoWhiteCastleLong, zobristKeys.zkDoBlackCastleLong);
 			if (whiteCanCastle) {
-				hk ^= zobristKeys.zkWhiteCanCastle;	// conditionally flip white castling
+				hashKey(zobristKeys.zkWhiteCanCastle, zobristKeys.zkBlackCanCastle);	// conditionally flip white castling
 			}
 
 			whiteDidCastleLong = 1;
@@ -229,11 +385,11 @@ ChessPosition& ChessPosition::performMove(const ChessMove& m)
 		// ordinary king move; White could have castled,
 		// but chose to move the King in a non-castling move
 		if (whiteCanCastle) {
-			hk ^= zobristKeys.zkWhiteCanCastle;	// flip white castling
+			hashKey(zobristKeys.zkWhiteCanCastle, zobristKeys.zkBlackCanCastle);	// flip white castling
 		}
 
 		if (whiteCanCastleLong) {
-			hk ^= zobristKeys.zkWhiteCanCastleLong;	// flip white castling long
+			hashKey(zobristKeys.zkWhiteCanCastleLong, zobristKeys.zkBlackCanCastleLong);	// flip white castling long
 		}
 
 		whiteForfeitedCastle = 1;
@@ -247,14 +403,14 @@ ChessPosition& ChessPosition::performMove(const ChessMove& m)
 			// Black moved K-side Rook and forfeits right to castle K-side
 			if (blackCanCastle){
 				blackForfeitedCastle = 1;
-				hk ^= zobristKeys.zkBlackCanCastle;	// flip black castling
+				hashKey(zobristKeys.zkBlackCanCastle, zobristKeys.zkWhiteCanCastle);	// flip black castling
 				blackCanCastle = 0;
 			}
 		} else if (nFromSquare == SquareIndex::a8) {
 			// Black moved the QS Rook and forfeits right to castle Q-side
 			if (blackCanCastleLong) {
 				blackForfeitedCastleLong = 1;
-				hk ^= zobristKeys.zkBlackCanCastleLong;	// flip black castling long
+				hashKey(zobristKeys.zkBlackCanCastleLong, zobristKeys.zkWhiteCanCastleLong);	// flip black castling long
 				blackCanCastleLong = 0;
 			}
 		}
@@ -265,14 +421,14 @@ ChessPosition& ChessPosition::performMove(const ChessMove& m)
 			// White moved K-side Rook and forfeits right to castle K-side
 			if (whiteCanCastle) {
 				whiteForfeitedCastle = 1;
-				hk ^= zobristKeys.zkWhiteCanCastle;	// flip white castling BROKEN !!!
+				hashKey(zobristKeys.zkWhiteCanCastle, zobristKeys.zkBlackCanCastle);	// flip white castling BROKEN !!!
 				whiteCanCastle = 0;
 			}
 		} else if (nFromSquare == SquareIndex::a1) {
 			// White moved the QSide Rook and forfeits right to castle Q-side
 			if (whiteCanCastleLong) {
 				whiteForfeitedCastleLong = 1;
-				hk ^= zobristKeys.zkWhiteCanCastleLong;	// flip white castling long
+				hashKey(zobristKeys.zkWhiteCanCastleLong, zobristKeys.zkBlackCanCastleLong);	// flip white castling long
 				whiteCanCastleLong = 0;
 			}
 		}
@@ -292,26 +448,26 @@ ChessPosition& ChessPosition::performMove(const ChessMove& m)
 														  | ((A & To) >> nToSquare);
 
 		// Update Hash
-		hk ^= zobristKeys.zkPieceOnSquare[capturedpiece][nToSquare]; // Remove captured Piece
+		hashPiece(capturedpiece, nToSquare); // Remove captured Piece
 
 		// if a rook was captured, it may take away castling rights
 		if (To & CORNERS) {
 			switch (capturedpiece) {
 			case WROOK:
 				if (whiteCanCastle && (To & H1)) {
-					hk ^= zobristKeys.zkWhiteCanCastle;
+					hashKey(zobristKeys.zkWhiteCanCastle, zobristKeys.zkBlackCanCastle);
 					whiteCanCastle = 0;
 				} else if (whiteCanCastleLong && (To & A1)) {
-					hk ^= zobristKeys.zkWhiteCanCastleLong;
+					hashKey(zobristKeys.zkWhiteCanCastleLong, zobristKeys.zkBlackCanCastleLong);
 					whiteCanCastleLong = 0;
 				}
 				break;
 			case BROOK:
 				if (blackCanCastle && (To & H8)){
-					hk ^= zobristKeys.zkBlackCanCastle;
+					hashKey(zobristKeys.zkBlackCanCastle, zobristKeys.zkWhiteCanCastle);
 					blackCanCastle = 0;
 				} else if (blackCanCastleLong && (To & A8)) {
-					hk ^= zobristKeys.zkBlackCanCastleLong;
+					hashKey(zobristKeys.zkBlackCanCastleLong, zobristKeys.zkWhiteCanCastleLong);
 					blackCanCastleLong = 0;
 				}
 			default:
@@ -331,10 +487,11 @@ ChessPosition& ChessPosition::performMove(const ChessMove& m)
 	B |= static_cast<int64_t>((m.piece & 2) >> 1) << m.destination;
 	C |= static_cast<int64_t>((m.piece & 4) >> 2) << m.destination;
 	D |= static_cast<int64_t>((m.piece & 8) >> 3) << m.destination;
+	moveDerived(1ull << m.origin, To, m.blackToMove, (m.piece & 7) == WKING);
 
 	// Update Hash
-	hk ^= zobristKeys.zkPieceOnSquare[m.piece][nFromSquare]; // Remove piece at From square
-	hk ^= zobristKeys.zkPieceOnSquare[m.piece][nToSquare]; // Place piece at To Square
+	hashPiece(m.piece, nFromSquare); // Remove piece at From square
+	hashPiece(m.piece, nToSquare); // Place piece at To Square
 
 	if ((m.piece & 7) == WPAWN) {
 		// For double-pawn moves, set EP square:
@@ -346,14 +503,16 @@ ChessPosition& ChessPosition::performMove(const ChessMove& m)
 				B |= To;
 				C &= ~To;
 				D |= To;
-				hk ^= zobristKeys.zkPieceOnSquare[BENPASSANT][nToSquare + 8]; // Place Black EP at (To+8)
+				addDerived(To, true);
+				hashPiece(BENPASSANT, nToSquare + 8); // Place Black EP at (To+8)
 			} else {
 				To >>= 8;
 				A |= To;
 				B |= To;
 				C &= ~To;
 				D &= ~To;
-				hk ^= zobristKeys.zkPieceOnSquare[WENPASSANT][nToSquare - 8]; // Place White EP at (To-8)
+				addDerived(To, false);
+				hashPiece(WENPASSANT, nToSquare - 8); // Place White EP at (To-8)
 			}
 			return *this;
 		}
@@ -367,15 +526,16 @@ ChessPosition& ChessPosition::performMove(const ChessMove& m)
 				B &= ~To;
 				C &= ~To;
 				D &= ~To;
-				hk ^= zobristKeys.zkPieceOnSquare[WPAWN][nToSquare + 8]; // Remove WHITE Pawn at (To+8)
+				hashPiece(WPAWN, nToSquare + 8); // Remove WHITE Pawn at (To+8)
 			} else {
 				To >>= 8;
 				A &= ~To;
 				B &= ~To;
 				C &= ~To;
 				D &= ~To;
-				hk ^= zobristKeys.zkPieceOnSquare[BPAWN][nToSquare - 8]; // Remove BLACK Pawn at (To-8)
+				hashPiece(BPAWN, nToSquare - 8); // Remove BLACK Pawn at (To-8)
 			}
+			removeDerived(To);
 			return *this;
 		}
 
@@ -384,31 +544,31 @@ ChessPosition& ChessPosition::performMove(const ChessMove& m)
 			A &= ~To;
 			B |= To;
 			C |= To;
-			hk ^= zobristKeys.zkPieceOnSquare[(m.blackToMove ? BPAWN : WPAWN)][nToSquare]; // Remove pawn at To square
-			hk ^= zobristKeys.zkPieceOnSquare[(m.blackToMove ? BQUEEN : WQUEEN)][nToSquare]; // place Queen at To square
+			hashPiece(m.blackToMove ? BPAWN : WPAWN, nToSquare); // Remove pawn at To square
+			hashPiece(m.blackToMove ? BQUEEN : WQUEEN, nToSquare); // place Queen at To square
 			return *this;
 		}
 
 		if (get_flag(m, promoteKnight)) {
 			C |= To;
-			hk ^= zobristKeys.zkPieceOnSquare[(m.blackToMove ? BPAWN : WPAWN)][nToSquare]; // Remove pawn at To square
-			hk ^= zobristKeys.zkPieceOnSquare[(m.blackToMove ? BKNIGHT : WKNIGHT)][nToSquare]; // place Knight at To square
+			hashPiece(m.blackToMove ? BPAWN : WPAWN, nToSquare); // Remove pawn at To square
+			hashPiece(m.blackToMove ? BKNIGHT : WKNIGHT, nToSquare); // place Knight at To square
 			return *this;
 		}
 
 		if (get_flag(m, promoteBishop)) {
 			A &= ~To;
 			B |= To;
-			hk ^= zobristKeys.zkPieceOnSquare[(m.blackToMove ? BPAWN : WPAWN)][nToSquare]; // Remove pawn at To square
-			hk ^= zobristKeys.zkPieceOnSquare[(m.blackToMove ? BBISHOP : WBISHOP)][nToSquare]; // place Bishop at To square
+			hashPiece(m.blackToMove ? BPAWN : WPAWN, nToSquare); // Remove pawn at To square
+			hashPiece(m.blackToMove ? BBISHOP : WBISHOP, nToSquare); // place Bishop at To square
 			return *this;
 		}
 
 		if (get_flag(m, promoteRook)) {
 			A &= ~To;
 			C |= To;
-			hk ^= zobristKeys.zkPieceOnSquare[(m.blackToMove ? BPAWN : WPAWN)][nToSquare]; // Remove pawn at To square
-			hk ^= zobristKeys.zkPieceOnSquare[(m.blackToMove ? BROOK : WROOK)][nToSquare];	// place Rook at To square
+			hashPiece(m.blackToMove ? BPAWN : WPAWN, nToSquare); // Remove pawn at To square
+			hashPiece(m.blackToMove ? BROOK : WROOK, nToSquare);	// place Rook at To square
 			return *this;
 		}
 	}
@@ -437,6 +597,7 @@ ChessPosition& ChessPosition::performMoveNoHash(const ChessMove& m)
 	B &= ~EnPassant;
 	C &= ~EnPassant;
 	D &= ~EnPassant;
+	removeDerived(EnPassant);
 
 	switch (m.piece) {
 	case BKING:
@@ -446,6 +607,7 @@ ChessPosition& ChessPosition::performMoveNoHash(const ChessMove& m)
 			B ^= 0x0a00000000000000;
 			C ^= 0x0f00000000000000;
 			D ^= 0x0f00000000000000;
+			castleDerived(0x0f00000000000000, 0x0a00000000000000, true);
 
 			blackDidCastle = 1;
 			blackCanCastle = 0;
@@ -458,6 +620,7 @@ ChessPosition& ChessPosition::performMoveNoHash(const ChessMove& m)
 			B ^= 0x2800000000000000;
 			C ^= 0xb800000000000000;
 			D ^= 0xb800000000000000;
+			castleDerived(0xb800000000000000, 0x2800000000000000, true);
 
 			blackDidCastleLong = 1;
 			blackCanCastle = 0;
@@ -477,6 +640,7 @@ ChessPosition& ChessPosition::performMoveNoHash(const ChessMove& m)
 			B ^= 0x000000000000000a;
 			C ^= 0x000000000000000f;
 			D &= 0xfffffffffffffff0;	// clear colour of e1, f1, g1, h1 (make white)
+			castleDerived(0x000000000000000f, 0x000000000000000a, false);
 
 			whiteDidCastle = 1;
 			whiteCanCastle = 0;
@@ -489,6 +653,7 @@ ChessPosition& ChessPosition::performMoveNoHash(const ChessMove& m)
 			B ^= 0x0000000000000028;
 			C ^= 0x00000000000000b8;
 			D &= 0xffffffffffffff07;	// clear colour of a1, b1, c1, d1, e1 (make white)
+			castleDerived(0x00000000000000b8, 0x0000000000000028, false);
 
 			whiteDidCastleLong = 1;
 			whiteCanCastle = 0;
@@ -582,6 +747,7 @@ ChessPosition& ChessPosition::performMoveNoHash(const ChessMove& m)
 	B |= static_cast<int64_t>((m.piece & 2) >> 1) << m.destination;
 	C |= static_cast<int64_t>((m.piece & 4) >> 2) << m.destination;
 	D |= static_cast<int64_t>((m.piece & 8) >> 3) << m.destination;
+	moveDerived(1ull << m.origin, To, m.blackToMove, (m.piece & 7) == WKING);
 
 	if ((m.piece & 7) == WPAWN) {
 		// For double-pawn moves, set EP square:
@@ -593,12 +759,14 @@ ChessPosition& ChessPosition::performMoveNoHash(const ChessMove& m)
 				B |= To;
 				C &= ~To;
 				D |= To;
+				addDerived(To, true);
 			} else {
 				To >>= 8;
 				A |= To;
 				B |= To;
 				C &= ~To;
 				D &= ~To;
+				addDerived(To, false);
 			}
 			return *this;
 		}
@@ -619,6 +787,7 @@ ChessPosition& ChessPosition::performMoveNoHash(const ChessMove& m)
 				C &= ~To;
 				D &= ~To;
 			}
+			removeDerived(To);
 			return *this;
 		}
 
@@ -669,7 +838,7 @@ void ChessPosition::getLegalMoves(ChessMove *movelist) const
 void ChessPosition::switchSides()
 {
 	blackToMove ^= 1;
-	hk ^= zobristKeys.zkBlackToMove;
+	hashKey(zobristKeys.zkBlackToMove, zobristKeys.zkBlackToMove);
 	return;
 }
 
@@ -678,6 +847,10 @@ void ChessPosition::clear(void)
 	A = B = C = D = 0;
 	flags = 0;
 	hk = 0;
+#if defined(CP_CANONICAL_HASH)
+	hkMirror = 0;
+#endif
+	calculateDerivedBitboards();
 }
 
 // Text Print functions //////////////////
@@ -8,9 +8,15 @@
 // class ChessPosition						//
 //////////////////////////////////////////////
 
+#include "zobristkeyset.h"
+
 #include <cstdint>
 #include <vector>
 
+// Build Options:
+// #define CP_DERIVED_BITBOARDS 1				// if defined, ChessPosition also carries incrementally-updated occupancy, colour and king bitboards
+#define CP_CANONICAL_HASH 1						// if defined, ChessPosition also carries the hash key of its colour-flipped mirror image (see getCanonicalHash())
+
 namespace juddperft {
 
 using Bitboard = uint64_t;
@@ -107,13 +113,17 @@ public:
 	Bitboard C;
 	Bitboard D;
 
+	// widths of the flags fields which come before the castling rights (see CASTLING_RIGHTS_MASK)
+	static constexpr unsigned int MOVEGEN_OPTION_BITS = 3;	// dontGenerateAllMoves, dontDetectCheckmates, dontDetectChecks
+	static constexpr unsigned int UNUSED_FLAG_BITS = 10;
+
 	union{
 		struct{
 			// move-generation options
 			uint32_t dontGenerateAllMoves : 1; // used just to prove whether there is at least one legal move
 			uint32_t dontDetectCheckmates : 1; // if set, generateMoves() will not test for 'IsCheckmated' flags
 			uint32_t dontDetectChecks : 1; // if set, generateMoves() will not test for 'isInCheck' flags (implies dontDetectCheckmates)
-			uint32_t unused : 10;
+			uint32_t unused : UNUSED_FLAG_BITS;
 			// actual position flags
 			uint32_t whiteCanCastle : 1;
 			uint32_t whiteCanCastleLong : 1;
@@ -139,16 +149,147 @@ public:
 	};
 	uint16_t moveNumber;
 	uint16_t halfMoves;
+
+#if defined(CP_DERIVED_BITBOARDS)
+	// derived Bitboards: these are redundant (they can always be calculated from A, B, C and D),
+	// but are maintained incrementally by performMove(), so that the move generator doesn't
+	// have to keep re-deriving them. See calculateDerivedBitboards()
+	Bitboard Occupied;	// all occupied squares (including EP squares)
+	Bitboard White;		// all squares occupied by White (including White EP square)
+	Bitboard Kings;		// both Kings (use D to tell them apart)
+#endif
+
 	bool operator==(const ChessPosition& Q) {
 		return((ChessPosition::A == Q.A) && (ChessPosition::B == Q.B) && (ChessPosition::C == Q.C) && (ChessPosition::D == Q.D) && (ChessPosition::flags == Q.flags));
 	}
 
 	HashKey hk;
 
+#if defined(CP_CANONICAL_HASH)
+	// hash key of the colour-flipped position (board turned upside-down, colours of all pieces swapped, other side to move),
+	// which is maintained incrementally alongside hk. A position and its mirror image have the same perft counts,
+	// so they can share hash table entries.
+	HashKey hkMirror;
+#endif
+
 public:
 	ChessPosition();
 	ChessPosition& setupStartPosition();
 	ChessPosition& calculateHash();
+	ChessPosition& calculateDerivedBitboards();
+	ChessPosition& flipColours(); // turn the board upside-down and swap the colours of all pieces (note: doesn't update hash)
+
+	// accessors for derived Bitboards (these work regardless of whether CP_DERIVED_BITBOARDS is defined)
+
+	Bitboard getOccupied() const
+	{
+#if defined(CP_DERIVED_BITBOARDS)
+		return Occupied;
+#else
+		return A | B | C;
+#endif
+	}
+
+	Bitboard getWhiteOccupied() const
+	{
+#if defined(CP_DERIVED_BITBOARDS)
+		return White;
+#else
+		return (A | B | C) & ~D;
+#endif
+	}
+
+	Bitboard getBlackOccupied() const
+	{
+		return D; // (there are no "black empty" squares)
+	}
+
+	Bitboard getWhiteKing() const
+	{
+#if defined(CP_DERIVED_BITBOARDS)
+		return Kings & ~D;
+#else
+		return A & B & C & ~D;
+#endif
+	}
+
+	Bitboard getBlackKing() const
+	{
+#if defined(CP_DERIVED_BITBOARDS)
+		return Kings & D;
+#else
+		return A & B & C & D;
+#endif
+	}
+
+	// functions for keeping derived Bitboards in step with direct manipulation of A, B, C and D
+	// (these compile to nothing when CP_DERIVED_BITBOARDS is not defined)
+
+	// a piece has moved from From to To (To may have been occupied by an enemy piece)
+	void moveDerived(Bitboard From, Bitboard To, bool black, bool isKing)
+	{
+#if defined(CP_DERIVED_BITBOARDS)
+		const Bitboard X = ~(From | To);
+		Occupied = (Occupied & X) | To;
+		White = (White & X) | (black ? 0ull : To);
+		if (isKing) {
+			Kings = (Kings & X) | To;
+		}
+#else
+		(void)From; (void)To; (void)black; (void)isKing;
+#endif
+	}
+
+	// squares in X have been vacated
+	void removeDerived(Bitboard X)
+	{
+#if defined(CP_DERIVED_BITBOARDS)
+		Occupied &= ~X;
+		White &= ~X;
+#else
+		(void)X;
+#endif
+	}
+
+	// squares in X have been populated (with a non-King)
+	void addDerived(Bitboard X, bool black)
+	{
+#if defined(CP_DERIVED_BITBOARDS)
+		Occupied |= X;
+		if (!black) {
+			White |= X;
+		}
+#else
+		(void)X; (void)black;
+#endif
+	}
+
+	// apply a castling move, given the XOR mask for the C plane (which toggles K, R and the 2 squares they move to)
+	// and the King's origin and destination
+	void castleDerived(Bitboard CMask, Bitboard KingMask, bool black)
+	{
+#if defined(CP_DERIVED_BITBOARDS)
+		Occupied ^= CMask;
+		if (!black) {
+			White ^= CMask;
+		}
+		Kings ^= KingMask;
+#else
+		(void)CMask; (void)KingMask; (void)black;
+#endif
+	}
+
+	// restore derived Bitboards from another position
+	void copyDerived(const ChessPosition& P)
+	{
+#if defined(CP_DERIVED_BITBOARDS)
+		Occupied = P.Occupied;
+		White = P.White;
+		Kings = P.Kings;
+#else
+		(void)P;
+#endif
+	}
 
 	ChessPosition& setPieceAtSquare(const piece_t& piece,  unsigned int s)
 	{
@@ -167,6 +308,7 @@ public:
 		D |= static_cast<int64_t>((piece & 8) >> 3) << s;
 
 		calculateHash();
+		calculateDerivedBitboards();
 
 		return *this;
 	}
@@ -186,6 +328,28 @@ public:
 		return static_cast<piece_t>(V);
 	}
 
+	// getCanonicalHash() : a hash key which is the same for a position and its mirror images (for use as a hash table key).
+	// Without CP_CANONICAL_HASH, this is just hk
+	HashKey getCanonicalHash() const
+	{
+#if defined(CP_CANONICAL_HASH)
+		const HashKey k = (hk < hkMirror) ? hk : hkMirror;
+
+		// with no pawns and no castling rights, the left-right mirror images are equivalent too
+		if (((A & ~B & ~C) | (flags & CASTLING_RIGHTS_MASK)) == 0) {
+			return calculateLeftRightCanonicalHash(k);
+		}
+		return k;
+#else
+		return hk;
+#endif
+	}
+
+	// calculateVerificationKey() : a second 64-bit hash of the position, calculated from scratch, and independent of the
+	// Zobrist keys (used to detect hash collisions; see hashverifier.h). Like getCanonicalHash(), it is the same for a position
+	// and its mirror images
+	HashKey calculateVerificationKey() const;
+
 	// performMove() : applies a move to a position, including differential update to hash key
 	ChessPosition& performMove(const ChessMove& m);
 
@@ -204,6 +368,35 @@ public:
 	static void printBitboard(Bitboard b);
 
 private:
+	// whiteCanCastle, whiteCanCastleLong, blackCanCastle, blackCanCastleLong (the four 1-bit fields after the unused ones;
+	// setupStartPosition() checks this against the bit-fields themselves)
+	static constexpr uint32_t CASTLING_RIGHTS_MASK = 0xfu << (MOVEGEN_OPTION_BITS + UNUSED_FLAG_BITS);
+
+#if defined(CP_CANONICAL_HASH)
+	HashKey calculateLeftRightCanonicalHash(HashKey k) const;
+#endif
+
+	// hash key updates (keeping hkMirror in step, if CP_CANONICAL_HASH is defined)
+
+	// toggle piece on square q
+	void hashPiece(piece_t piece, unsigned int q)
+	{
+		hk ^= zobristKeys.zkPieceOnSquare[piece][q];
+#if defined(CP_CANONICAL_HASH)
+		hkMirror ^= zobristKeys.zkPieceOnSquare[piece ^ 8][q ^ 56];
+#endif
+	}
+
+	// toggle key k, which corresponds to mirroredKey in the colour-flipped position
+	void hashKey(ZobristKey k, ZobristKey mirroredKey)
+	{
+		hk ^= k;
+#if defined(CP_CANONICAL_HASH)
+		hkMirror ^= mirroredKey;
+#else
+		(void)mirroredKey;
+#endif
+	}
 };
 
 } // namespace juddperft
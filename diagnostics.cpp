@@ -30,6 +30,7 @@ SOFTWARE.
 #include "movegen.h"
 #include "fen.h"
 #include "raiitimer.h"
+#include "resultsdb.h"
 
 #include <cstring>
 #include <cinttypes>
@@ -53,7 +54,7 @@ void printPerftScoreFfromFEN(const char* pzFENstring, unsigned int depth, uint64
 	P.printPosition();
 
 	nodecount_t n = 0;
-	perftFastMT(P, depth, n);
+	perftFastMT(P, depth, n); // (not perftFastCached(): the self-test is of the move generator, not of the results database)
 	printf("Perft %d: %" PRIu64 " (Correct! Answer= %" PRIu64 ")\n", depth, n, correctAnswer);
 
 	if (n != correctAnswer)
@@ -97,7 +98,7 @@ void findPerftBug(const std::string& validatorPath, const ChessPosition* pP, int
 
 		pP->printPosition();
 		printMoveList(MoveList);
-		perftMT(*pP, 1, 1, &T);
+		perftCached(*pP, 1, T);
 		int nResult = perftValidateWithExternal(validatorPath, fenString, 1, T.nMoves);
 		if (nResult == PERFTVALIDATE_FALSE) {
 			std::cout << "Engines disagree on Number of moves from this position" << std::endl;
@@ -132,8 +133,7 @@ void findPerftBug(const std::string& validatorPath, const ChessPosition* pP, int
 		printMove(*pM);
 		std::cout << "Position: " << fenString << std::endl;
 
-		T.nMoves = T.nCapture = T.nEPCapture = T.nCastle = T.nCastleLong = T.nPromotion = T.nCheck = T.nCheckmate = 0LL;
-		perftMT(Q, depth - 1, 1, &T);
+		perftCached(Q, depth - 1, T);
 
 		std::cout << "\nValidating depth: " << depth - 1 << " perft: " << T.nMoves << std::endl;
 		int nResult = perftValidateWithExternal(validatorPath, fenString, depth - 1, T.nMoves);
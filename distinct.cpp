@@ -0,0 +1,257 @@
+/*
+
+MIT License
+
+Copyright(c) 2016-2025 Judd Niemann
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files(the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include "distinct.h"
+#include "engine.h"
+#include "search.h"
+
+#include <cstdio>
+#include <cstring>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <numeric>
+#include <thread>
+
+namespace juddperft {
+
+//////////////////////////////////////////////
+// PositionSet
+//////////////////////////////////////////////
+
+PositionSet::PositionSet(size_t memoryBytes)
+{
+	// largest power of 2 number of slots which fits (but at least 64 slots per shard)
+	capacity = NUM_SHARDS * 64;
+	while (capacity * 2 * sizeof(FrontierRecord) <= memoryBytes) {
+		capacity *= 2;
+	}
+
+	shardMask = capacity / NUM_SHARDS - 1;
+	shardLimit = (shardMask + 1) / 4 * 3;
+	slots = std::make_unique<FrontierRecord[]>(capacity);
+	shards = std::make_unique<Shard[]>(NUM_SHARDS);
+	clear();
+}
+
+uint64_t PositionSet::hashOf(const PackedPosition& position)
+{
+	uint64_t w[4] = {0, 0, 0, 0};
+	std::memcpy(w, &position, sizeof(PackedPosition));
+
+	uint64_t h = 0;
+	for (uint64_t x : w) {
+		h = (h ^ x) * 0x9e3779b97f4a7c15;
+		h ^= h >> 29;
+	}
+
+	// (murmur3 finaliser)
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccd;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53;
+	h ^= h >> 33;
+	return h;
+}
+
+bool PositionSet::insert(const PackedPosition& position, uint64_t multiplicity)
+{
+	const uint64_t h = hashOf(position);
+	const size_t shardIndex = h >> 58; // (top 6 bits select the shard)
+	Shard& shard = shards[shardIndex];
+	FrontierRecord* table = &slots[shardIndex * (shardMask + 1)];
+
+	std::lock_guard<std::mutex> lock(shard.mutex);
+	for (size_t i = h & shardMask; ; i = (i + 1) & shardMask) {
+		FrontierRecord& r = table[i];
+		if (r.position.occupied == 0) { // (empty slot: a real position always has at least 2 kings)
+			if (shard.count >= shardLimit) {
+				return false;
+			}
+			r.position = position;
+			r.multiplicity = multiplicity;
+			shard.count++;
+			return true;
+		}
+
+		if (r.position == position) {
+			r.multiplicity += multiplicity;
+			return true;
+		}
+	}
+}
+
+void PositionSet::clear()
+{
+	std::memset(static_cast<void*>(slots.get()), 0, capacity * sizeof(FrontierRecord));
+	for (unsigned int s = 0; s < NUM_SHARDS; s++) {
+		shards[s].count = 0;
+	}
+}
+
+uint64_t PositionSet::size() const
+{
+	uint64_t n = 0;
+	for (unsigned int s = 0; s < NUM_SHARDS; s++) {
+		n += shards[s].count;
+	}
+	return n;
+}
+
+void PositionSet::extract(std::vector<FrontierRecord>& records)
+{
+	records.clear();
+	records.reserve(size());
+	for (size_t i = 0; i < capacity; i++) {
+		if (slots[i].position.occupied != 0) {
+			records.push_back(slots[i]);
+		}
+	}
+	clear();
+}
+
+//////////////////////////////////////////////
+// Distinct-position counting
+//////////////////////////////////////////////
+
+// expandInMemory() : insert the children of every position in level into set. Returns false if the set overflowed
+static bool expandInMemory(const std::vector<FrontierRecord>& level, PositionSet& set, nodecount_t& generated)
+{
+	unsigned int nThreads = std::min(std::thread::hardware_concurrency(), std::min(theEngine.nNumCores, static_cast<unsigned int>(MAX_THREADS)));
+	nThreads = std::max(1u, nThreads);
+
+	constexpr size_t chunkSize = 256;
+	std::atomic<size_t> nextChunk{0};
+	std::atomic<bool> overflow{false};
+	std::vector<nodecount_t> subTotal(nThreads, 0);
+	std::vector<std::thread> threads;
+
+	for (unsigned int t = 0; t < nThreads; t++) {
+		threads.emplace_back([&, t] {
+			ChessMove movelist[MOVELIST_SIZE];
+			nodecount_t n = 0;
+			for (size_t first = nextChunk.fetch_add(chunkSize); first < level.size() && !overflow; first = nextChunk.fetch_add(chunkSize)) {
+				const size_t last = std::min(level.size(), first + chunkSize);
+				for (size_t i = first; i < last; i++) {
+					ChessPosition P = unpackPosition(level[i].position);
+					P.dontDetectChecks = 1;
+					MoveGenerator::generateMoves(P, movelist);
+					for (unsigned int m = 0; m < move_count(movelist); m++) {
+						ChessPosition Q = P;
+						Q.performMoveNoHash(movelist[m]);
+						Q.blackToMove ^= 1;
+						if (!set.insert(packPosition(Q), level[i].multiplicity)) {
+							overflow = true;
+							break;
+						}
+					}
+					n += move_count(movelist);
+				}
+			}
+			subTotal[t] = n;
+		});
+	}
+
+	for (auto& th : threads) {
+		th.join();
+	}
+
+	generated = std::accumulate(subTotal.begin(), subTotal.end(), 0ull);
+	return !overflow;
+}
+
+bool countDistinctPositions(const ChessPosition& P, int depth, size_t memoryBytes, const std::string& spillDir,
+							const std::function<void(const DistinctLevelInfo&)>& onLevel)
+{
+	namespace fs = std::filesystem;
+	using clock = std::chrono::steady_clock;
+
+	// half the memory for the set, and (up to) half for the level being expanded
+	std::vector<FrontierRecord> level{{packPosition(P), 1}};
+	auto set = std::make_unique<PositionSet>(memoryBytes / 2);
+
+	int d = 1;
+	for (; d <= depth; d++) {
+		const auto start = clock::now();
+		DistinctLevelInfo info;
+		info.depth = d;
+		if (!expandInMemory(level, *set, info.generated)) {
+			break; // doesn't fit in memory; continue on disk
+		}
+
+		set->extract(level);
+		info.distinctPositions = level.size();
+		for (const FrontierRecord& r : level) {
+			info.paths += r.multiplicity;
+		}
+
+		info.milliseconds = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+		info.memoryBytes = set->bytesAllocated() + level.capacity() * sizeof(FrontierRecord);
+		onLevel(info);
+	}
+
+	if (d > depth) {
+		return true;
+	}
+
+	// Spill to disk: write out the last completed level, and carry on from there using external-memory expansion
+	set.reset();
+
+	std::error_code ec;
+	fs::create_directories(spillDir, ec);
+	auto levelPath = [&spillDir](int level) {
+		return (fs::path(spillDir) / ("distinct-" + std::to_string(level) + ".dat")).string();
+	};
+
+	if (!writeRun(level, levelPath(d - 1))) {
+		printf("distinct: unable to write to %s\n", spillDir.c_str());
+		return false;
+	}
+	level.shrink_to_fit();
+
+	for (; d <= depth; d++) {
+		const auto start = clock::now();
+		DistinctLevelInfo info;
+		info.depth = d;
+		info.onDisk = true;
+		if (!expandLevel(levelPath(d - 1), levelPath(d), memoryBytes, info.distinctPositions, info.paths)) {
+			printf("distinct: I/O error while expanding depth %d\n", d);
+			return false;
+		}
+
+		fs::remove(levelPath(d - 1), ec);
+		info.milliseconds = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+		info.memoryBytes = fs::file_size(levelPath(d), ec);
+		onLevel(info);
+	}
+
+	fs::remove(levelPath(depth), ec);
+	return true;
+}
+
+} // namespace juddperft
@@ -0,0 +1,107 @@
+/*
+
+MIT License
+
+Copyright(c) 2016-2025 Judd Niemann
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files(the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+//////////////////////////////////////////////
+// distinct.h								//
+// Defines:									//
+// class PositionSet						//
+// Distinct-position counting				//
+//////////////////////////////////////////////
+
+#ifndef _DISTINCT_H
+#define _DISTINCT_H 1
+
+#include "extperft.h"
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace juddperft {
+
+// PositionSet : compact concurrent hash set of positions (in packed form), each with a multiplicity.
+// The set is split into shards, each of which is an open-addressed table with its own lock.
+// The capacity is fixed: insert() fails (returns false) once a shard is 3/4 full, rather than growing.
+// Positions are compared in full (board + flags), so there are no false matches.
+
+class PositionSet
+{
+public:
+	static constexpr unsigned int NUM_SHARDS = 64;
+
+	explicit PositionSet(size_t memoryBytes);
+
+	bool insert(const PackedPosition& position, uint64_t multiplicity);
+	void clear();
+	uint64_t size() const;
+	size_t bytesAllocated() const { return capacity * sizeof(FrontierRecord); }
+
+	// extract() : move contents (in no particular order) into records, and clear the set
+	void extract(std::vector<FrontierRecord>& records);
+
+private:
+	struct alignas(64) Shard
+	{
+		std::mutex mutex;
+		size_t count{0};
+	};
+
+	size_t capacity;						// total number of slots (a power of 2)
+	size_t shardMask;						// slots per shard - 1
+	size_t shardLimit;						// maximum entries per shard
+	std::unique_ptr<FrontierRecord[]> slots;
+	std::unique_ptr<Shard[]> shards;
+
+	static uint64_t hashOf(const PackedPosition& position);
+};
+
+// Distinct-position counting
+// --------------------------
+// The set of positions reachable at depth d is exactly the set of children of the (distinct) positions at depth d-1,
+// so the tree is expanded breadth-first, deduplicating each level in a PositionSet.
+// If a level doesn't fit in memoryBytes, the count falls back to the external-memory level expansion used by extperft,
+// with files in spillDir.
+
+struct DistinctLevelInfo
+{
+	int depth{0};
+	uint64_t distinctPositions{0};
+	nodecount_t paths{0};					// number of move sequences leading to depth (ie perft(depth))
+	nodecount_t generated{0};				// positions generated (ie children of distinct positions at depth-1)
+	double milliseconds{0.0};
+	size_t memoryBytes{0};					// memory used by the level (in-memory), or size of level file (on disk)
+	bool onDisk{false};
+};
+
+bool countDistinctPositions(const ChessPosition& P, int depth, size_t memoryBytes, const std::string& spillDir,
+							const std::function<void(const DistinctLevelInfo&)>& onLevel);
+
+} // namespace juddperft
+
+#endif // _DISTINCT_H
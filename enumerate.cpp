@@ -0,0 +1,344 @@
+/*
+
+MIT License
+
+Copyright(c) 2016-2025 Judd Niemann
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files(the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include "enumerate.h"
+#include "engine.h"
+#include "movestack.h"
+#include "search.h"
+
+#include <cstdio>
+#include <cstring>
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <numeric>
+#include <thread>
+#include <vector>
+
+#if defined(_MSC_VER)
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+namespace juddperft {
+
+constexpr size_t ENUMERATE_BUFFER_SIZE = 4 << 20;	// size of each thread's output buffer
+
+// EnumerateOutput : the shared output stream. Threads fill their own buffers, and only take the lock to write them out
+class EnumerateOutput
+{
+public:
+	EnumerateOutput(FILE* f) : f(f) {}
+
+	void write(const char* data, size_t n)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (fwrite(data, 1, n, f) != n) {
+			ok = false;
+		}
+	}
+
+	bool isOk() const { return ok; }
+
+private:
+	FILE* f;
+	std::mutex mutex;
+	std::atomic<bool> ok{true};
+};
+
+// EnumerateWorker : walks a subtree, formatting each position at the target depth into its buffer
+class EnumerateWorker
+{
+public:
+	EnumerateWorker(EnumerateOutput& output, const EnumerateOptions& options, int depth)
+		: output(output), options(options), depth(depth),
+		  maxRecordSize((options.format == EnumerateFormat::Binary) ? sizeof(PackedPosition) + depth * sizeof(CompactMove)
+																	 : 128 + 6 * depth) // (FEN + path: generous upper bound)
+	{
+		buffer.resize(std::max(ENUMERATE_BUFFER_SIZE, 2 * maxRecordSize));
+	}
+
+	~EnumerateWorker()
+	{
+		flush();
+	}
+
+	// walk() : enumerate the positions reachable from P (which is at the given ply, reached by path[0 .. ply-1])
+	void walk(const ChessPosition& P, int ply)
+	{
+		if (ply == depth) {
+			emit(P);
+			return;
+		}
+
+		MoveStack& moveStack = MoveStack::forThisThread();
+		ChessMove* moveList = moveStack.scratch();
+		MoveGenerator::generateMoves(P, moveList);
+		const int movecount = move_count(moveList);
+
+		const CompactMove* moves = moveStack.push(moveList, movecount);
+		for (int i = 0; i < movecount; i++) {
+			path[ply] = moves[i];
+			ChessPosition Q = P;
+			Q.performMoveNoHash(expandMove(P, moves[i])).switchSides();
+			walk(Q, ply + 1);
+		}
+		moveStack.pop(movecount);
+	}
+
+	CompactMove path[MOVELIST_SIZE];
+	nodecount_t count{0};
+
+private:
+	EnumerateOutput& output;
+	const EnumerateOptions& options;
+	const int depth;
+	const size_t maxRecordSize;
+	std::vector<char> buffer;
+	size_t used{0};
+
+	void flush()
+	{
+		if (used != 0) {
+			output.write(buffer.data(), used);
+			used = 0;
+		}
+	}
+
+	void emit(const ChessPosition& P)
+	{
+		if (used + maxRecordSize > buffer.size()) {
+			flush();
+		}
+
+		char* s = buffer.data() + used;
+		if (options.format == EnumerateFormat::Binary) {
+			const PackedPosition packed = packPosition(P);
+			std::memcpy(s, &packed, sizeof(PackedPosition));
+			s += sizeof(PackedPosition);
+			if (options.includePath) {
+				std::memcpy(s, path, depth * sizeof(CompactMove));
+				s += depth * sizeof(CompactMove);
+			}
+		} else {
+			s = appendFen(s, P);
+			if (options.includePath) {
+				*s++ = '\t';
+				for (int ply = 0; ply < depth; ply++) {
+					s = appendMove(s, path[ply]);
+					*s++ = ' ';
+				}
+				s -= (depth > 0);
+			}
+			*s++ = '\n';
+		}
+
+		used = s - buffer.data();
+		count++;
+	}
+
+	// appendFen() : write the FEN string for P (produces the same output as writeFen(), but without all the strcat()s,
+	// which would otherwise make formatting much slower than generating the positions in the first place)
+	static char* appendFen(char* s, const ChessPosition& P)
+	{
+		static constexpr char pieceChar[16] = {0, 'P', 'B', 0, 'R', 'N', 'Q', 'K', 0, 'p', 'b', 0, 'r', 'n', 'q', 'k'};
+
+		int epSquare = 0;
+		for (int rank = 7; rank >= 0; rank--) {
+			int nBlanks = 0;
+			for (int square = rank * 8 + 7; square >= rank * 8; square--) {
+				const piece_t piece = P.getPieceAtSquare(square);
+				if (pieceChar[piece] == 0) {
+					nBlanks++;
+					if (piece == WENPASSANT || piece == BENPASSANT) {
+						epSquare = square;
+					}
+				} else {
+					if (nBlanks != 0) {
+						*s++ = static_cast<char>('0' + nBlanks);
+						nBlanks = 0;
+					}
+					*s++ = pieceChar[piece];
+				}
+			}
+			if (nBlanks != 0) {
+				*s++ = static_cast<char>('0' + nBlanks);
+			}
+			if (rank != 0) {
+				*s++ = '/';
+			}
+		}
+
+		*s++ = ' ';
+		*s++ = P.blackToMove ? 'b' : 'w';
+		*s++ = ' ';
+
+		if (!(P.whiteCanCastle || P.whiteCanCastleLong || P.blackCanCastle || P.blackCanCastleLong)) {
+			*s++ = '-';
+		} else {
+			if (P.whiteCanCastle) *s++ = 'K';
+			if (P.whiteCanCastleLong) *s++ = 'Q';
+			if (P.blackCanCastle) *s++ = 'k';
+			if (P.blackCanCastleLong) *s++ = 'q';
+		}
+		*s++ = ' ';
+
+		if (epSquare != 0) {
+			*s++ = static_cast<char>('h' - epSquare % 8);
+			*s++ = static_cast<char>('1' + epSquare / 8);
+		} else {
+			*s++ = '-';
+		}
+		*s++ = ' ';
+
+		s = appendNumber(s, P.halfMoves);
+		*s++ = ' ';
+		return appendNumber(s, P.moveNumber);
+	}
+
+	static char* appendNumber(char* s, unsigned int n)
+	{
+		char digits[10];
+		int nDigits = 0;
+		do {
+			digits[nDigits++] = static_cast<char>('0' + n % 10);
+			n /= 10;
+		} while (n != 0);
+
+		while (nDigits > 0) {
+			*s++ = digits[--nDigits];
+		}
+		return s;
+	}
+
+	// appendMove() : write a CompactMove in co-ordinate notation (eg e7e8q)
+	static char* appendMove(char* s, CompactMove cm)
+	{
+		const unsigned int origin = cm & 0x3f;
+		const unsigned int destination = (cm >> 6) & 0x3f;
+		*s++ = 'h' - (origin % 8);
+		*s++ = '1' + (origin / 8);
+		*s++ = 'h' - (destination % 8);
+		*s++ = '1' + (destination / 8);
+		switch (cm >> 12) {
+		case WQUEEN: *s++ = 'q'; break;
+		case WROOK: *s++ = 'r'; break;
+		case WBISHOP: *s++ = 'b'; break;
+		case WKNIGHT: *s++ = 'n'; break;
+		default: break;
+		}
+		return s;
+	}
+};
+
+bool enumeratePositions(const ChessPosition& P, int depth, const EnumerateOptions& options, nodecount_t& nPositions)
+{
+	nPositions = 0;
+	depth = std::max(0, std::min(depth, MOVELIST_SIZE - 1));
+
+	const bool toStdout = (options.output == "-");
+	FILE* f = toStdout ? stdout : fopen(options.output.c_str(), options.format == EnumerateFormat::Binary ? "wb" : "w");
+	if (f == nullptr) {
+		return false;
+	}
+
+#if defined(_MSC_VER)
+	if (toStdout && options.format == EnumerateFormat::Binary) {
+		_setmode(_fileno(stdout), _O_BINARY);
+	}
+#endif
+
+	EnumerateOutput output(f);
+
+	if (options.format == EnumerateFormat::Binary) {
+		EnumerateHeader header;
+		std::memset(&header, 0, sizeof(header));
+		std::memcpy(header.magic, "JPENUM1", 8);
+		header.depth = static_cast<uint16_t>(depth);
+		header.pathLength = static_cast<uint16_t>(options.includePath ? depth : 0);
+		header.recordSize = static_cast<uint32_t>(sizeof(PackedPosition) + header.pathLength * sizeof(CompactMove));
+		output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	}
+
+	ChessPosition root = P;
+	root.dontDetectChecks = 1;
+
+	// split the tree into work items at splitDepth, so that there are enough of them to keep all the threads busy
+	struct WorkItem
+	{
+		ChessPosition P;
+		std::vector<CompactMove> path;
+	};
+
+	const int splitDepth = std::min(depth, 2);
+	std::vector<WorkItem> work{{root, {}}};
+	for (int ply = 0; ply < splitDepth; ply++) {
+		std::vector<WorkItem> next;
+		ChessMove movelist[MOVELIST_SIZE];
+		for (const WorkItem& item : work) {
+			MoveGenerator::generateMoves(item.P, movelist);
+			for (unsigned int i = 0; i < move_count(movelist); i++) {
+				WorkItem child{item.P, item.path};
+				child.P.performMoveNoHash(movelist[i]).switchSides();
+				child.path.push_back(compactMove(movelist[i]));
+				next.push_back(std::move(child));
+			}
+		}
+		work.swap(next);
+	}
+
+	unsigned int nThreads = std::min(std::thread::hardware_concurrency(), std::min(theEngine.nNumCores, static_cast<unsigned int>(MAX_THREADS)));
+	nThreads = std::max(1u, std::min(nThreads, static_cast<unsigned int>(work.size())));
+	std::vector<nodecount_t> subTotal(nThreads, 0);
+	std::atomic<size_t> nextItem{0};
+	std::vector<std::thread> threads;
+
+	for (unsigned int t = 0; t < nThreads; t++) {
+		threads.emplace_back([&, t] {
+			EnumerateWorker worker(output, options, depth);
+			for (size_t i = nextItem++; i < work.size() && output.isOk(); i = nextItem++) {
+				std::copy(work[i].path.begin(), work[i].path.end(), worker.path);
+				worker.walk(work[i].P, splitDepth);
+			}
+			subTotal[t] = worker.count;
+		});
+	}
+
+	for (auto& th : threads) {
+		th.join();
+	}
+
+	nPositions = std::accumulate(subTotal.begin(), subTotal.end(), 0ull);
+
+	bool ok = output.isOk() && (fflush(f) == 0);
+	if (!toStdout) {
+		ok = (fclose(f) == 0) && ok;
+	}
+	return ok;
+}
+
+} // namespace juddperft
@@ -0,0 +1,86 @@
+/*
+
+MIT License
+
+Copyright(c) 2016-2025 Judd Niemann
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files(the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+//////////////////////////////////////////////
+// enumerate.h								//
+// Defines:									//
+// Position enumeration (streaming output	//
+// of every position at a given depth)		//
+//////////////////////////////////////////////
+
+#ifndef _ENUMERATE_H
+#define _ENUMERATE_H 1
+
+#include "chessposition.h"
+#include "extperft.h"
+#include "movegen.h"
+
+#include <cstdint>
+#include <string>
+
+namespace juddperft {
+
+// Output formats:
+//
+// Binary:	an EnumerateHeader, followed by fixed-width records, each consisting of a PackedPosition (see extperft.h),
+//			optionally followed by the path from the root position, as pathLength 16-bit CompactMoves (see movestack.h)
+// Fen:		one line per position: the FEN string, optionally followed by a tab and the path from the root position
+//			as space-separated moves in co-ordinate notation (eg e2e4 e7e5 g1f3)
+//
+// Positions are written in no particular order (each thread writes out its buffer whenever it fills up).
+// Every path is written, so transposed positions appear once for each path leading to them.
+
+enum class EnumerateFormat
+{
+	Binary,
+	Fen
+};
+
+#pragma pack(push, 1)
+struct EnumerateHeader
+{
+	char magic[8];			// "JPENUM1"
+	uint16_t depth;
+	uint16_t pathLength;	// number of CompactMoves in each record (0 if path not included)
+	uint32_t recordSize;	// in bytes
+};
+#pragma pack(pop)
+
+static_assert(sizeof(EnumerateHeader) == 16);
+
+struct EnumerateOptions
+{
+	std::string output;		// file name, or "-" for stdout
+	EnumerateFormat format{EnumerateFormat::Binary};
+	bool includePath{false};
+};
+
+// enumeratePositions() : write out every position at depth (nPositions receives the number written). Returns false on I/O error
+bool enumeratePositions(const ChessPosition& P, int depth, const EnumerateOptions& options, nodecount_t& nPositions);
+
+} // namespace juddperft
+
+#endif // _ENUMERATE_H
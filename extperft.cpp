@@ -0,0 +1,713 @@
+/*
+
+MIT License
+
+Copyright(c) 2016-2025 Judd Niemann
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files(the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include "extperft.h"
+#include "engine.h"
+#include "fen.h"
+#include "search.h"
+#include "utils.h"
+
+#include <cinttypes>
+#include <cstdio>
+
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <queue>
+#include <thread>
+
+namespace juddperft {
+
+namespace fs = std::filesystem;
+
+constexpr size_t IO_BLOCK_RECORDS = 4096;	// number of records read / written at a time
+constexpr size_t MAX_MERGE_FANIN = 128;		// maximum number of runs merged in a single pass
+
+//////////////////////////////////////////////
+// Packed Positions
+//////////////////////////////////////////////
+
+// epIsUsable() : true if the side to move has a legal e.p. capture onto the e.p. square
+static bool epIsUsable(const ChessPosition& P, unsigned int ep)
+{
+	const bool whiteEP = (ep < 32);					// white's e.p. square (rank 3) can only be captured by black
+	const unsigned int pawnRank = whiteEP ? 3 : 4;
+	const piece_t capturer = whiteEP ? BPAWN : WPAWN;
+	const int file = ep % 8;
+	bool pseudoLegal = false;
+	for (int f : {file - 1, file + 1}) {
+		if (f >= 0 && f < 8 && P.getPieceAtSquare(pawnRank * 8 + f) == capturer) {
+			pseudoLegal = true;
+		}
+	}
+
+	if (!pseudoLegal) {
+		return false;
+	}
+
+	// there is a pawn in position, but the capture might still be illegal (eg pinned pawn):
+	ChessPosition Q = P;
+	Q.dontDetectChecks = 1;
+	ChessMove movelist[MOVELIST_SIZE];
+	MoveGenerator::generateMoves(Q, movelist);
+	for (unsigned int i = 0; i < move_count(movelist); i++) {
+		if (get_flag(movelist[i], enPassantCapture)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+PackedPosition packPosition(const ChessPosition& P)
+{
+	PackedPosition packed;
+	std::memset(&packed, 0, sizeof(PackedPosition));
+
+	const Bitboard EP = P.A & P.B & ~P.C;
+	packed.occupied = P.getOccupied() & ~EP;
+
+	int n = 0;
+	for (Bitboard X = packed.occupied; X != 0; X &= (X - 1)) {
+		const unsigned int sq = getSquareIndex(X);
+		packed.pieces[n >> 1] |= static_cast<uint8_t>(P.getPieceAtSquare(sq) << ((n & 1) << 2));
+		n++;
+	}
+
+	packed.flags = static_cast<uint8_t>(P.whiteCanCastle | (P.whiteCanCastleLong << 1) | (P.blackCanCastle << 2) | (P.blackCanCastleLong << 3) | (P.blackToMove << 4));
+
+	if (EP != 0) {
+		const unsigned int ep = getSquareIndex(EP);
+		if (epIsUsable(P, ep)) {
+			packed.epSquare = static_cast<uint8_t>(ep + 1);
+		}
+	}
+
+	return packed;
+}
+
+ChessPosition unpackPosition(const PackedPosition& packed)
+{
+	ChessPosition P;
+	P.clear();
+
+	int n = 0;
+	for (Bitboard X = packed.occupied; X != 0; X &= (X - 1)) {
+		const unsigned int sq = getSquareIndex(X);
+		const Bitboard piece = (packed.pieces[n >> 1] >> ((n & 1) << 2)) & 0x0f;
+		P.A |= (piece & 1) << sq;
+		P.B |= ((piece >> 1) & 1) << sq;
+		P.C |= ((piece >> 2) & 1) << sq;
+		P.D |= ((piece >> 3) & 1) << sq;
+		n++;
+	}
+
+	if (packed.epSquare != 0) {
+		const unsigned int ep = packed.epSquare - 1;
+		const Bitboard EP = 1ull << ep;
+		P.A |= EP;
+		P.B |= EP;
+		if (ep >= 32) {
+			P.D |= EP; // black e.p. square
+		}
+	}
+
+	P.whiteCanCastle = packed.flags & 1;
+	P.whiteCanCastleLong = (packed.flags >> 1) & 1;
+	P.blackCanCastle = (packed.flags >> 2) & 1;
+	P.blackCanCastleLong = (packed.flags >> 3) & 1;
+	P.blackToMove = (packed.flags >> 4) & 1;
+
+	P.calculateHash();
+	P.calculateDerivedBitboards();
+	return P;
+}
+
+//////////////////////////////////////////////
+// Record Files
+//////////////////////////////////////////////
+
+// RecordReader : buffered sequential reader of a record file
+class RecordReader
+{
+public:
+	explicit RecordReader(const std::string& path) : f(fopen(path.c_str(), "rb")), buffer(IO_BLOCK_RECORDS) {}
+	~RecordReader() { if (f != nullptr) fclose(f); }
+	RecordReader(const RecordReader&) = delete;
+	RecordReader& operator=(const RecordReader&) = delete;
+
+	bool isOpen() const { return f != nullptr; }
+
+	bool next(FrontierRecord& r)
+	{
+		if (pos == count) {
+			pos = 0;
+			count = (f != nullptr) ? fread(buffer.data(), sizeof(FrontierRecord), buffer.size(), f) : 0;
+			if (count == 0) {
+				return false;
+			}
+		}
+		r = buffer[pos++];
+		return true;
+	}
+
+	// skip() : skip over the next n records (returns false if there weren't that many)
+	bool skip(uint64_t n)
+	{
+		FrontierRecord r;
+		while (n-- > 0) {
+			if (!next(r)) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+private:
+	FILE* f;
+	std::vector<FrontierRecord> buffer;
+	size_t pos{0};
+	size_t count{0};
+};
+
+// RecordWriter : buffered sequential writer of a record file
+class RecordWriter
+{
+public:
+	explicit RecordWriter(const std::string& path) : f(fopen(path.c_str(), "wb")) { buffer.reserve(IO_BLOCK_RECORDS); }
+	~RecordWriter() { if (f != nullptr) fclose(f); }
+	RecordWriter(const RecordWriter&) = delete;
+	RecordWriter& operator=(const RecordWriter&) = delete;
+
+	bool isOpen() const { return f != nullptr; }
+
+	void write(const FrontierRecord& r)
+	{
+		buffer.push_back(r);
+		if (buffer.size() == IO_BLOCK_RECORDS) {
+			flushBuffer();
+		}
+	}
+
+	// close() : write everything out (optionally forcing it to disk), and close the file. Returns false if there were any errors
+	bool close(bool sync)
+	{
+		flushBuffer();
+		if (sync && ok) {
+			ok = Utils::flushToDisk(f);
+		}
+		ok = (fclose(f) == 0) && ok;
+		f = nullptr;
+		return ok;
+	}
+
+private:
+	FILE* f;
+	std::vector<FrontierRecord> buffer;
+	bool ok{true};
+
+	void flushBuffer()
+	{
+		if (!buffer.empty()) {
+			ok = (fwrite(buffer.data(), sizeof(FrontierRecord), buffer.size(), f) == buffer.size()) && ok;
+			buffer.clear();
+		}
+	}
+};
+
+void sortRecords(std::vector<FrontierRecord>& records)
+{
+	std::sort(records.begin(), records.end(), [](const FrontierRecord& a, const FrontierRecord& b) {
+		return a.position < b.position;
+	});
+
+	// merge duplicates:
+	size_t n = 0;
+	for (size_t i = 0; i < records.size(); i++) {
+		if (n != 0 && records[n - 1].position == records[i].position) {
+			records[n - 1].multiplicity += records[i].multiplicity;
+		} else {
+			records[n++] = records[i];
+		}
+	}
+	records.resize(n);
+}
+
+bool writeRun(std::vector<FrontierRecord>& records, const std::string& path)
+{
+	sortRecords(records);
+	FILE* f = fopen(path.c_str(), "wb");
+	if (f == nullptr) {
+		return false;
+	}
+	bool ok = (fwrite(records.data(), sizeof(FrontierRecord), records.size(), f) == records.size());
+	ok = (fclose(f) == 0) && ok;
+	records.clear();
+	return ok;
+}
+
+// mergePass() : merge a set of runs (no more than MAX_MERGE_FANIN) into one
+static bool mergePass(const std::vector<std::string>& runs, const std::string& outPath, bool sync, uint64_t& nRecords, nodecount_t& nPaths)
+{
+	nRecords = 0;
+	nPaths = 0;
+
+	std::vector<std::unique_ptr<RecordReader>> readers;
+	for (const std::string& run : runs) {
+		readers.push_back(std::make_unique<RecordReader>(run));
+		if (!readers.back()->isOpen()) {
+			return false;
+		}
+	}
+
+	RecordWriter writer(outPath);
+	if (!writer.isOpen()) {
+		return false;
+	}
+
+	// min-heap of (next record, which reader it came from)
+	using HeapEntry = std::pair<FrontierRecord, size_t>;
+	auto greater = [](const HeapEntry& a, const HeapEntry& b) { return b.first.position < a.first.position; };
+	std::priority_queue<HeapEntry, std::vector<HeapEntry>, decltype(greater)> heap(greater);
+
+	for (size_t i = 0; i < readers.size(); i++) {
+		FrontierRecord r;
+		if (readers[i]->next(r)) {
+			heap.push({r, i});
+		}
+	}
+
+	bool havePending = false;
+	FrontierRecord pending;
+	while (!heap.empty()) {
+		const auto [r, i] = heap.top();
+		heap.pop();
+
+		if (havePending && pending.position == r.position) {
+			pending.multiplicity += r.multiplicity; // duplicate
+		} else {
+			if (havePending) {
+				writer.write(pending);
+				nRecords++;
+				nPaths += pending.multiplicity;
+			}
+			pending = r;
+			havePending = true;
+		}
+
+		FrontierRecord n;
+		if (readers[i]->next(n)) {
+			heap.push({n, i});
+		}
+	}
+
+	if (havePending) {
+		writer.write(pending);
+		nRecords++;
+		nPaths += pending.multiplicity;
+	}
+
+	return writer.close(sync);
+}
+
+bool mergeRuns(std::vector<std::string> runs, const std::string& outPath, uint64_t& nRecords, nodecount_t& nPaths)
+{
+	// if there are too many runs to merge at once, merge them in groups first
+	int pass = 0;
+	while (runs.size() > MAX_MERGE_FANIN) {
+		std::vector<std::string> merged;
+		for (size_t first = 0; first < runs.size(); first += MAX_MERGE_FANIN) {
+			const std::vector<std::string> group(runs.begin() + first, runs.begin() + std::min(runs.size(), first + MAX_MERGE_FANIN));
+			const std::string groupPath = outPath + ".pass" + std::to_string(pass) + "." + std::to_string(merged.size()) + ".run";
+			if (!mergePass(group, groupPath, false, nRecords, nPaths)) {
+				return false;
+			}
+			for (const std::string& run : group) {
+				fs::remove(run);
+			}
+			merged.push_back(groupPath);
+		}
+		runs.swap(merged);
+		pass++;
+	}
+
+	if (!mergePass(runs, outPath, true, nRecords, nPaths)) {
+		return false;
+	}
+
+	for (const std::string& run : runs) {
+		fs::remove(run);
+	}
+	return true;
+}
+
+//////////////////////////////////////////////
+// Manifest
+//////////////////////////////////////////////
+
+// The manifest is a small text file recording the parameters of the run, and each completed stage:
+//
+// juddperft-extperft 1
+// fen <fen of root position>
+// depth <depth>
+// frontier <frontier depth>
+// level <n> <unique positions> <paths>			(one line per completed level)
+// tail <positions done> <nodes so far>			(progress through the final perftFast() stage)
+//
+// It is always replaced atomically (write to temporary file, flush to disk, rename), so it can be trusted after a crash
+
+struct ExtPerftManifest
+{
+	std::string fen;
+	int depth{0};
+	int frontierDepth{0};
+	int levelsDone{-1};						// highest completed level (-1 = none)
+	std::vector<uint64_t> levelPositions;
+	std::vector<nodecount_t> levelPaths;
+	uint64_t tailDone{0};
+	nodecount_t tailNodes{0};
+
+	bool save(const fs::path& path) const
+	{
+		const fs::path tmp = path.string() + ".tmp";
+		FILE* f = fopen(tmp.string().c_str(), "w");
+		if (f == nullptr) {
+			return false;
+		}
+
+		fprintf(f, "juddperft-extperft 1\nfen %s\ndepth %d\nfrontier %d\n", fen.c_str(), depth, frontierDepth);
+		for (int level = 0; level <= levelsDone; level++) {
+			fprintf(f, "level %d %" PRIu64 " %" PRIu64 "\n", level, levelPositions[level], levelPaths[level]);
+		}
+		fprintf(f, "tail %" PRIu64 " %" PRIu64 "\n", tailDone, tailNodes);
+
+		bool ok = Utils::flushToDisk(f);
+		ok = (fclose(f) == 0) && ok;
+		if (!ok) {
+			return false;
+		}
+
+		std::error_code ec;
+		fs::rename(tmp, path, ec);
+		if (ec) {
+			return false;
+		}
+		Utils::syncDirectory(path.parent_path().string());
+		return true;
+	}
+
+	bool load(const fs::path& path)
+	{
+		FILE* f = fopen(path.string().c_str(), "r");
+		if (f == nullptr) {
+			return false;
+		}
+
+		char line[1024];
+		int version = 0;
+		bool ok = (fgets(line, sizeof(line), f) != nullptr) && (sscanf(line, "juddperft-extperft %d", &version) == 1) && (version == 1);
+		while (ok && fgets(line, sizeof(line), f) != nullptr) {
+			line[strcspn(line, "\r\n")] = '\0';
+			int level;
+			uint64_t positions;
+			nodecount_t paths;
+			if (strncmp(line, "fen ", 4) == 0) {
+				fen = line + 4;
+			} else if (sscanf(line, "depth %d", &depth) == 1 || sscanf(line, "frontier %d", &frontierDepth) == 1) {
+				continue;
+			} else if (sscanf(line, "level %d %" SCNu64 " %" SCNu64, &level, &positions, &paths) == 3) {
+				ok = (level == levelsDone + 1);
+				levelsDone = level;
+				levelPositions.push_back(positions);
+				levelPaths.push_back(paths);
+			} else if (sscanf(line, "tail %" SCNu64 " %" SCNu64, &tailDone, &tailNodes) == 2) {
+				continue;
+			}
+		}
+
+		fclose(f);
+		return ok;
+	}
+};
+
+static std::string levelPath(const fs::path& dir, int level)
+{
+	return (dir / ("level-" + std::to_string(level) + ".dat")).string();
+}
+
+//////////////////////////////////////////////
+// External-memory perft driver
+//////////////////////////////////////////////
+
+bool expandLevel(const std::string& inPath, const std::string& outPath, size_t memoryBytes, uint64_t& nRecords, nodecount_t& nPaths)
+{
+	unsigned int nThreads = std::min(std::thread::hardware_concurrency(), std::min(theEngine.nNumCores, static_cast<unsigned int>(MAX_THREADS)));
+	nThreads = std::max(1u, nThreads);
+
+	// each thread has its own run buffer, and spills it to a new run file whenever it is (nearly) full
+	const size_t bufferRecords = std::max<size_t>(4 * MOVELIST_SIZE, memoryBytes / sizeof(FrontierRecord) / nThreads);
+
+	RecordReader reader(inPath);
+	if (!reader.isOpen()) {
+		return false;
+	}
+
+	std::mutex readerMutex;
+	std::mutex runsMutex;
+	std::vector<std::string> runs;
+	std::atomic<bool> ok{true};
+
+	auto spill = [&](std::vector<FrontierRecord>& buffer) {
+		std::string path;
+		{
+			std::lock_guard<std::mutex> lock(runsMutex);
+			path = outPath + "." + std::to_string(runs.size()) + ".run";
+			runs.push_back(path);
+		}
+		if (!writeRun(buffer, path)) {
+			ok = false;
+		}
+	};
+
+	std::vector<std::thread> threads;
+	for (unsigned int t = 0; t < nThreads; t++) {
+		threads.emplace_back([&] {
+			std::vector<FrontierRecord> buffer;
+			buffer.reserve(bufferRecords);
+			std::vector<FrontierRecord> parents(IO_BLOCK_RECORDS);
+			ChessMove movelist[MOVELIST_SIZE];
+
+			while (ok) {
+				// grab a block of parent positions
+				size_t nParents = 0;
+				{
+					std::lock_guard<std::mutex> lock(readerMutex);
+					while (nParents < parents.size() && reader.next(parents[nParents])) {
+						nParents++;
+					}
+				}
+				if (nParents == 0) {
+					break;
+				}
+
+				for (size_t p = 0; p < nParents; p++) {
+					ChessPosition P = unpackPosition(parents[p].position);
+					P.dontDetectChecks = 1;
+					MoveGenerator::generateMoves(P, movelist);
+					if (buffer.size() + move_count(movelist) > bufferRecords) {
+						spill(buffer);
+					}
+					for (unsigned int i = 0; i < move_count(movelist); i++) {
+						ChessPosition Q = P;
+						Q.performMoveNoHash(movelist[i]);
+						Q.blackToMove ^= 1;
+						buffer.push_back({packPosition(Q), parents[p].multiplicity});
+					}
+				}
+			}
+
+			if (!buffer.empty()) {
+				spill(buffer);
+			}
+		});
+	}
+
+	for (auto& th : threads) {
+		th.join();
+	}
+
+	if (!ok) {
+		return false;
+	}
+
+	return mergeRuns(runs, outPath, nRecords, nPaths);
+}
+
+// perftTail() : run perftFast() to the given depth on every position in level file inPath, resuming from manifest.tailDone,
+// and checkpointing progress in the manifest after each batch
+static bool perftTail(const std::string& inPath, int depth, ExtPerftManifest& manifest, const fs::path& manifestPath)
+{
+	RecordReader reader(inPath);
+	if (!reader.isOpen() || !reader.skip(manifest.tailDone)) {
+		return false;
+	}
+
+	unsigned int nThreads = std::min(std::thread::hardware_concurrency(), std::min(theEngine.nNumCores, static_cast<unsigned int>(MAX_THREADS)));
+	nThreads = std::max(1u, nThreads);
+
+	constexpr size_t batchSize = 1 << 16;
+	std::vector<FrontierRecord> batch(batchSize);
+
+	for (;;) {
+		size_t n = 0;
+		while (n < batchSize && reader.next(batch[n])) {
+			n++;
+		}
+		if (n == 0) {
+			break;
+		}
+
+		std::vector<std::thread> threads;
+		std::vector<nodecount_t> subTotal(nThreads, 0);
+		std::atomic<size_t> next{0};
+		for (unsigned int t = 0; t < nThreads; t++) {
+			threads.emplace_back([&, t] {
+				nodecount_t total = 0;
+				for (size_t i = next++; i < n; i = next++) {
+					nodecount_t s = 0;
+					ChessPosition P = unpackPosition(batch[i].position);
+					P.dontDetectChecks = 1;
+					perftFast(P, depth, s);
+					total += s * batch[i].multiplicity;
+				}
+				subTotal[t] = total;
+			});
+		}
+
+		for (auto& th : threads) {
+			th.join();
+		}
+
+		manifest.tailDone += n;
+		manifest.tailNodes += std::accumulate(subTotal.begin(), subTotal.end(), 0ull);
+		if (!manifest.save(manifestPath)) {
+			return false;
+		}
+		std::cout << ".";
+	}
+
+	std::cout << std::endl;
+	return true;
+}
+
+bool perftExternal(const ChessPosition& P, int depth, const ExtPerftOptions& options, nodecount_t& nNodes)
+{
+	nNodes = 0;
+
+	if (depth <= 0) {
+		nNodes = 1;
+		return true;
+	}
+
+	const fs::path dir(options.workDir);
+	const fs::path manifestPath = dir / "manifest.txt";
+
+	std::error_code ec;
+	fs::create_directories(dir, ec);
+	if (ec) {
+		printf("extperft: unable to create directory %s\n", options.workDir.c_str());
+		return false;
+	}
+
+	int frontierDepth = (options.frontierDepth > 0) ? options.frontierDepth : depth / 2;
+	frontierDepth = std::max(0, std::min(frontierDepth, depth - 1));
+
+	char fen[1024] = {0};
+	writeFen(fen, &P);
+
+	ExtPerftManifest manifest;
+	if (fs::exists(manifestPath)) {
+		// resume a previous run (if it was for the same thing)
+		if (!manifest.load(manifestPath) || manifest.fen != fen || manifest.depth != depth || manifest.frontierDepth != frontierDepth) {
+			printf("extperft: %s contains a different (or damaged) run. Use an empty directory\n", options.workDir.c_str());
+			return false;
+		}
+		printf("extperft: resuming from level %d\n", manifest.levelsDone);
+	} else {
+		manifest.fen = fen;
+		manifest.depth = depth;
+		manifest.frontierDepth = frontierDepth;
+	}
+
+	// remove anything left over from an interrupted level
+	for (const auto& entry : fs::directory_iterator(dir)) {
+		const std::string name = entry.path().filename().string();
+		if (entry.path().extension() == ".run" || entry.path().extension() == ".tmp") {
+			fs::remove(entry.path(), ec);
+		} else if (name.rfind("level-", 0) == 0) {
+			const int level = atoi(name.c_str() + 6);
+			if (level > manifest.levelsDone) {
+				fs::remove(entry.path(), ec);
+			}
+		}
+	}
+
+	// Level 0: the root position
+	if (manifest.levelsDone < 0) {
+		RecordWriter writer(levelPath(dir, 0));
+		if (!writer.isOpen()) {
+			return false;
+		}
+		writer.write({packPosition(P), 1});
+		if (!writer.close(true)) {
+			return false;
+		}
+		manifest.levelsDone = 0;
+		manifest.levelPositions.push_back(1);
+		manifest.levelPaths.push_back(1);
+		if (!manifest.save(manifestPath)) {
+			return false;
+		}
+	}
+
+	// Expand levels:
+	while (manifest.levelsDone < frontierDepth) {
+		const int level = manifest.levelsDone + 1;
+		uint64_t nRecords = 0;
+		nodecount_t nPaths = 0;
+		if (!expandLevel(levelPath(dir, level - 1), levelPath(dir, level), options.memoryBytes, nRecords, nPaths)) {
+			printf("extperft: I/O error while expanding level %d\n", level);
+			return false;
+		}
+
+		manifest.levelsDone = level;
+		manifest.levelPositions.push_back(nRecords);
+		manifest.levelPaths.push_back(nPaths);
+		if (!manifest.save(manifestPath)) {
+			return false;
+		}
+
+		if (!options.keepFiles) {
+			fs::remove(levelPath(dir, level - 1), ec);
+		}
+
+		printf("Level %d: %" PRIu64 " unique positions (Perft %d: %" PRIu64 ")\n", level, nRecords, level, nPaths);
+	}
+
+	// Run perftFast() on the final level:
+	if (!perftTail(levelPath(dir, frontierDepth), depth - frontierDepth, manifest, manifestPath)) {
+		printf("extperft: I/O error in final stage\n");
+		return false;
+	}
+
+	nNodes = manifest.tailNodes;
+	return true;
+}
+
+} // namespace juddperft
@@ -0,0 +1,127 @@
+/*
+
+MIT License
+
+Copyright(c) 2016-2025 Judd Niemann
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files(the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+//////////////////////////////////////////////
+// extperft.h								//
+// Defines:									//
+// External-memory (disk-based) perft		//
+// Compact on-disk position format			//
+//////////////////////////////////////////////
+
+#ifndef _EXTPERFT_H
+#define _EXTPERFT_H 1
+
+#include "chessposition.h"
+#include "movegen.h"
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace juddperft {
+
+// PackedPosition : compact, fixed-size on-disk form of a ChessPosition (26 bytes, vs 40+ in memory)
+// occupied:	all squares holding a piece (not including the e.p. square)
+// pieces:		one nibble (ie the DCBA piece code) for each occupied square, in ascending order of square index
+// flags:		bit 0: whiteCanCastle, 1: whiteCanCastleLong, 2: blackCanCastle, 3: blackCanCastleLong, 4: blackToMove
+// epSquare:	(square index + 1) of the e.p. square, or 0 if there isn't one.
+//				Note: the e.p. square is only kept if the side to move can (legally) capture onto it,
+//				so that positions which differ only by an unusable e.p. square are treated as the same position.
+// Positions compare equal if and only if they are the same position (there are no hash collisions to worry about)
+
+#pragma pack(push, 1)
+struct PackedPosition
+{
+	uint64_t occupied;
+	uint8_t pieces[16];
+	uint8_t flags;
+	uint8_t epSquare;
+};
+
+// FrontierRecord : a position, and the number of distinct paths (move sequences) leading to it from the root
+struct FrontierRecord
+{
+	PackedPosition position;
+	uint64_t multiplicity;
+};
+#pragma pack(pop)
+
+static_assert(sizeof(PackedPosition) == 26);
+static_assert(sizeof(FrontierRecord) == 34);
+
+inline bool operator<(const PackedPosition& a, const PackedPosition& b)
+{
+	return std::memcmp(&a, &b, sizeof(PackedPosition)) < 0;
+}
+
+inline bool operator==(const PackedPosition& a, const PackedPosition& b)
+{
+	return std::memcmp(&a, &b, sizeof(PackedPosition)) == 0;
+}
+
+PackedPosition packPosition(const ChessPosition& P);
+ChessPosition unpackPosition(const PackedPosition& packed); // note: also calculates hash key
+
+// Sorted Runs:
+// A run file is a sequence of FrontierRecords, sorted by position, with no duplicate positions.
+
+// sortRecords() : sort a buffer of records in-place, and merge duplicates (adding their multiplicities)
+void sortRecords(std::vector<FrontierRecord>& records);
+
+// writeRun() : sort the records, and write them to a new run file. The buffer is left empty. Returns false on I/O error
+bool writeRun(std::vector<FrontierRecord>& records, const std::string& path);
+
+// mergeRuns() : k-way merge of sorted runs into a single sorted run, merging duplicates.
+// The input runs are deleted, and the output is flushed to disk before returning.
+// nRecords receives the number of (unique) records in the output, and nPaths receives the sum of their multiplicities
+bool mergeRuns(std::vector<std::string> runs, const std::string& outPath, uint64_t& nRecords, nodecount_t& nPaths);
+
+// expandLevel() : expand every position in the run (or level) file inPath by one ply, writing the sorted,
+// deduplicated result to outPath, using no more than (about) memoryBytes of memory
+bool expandLevel(const std::string& inPath, const std::string& outPath, size_t memoryBytes, uint64_t& nRecords, nodecount_t& nPaths);
+
+// External-memory perft
+// ---------------------
+// The tree is expanded breadth-first, one level at a time, to frontierDepth.
+// Each level is written to disk as sorted runs, which are then merged (and deduplicated) into a single level file,
+// so memory use is bounded by memoryBytes, regardless of how many positions there are.
+// perftFast() is then run on each unique position in the final level, and weighted by its multiplicity.
+// Progress is recorded in a manifest file in workDir, so an interrupted run can be resumed by repeating the command.
+
+struct ExtPerftOptions
+{
+	std::string workDir;
+	int frontierDepth{0};			// levels to expand on disk (0 = depth / 2)
+	size_t memoryBytes{1ull << 30};	// total size of in-memory run buffers
+	bool keepFiles{false};			// if false, level files are deleted once they are no longer needed
+};
+
+bool perftExternal(const ChessPosition& P, int depth, const ExtPerftOptions& options, nodecount_t& nNodes);
+
+} // namespace juddperft
+
+#endif // _EXTPERFT_H
@@ -31,9 +31,17 @@ SOFTWARE.
 
 #include <cstring>
 
+#include <algorithm>
 #include <atomic>
 #include <iostream>
 #include <string>
+#include <thread>
+#include <vector>
+
+#if !defined(_MSC_VER)
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
 
 namespace juddperft {
 
@@ -60,6 +68,29 @@ public:
 	bool deAllocate();
 	void clear();
 
+	// resize() : like setSize(), but keeps the records (as many as will fit), by moving each one to its slot in the new table.
+	// keyOf(record, slot) gives the hash key of the record found in slot (0 for an empty slot), and prefer(a, b) says whether
+	// record a should be kept rather than record b, when both land in the same slot of the new table (ie when shrinking).
+	// The work is shared between nThreads threads. The table must not be in use while it is being resized.
+	// (the new table is always allocated with new[], even if the old one was a file mapping)
+	template<class KeyOf, class Prefer>
+	bool resize(size_t nBytes, unsigned int nThreads, KeyOf keyOf, Prefer prefer);
+
+	// halve() : halve the table in place, keeping the preferred record (see resize()) of each pair of slots which fold together,
+	// and giving the memory of the upper half back to the system. Unlike resize(), nothing is allocated, so it is safe to use
+	// when memory is short. The table must not be in use while it is being halved. (not for file mappings)
+	template<class KeyOf, class Prefer>
+	bool halve(unsigned int nThreads, KeyOf keyOf, Prefer prefer);
+
+#if !defined(_MSC_VER)
+	// mapFile() : use nEntries records of an open file (starting at offset, which must be page-aligned) as the table.
+	// shared == false: the file is mapped copy-on-write (changes are never written back to the file)
+	// shared == true: changes go straight to the file, and are visible to any other process which maps it (fd must be read/write)
+	// nEntries must be a power of 2. The file can be closed afterwards.
+	bool mapFile(int fd, size_t offset, size_t nEntries, bool shared);
+#endif
+	bool isMapped() const;
+
 	void setQuiet(bool newQuiet);
 
 private:
@@ -69,6 +100,9 @@ private:
 	size_t m_nRequestedSize;
 	std::string m_Name;
 	bool quiet{false};
+	bool m_bMapped{false};	// true if m_pTable is a file mapping (rather than allocated with new[])
+
+	void release();
 };
 
 template<class T>
@@ -85,9 +119,24 @@ inline HashTable<T>::~HashTable()
 {
 	if (m_pTable != nullptr) {
 		std::cout << "deallocating " << m_Name << std::endl;
+		release();
+	}
+}
+
+template<class T>
+inline void HashTable<T>::release()
+{
+#if !defined(_MSC_VER)
+	if (m_bMapped) {
+		munmap(m_pTable, m_nEntries * sizeof(std::atomic<T>));
+	} else {
 		delete[] m_pTable;
-		m_pTable = nullptr;
 	}
+#else
+	delete[] m_pTable;
+#endif
+	m_pTable = nullptr;
+	m_bMapped = false;
 }
 
 template<class T>
@@ -132,6 +181,125 @@ inline bool HashTable<T>::setSize(size_t nBytes)
 	}
 }
 
+template<class T>
+template<class KeyOf, class Prefer>
+inline bool HashTable<T>::resize(size_t nBytes, unsigned int nThreads, KeyOf keyOf, Prefer prefer)
+{
+	if (m_pTable == nullptr) {
+		return setSize(nBytes);
+	}
+
+	size_t nNewNumEntries = 1ull;
+	while (nNewNumEntries * sizeof (std::atomic<T>) <= nBytes) {
+		nNewNumEntries <<= 1;
+	}
+	nNewNumEntries >>= 1;
+
+	std::atomic<T>* pNewTable = new (std::nothrow) std::atomic<T>[nNewNumEntries];
+	if (pNewTable == nullptr) {
+		std::cout << "Failed to allocate " << nBytes << " bytes for " << m_Name << std::endl;
+		return false;
+	}
+
+	// Each slot j of the new table can only be filled from the slots of the old table which are congruent to j
+	// (modulo the smaller of the two table sizes), so each thread fills its own range of new slots, without contention.
+	const size_t nNewIndexMask = nNewNumEntries - 1;
+	auto fill = [&](size_t begin, size_t end) {
+		for (size_t j = begin; j < end; j++) {
+			T best{};
+			bool found = false;
+			for (size_t i = j & m_nIndexMask; i < m_nEntries; i += nNewNumEntries) {
+				const T r = m_pTable[i].load(std::memory_order_relaxed);
+				const HashKey hk = keyOf(r, i);
+				if (hk != 0 && (hk & nNewIndexMask) == j && (!found || prefer(r, best))) {
+					best = r;
+					found = true;
+				}
+			}
+			pNewTable[j].store(best, std::memory_order_relaxed);
+		}
+	};
+
+	nThreads = std::max(1u, nThreads);
+	const size_t chunk = (nNewNumEntries + nThreads - 1) / nThreads;
+	std::vector<std::thread> threads;
+	for (size_t begin = 0; begin < nNewNumEntries; begin += chunk) {
+		threads.emplace_back(fill, begin, std::min(nNewNumEntries, begin + chunk));
+	}
+	for (auto& th : threads) {
+		th.join();
+	}
+
+	const size_t nOldBytes = getSize();
+	release();
+	m_pTable = pNewTable;
+	m_nEntries = nNewNumEntries;
+	m_nIndexMask = nNewIndexMask;
+	m_nRequestedSize = nBytes;
+
+	if (!quiet) {
+		std::cout << "Resized " << m_Name << " from " << Utils::memorySizeWithBinaryPrefix(nOldBytes)
+				  << " to " << Utils::memorySizeWithBinaryPrefix(getSize())
+				  << " (" << m_nEntries << " entries at " << sizeof(T) << " bytes each)" << std::endl;
+	}
+
+	return true;
+}
+
+template<class T>
+template<class KeyOf, class Prefer>
+inline bool HashTable<T>::halve(unsigned int nThreads, KeyOf keyOf, Prefer prefer)
+{
+	if (m_pTable == nullptr || m_bMapped || m_nEntries < 2) {
+		return false;
+	}
+
+	// slot j of the halved table can only be filled from slots j and j + half of the old one
+	const size_t half = m_nEntries / 2;
+	auto fold = [&](size_t begin, size_t end) {
+		for (size_t j = begin; j < end; j++) {
+			const T a = m_pTable[j].load(std::memory_order_relaxed);
+			const T b = m_pTable[j + half].load(std::memory_order_relaxed);
+			if (keyOf(b, j + half) != 0 && (keyOf(a, j) == 0 || prefer(b, a))) {
+				m_pTable[j].store(b, std::memory_order_relaxed);
+			}
+		}
+	};
+
+	nThreads = std::max(1u, nThreads);
+	const size_t chunk = (half + nThreads - 1) / nThreads;
+	std::vector<std::thread> threads;
+	for (size_t begin = 0; begin < half; begin += chunk) {
+		threads.emplace_back(fold, begin, std::min(half, begin + chunk));
+	}
+	for (auto& th : threads) {
+		th.join();
+	}
+
+#if !defined(_MSC_VER)
+	// give back the pages wholly within the upper half (the allocation itself is freed as a whole, later)
+	const uintptr_t pageSize = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+	const uintptr_t tailBegin = (reinterpret_cast<uintptr_t>(m_pTable + half) + pageSize - 1) & ~(pageSize - 1);
+	const uintptr_t tailEnd = reinterpret_cast<uintptr_t>(m_pTable + m_nEntries) & ~(pageSize - 1);
+	if (tailEnd > tailBegin) {
+		madvise(reinterpret_cast<void*>(tailBegin), tailEnd - tailBegin, MADV_DONTNEED);
+	}
+#endif
+
+	const size_t nOldBytes = getSize();
+	m_nEntries = half;
+	m_nIndexMask = half - 1;
+	m_nRequestedSize = getSize();
+
+	if (!quiet) {
+		std::cout << "Halved " << m_Name << " from " << Utils::memorySizeWithBinaryPrefix(nOldBytes)
+				  << " to " << Utils::memorySizeWithBinaryPrefix(getSize())
+				  << " (" << m_nEntries << " entries at " << sizeof(T) << " bytes each)" << std::endl;
+	}
+
+	return true;
+}
+
 template<class T>
 inline bool HashTable<T>::deAllocate()
 {
@@ -139,14 +307,50 @@ inline bool HashTable<T>::deAllocate()
 		if (!quiet) {
 			std::cout << "deallocating " << m_Name << std::endl;
 		}
-		delete[] m_pTable;
-		m_pTable = nullptr;
+		release();
 		return true;
 	}
 
 	return false;
 }
 
+#if !defined(_MSC_VER)
+template<class T>
+inline bool HashTable<T>::mapFile(int fd, size_t offset, size_t nEntries, bool shared)
+{
+	deAllocate();
+
+	const size_t bytes = nEntries * sizeof(std::atomic<T>);
+	void* p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, shared ? MAP_SHARED : MAP_PRIVATE, fd, static_cast<off_t>(offset));
+	if (p == MAP_FAILED) {
+		std::cout << "Failed to map " << bytes << " bytes for " << m_Name << std::endl;
+		m_nEntries = 0;
+		m_nIndexMask = 0;
+		return false;
+	}
+
+	m_pTable = static_cast<std::atomic<T>*>(p);
+	m_bMapped = true;
+	m_nEntries = nEntries;
+	m_nIndexMask = m_nEntries - 1;
+	m_nRequestedSize = bytes;
+
+	if (!quiet) {
+		std::cout << "Mapped " << bytes << " bytes ("
+				  << Utils::memorySizeWithBinaryPrefix(bytes) << ") " << (shared ? "(shared) " : "") << "for "
+				  << m_Name << " (" << m_nEntries << " entries at " << sizeof(T) << " bytes each)" << std::endl;
+	}
+
+	return true;
+}
+#endif
+
+template<class T>
+inline bool HashTable<T>::isMapped() const
+{
+	return m_bMapped;
+}
+
 template<class T>
 inline std::atomic<T> *HashTable<T>::getAddress(const HashKey & SearchHK) const
 {
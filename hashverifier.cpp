@@ -0,0 +1,223 @@
+/*
+
+MIT License
+
+Copyright(c) 2016-2025 Judd Niemann
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files(the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+
+#include "hashverifier.h"
+#include "fen.h"
+#include "movegen.h"
+#include "search.h"
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+namespace juddperft {
+
+namespace {
+
+struct VerifyTask
+{
+	ChessPosition P;
+	int depth;
+	uint64_t count;
+};
+
+constexpr size_t MAX_QUEUED_TASKS = 4096;
+
+std::mutex queueMutex;
+std::condition_variable queueCv;	// signalled when there is work to do (or the worker is to stop)
+std::condition_variable idleCv;		// signalled when the queue has been emptied
+std::deque<VerifyTask> queue;
+std::thread worker;
+bool stopWorker{false};
+bool workerBusy{false};
+double sampleFraction{0.0};
+
+std::atomic<uint64_t> nSampled{0};
+std::atomic<uint64_t> nChecked{0};
+std::atomic<uint64_t> nMismatches{0};
+std::atomic<uint64_t> nDropped{0};
+uint64_t checkedAtLastDrain{0};
+uint64_t mismatchesAtLastDrain{0};
+
+thread_local bool isWorker{false}; // (the worker's own hits aren't sampled)
+
+// recount() : count the nodes of P at depth again, by generating its moves and calling perftFast() for each child
+nodecount_t recount(const ChessPosition& P, int depth)
+{
+	ChessMove movelist[MOVELIST_SIZE];
+	MoveGenerator::generateMoves(P, movelist);
+	const unsigned int movecount = move_count(movelist);
+	if (depth == 1) {
+		return movecount;
+	}
+
+	nodecount_t n = 0;
+	for (unsigned int i = 0; i < movecount; i++) {
+		ChessPosition Q = P;
+		Q.performMove(movelist[i]).switchSides();
+		perftFast(Q, depth - 1, n);
+	}
+	return n;
+}
+
+void check(const VerifyTask& task)
+{
+	const nodecount_t n = recount(task.P, task.depth);
+	nChecked.fetch_add(1, std::memory_order_relaxed);
+	if (n != task.count) {
+		nMismatches.fetch_add(1, std::memory_order_relaxed);
+		char fen[1024] = {0};
+		writeFen(fen, &task.P);
+		printf("\nHash verification: MISMATCH at depth %d (table: %" PRIu64 ", recount: %" PRIu64 ") for %s\n",
+			   task.depth, task.count, n, fen);
+	}
+}
+
+void workerLoop()
+{
+	isWorker = true;
+	std::unique_lock<std::mutex> lock(queueMutex);
+	for (;;) {
+		queueCv.wait(lock, [] { return stopWorker || !queue.empty(); });
+		if (queue.empty()) {
+			break; // (stopping, and nothing left to check)
+		}
+		const VerifyTask task = queue.front();
+		queue.pop_front();
+		workerBusy = true;
+		lock.unlock();
+		check(task);
+		lock.lock();
+		workerBusy = false;
+		if (queue.empty()) {
+			idleCv.notify_all();
+		}
+	}
+}
+
+} // namespace
+
+bool HashVerifier::enabled = false;
+uint64_t HashVerifier::sampleInterval = 0;
+thread_local uint64_t HashVerifier::hitsSinceSample = 0;
+
+void HashVerifier::enable(double fraction)
+{
+	disable();
+
+	sampleFraction = std::min(std::max(fraction, 0.0), 1.0);
+	enabled = true;
+	if (sampleFraction == 0.0) {
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(queueMutex);
+		stopWorker = false;
+	}
+	worker = std::thread(workerLoop);
+	sampleInterval = std::max(static_cast<uint64_t>(1.0 / sampleFraction + 0.5), uint64_t{1});
+
+	// make sure the worker is finished with before exit()
+	static const bool disableAtExit = (std::atexit([] { HashVerifier::disable(); }) == 0);
+	(void)disableAtExit;
+}
+
+void HashVerifier::disable()
+{
+	if (worker.joinable()) {
+		{
+			std::lock_guard<std::mutex> lock(queueMutex);
+			stopWorker = true;
+		}
+		queueCv.notify_one();
+		worker.join(); // (once the queue has been checked)
+		drain();
+	}
+	sampleInterval = 0;
+	enabled = false;
+}
+
+double HashVerifier::getFraction()
+{
+	return enabled ? sampleFraction : 0.0;
+}
+
+HashVerifierStats HashVerifier::getStats()
+{
+	HashVerifierStats stats;
+	stats.sampled = nSampled;
+	stats.checked = nChecked;
+	stats.mismatches = nMismatches;
+	stats.dropped = nDropped;
+	return stats;
+}
+
+void HashVerifier::drain()
+{
+	{
+		std::unique_lock<std::mutex> lock(queueMutex);
+		idleCv.wait(lock, [] { return queue.empty() && !workerBusy; });
+	}
+
+	const uint64_t checked = nChecked - checkedAtLastDrain;
+	const uint64_t mismatches = nMismatches - mismatchesAtLastDrain;
+	if (checked != 0) {
+		printf("Hash verification: %" PRIu64 " sampled hits recounted, %" PRIu64 " mismatches\n", checked, mismatches);
+	}
+	checkedAtLastDrain += checked;
+	mismatchesAtLastDrain += mismatches;
+}
+
+void HashVerifier::submit(const ChessPosition& P, int depth, uint64_t count)
+{
+	hitsSinceSample = 0;
+	if (isWorker) {
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(queueMutex);
+	if (stopWorker) {
+		return;
+	}
+	if (queue.size() >= MAX_QUEUED_TASKS) {
+		nDropped.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+	queue.push_back({P, depth, count});
+	nSampled.fetch_add(1, std::memory_order_relaxed);
+	queueCv.notify_one();
+}
+
+} // namespace juddperft
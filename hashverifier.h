@@ -0,0 +1,124 @@
+/*
+
+MIT License
+
+Copyright(c) 2016-2025 Judd Niemann
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files(the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+
+//////////////////////////////////////////////
+// hashverifier.h							//
+// Defines:									//
+// Collision-hardened mode for the perft	//
+// tables (verification keys, and			//
+// background recounting of sampled hits)	//
+//////////////////////////////////////////////
+
+#ifndef _HASHVERIFIER_H
+#define _HASHVERIFIER_H 1
+
+#include "chessposition.h"
+#include "tablegroup.h"
+
+#include <cstdint>
+
+namespace juddperft {
+
+// perftFast() trusts any record whose hash key matches (or just the top 52 bits, in the leaf table), so a collision
+// silently corrupts the result. In collision-hardened mode:
+// - each perft record also carries the top bits of the position's verification key (ChessPosition::calculateVerificationKey(),
+//   which is independent of the Zobrist keys), and a record is only used if both keys match.
+//   (This needs HT_PERFT_VERIFY_KEY: without it, no verification key is calculated, and hardened mode is sampling alone.
+//   Leaf records have no room for it, so they are covered by sampling alone.)
+// - a fraction of all hits are sampled, and recounted by a background thread: one ply of moves, then perftFast() of each child.
+//   A recount which differs from the record is reported, and counted as a mismatch.
+// With HT_PERFT_VERIFY_KEY, records written while hardened mode is off have no verification bits, so they are (almost always)
+// ignored while it is on.
+
+constexpr double DEFAULT_VERIFY_FRACTION = 0.001;
+
+struct HashVerifierStats
+{
+	uint64_t sampled{0};	// hits queued for recounting
+	uint64_t checked{0};	// hits recounted
+	uint64_t mismatches{0};	// hits whose recount differed from the record
+	uint64_t dropped{0};	// sampled hits which were discarded because the background thread couldn't keep up
+};
+
+class HashVerifier
+{
+public:
+	// enable() : switch hardened mode on, recounting (about) the given fraction of hits (0 means: check the keys only)
+	static void enable(double fraction);
+	static void disable(); // (waits for outstanding recounts)
+	static bool isEnabled() { return enabled; }
+	static double getFraction();
+	static HashVerifierStats getStats();
+
+	// drain() : wait for outstanding recounts, and report on those done since the last drain().
+	// The background thread uses the tables, so this must be called before they can be resized (ie before useMutex is released)
+	static void drain();
+
+	// verificationKey() : the verification key to store in P's records (0 when hardened mode is off, or when records have no
+	// verification bits)
+	static uint64_t verificationKey(const ChessPosition& P)
+	{
+		if constexpr (PerftRecord::VERIFY_BITS == 0) {
+			return 0;
+		}
+		return enabled ? P.calculateVerificationKey() : 0;
+	}
+
+	// verifies() : whether record (whose hash key matches P's) may be used
+	static bool verifies(const PerftRecord& record, const ChessPosition& P)
+	{
+		if constexpr (PerftRecord::VERIFY_BITS == 0) {
+			return true;
+		}
+		return !enabled || record.verifies(P.calculateVerificationKey());
+	}
+
+	// (the same, given P's verification key)
+	static bool verifies(const PerftRecord& record, uint64_t vk)
+	{
+		return !enabled || record.verifies(vk);
+	}
+
+	// sample() : called on each hit (count nodes for P at depth); queues about one in every 1/fraction hits for recounting
+	static void sample(const ChessPosition& P, int depth, uint64_t count)
+	{
+		if (sampleInterval != 0 && ++hitsSinceSample >= sampleInterval) {
+			submit(P, depth, count);
+		}
+	}
+
+private:
+	static void submit(const ChessPosition& P, int depth, uint64_t count);
+
+	static bool enabled;
+	static uint64_t sampleInterval; // (0 when not sampling)
+	static thread_local uint64_t hitsSinceSample;
+};
+
+} // namespace juddperft
+
+#endif // _HASHVERIFIER_H
@@ -35,6 +35,7 @@ SOFTWARE.
 #include "tablegroup.h"
 
 #include "engine.h"
+#include "utils.h"
 #include "winboard.h"
 
 #ifdef _MSC_VER
@@ -47,7 +48,11 @@ SOFTWARE.
 #endif
 #endif
 
+#include <algorithm>
+#include <cstdlib>
 #include <iostream>
+#include <optional>
+#include <string>
 
 using namespace juddperft;
 
@@ -59,9 +64,41 @@ int main(int argc, char *argv[], char *envp[])
 
 
 #if !defined(__EMSCRIPTEN__ )
-	size_t nBytesToAllocate = 8589934592; // <-- Set how much RAM to use here (more RAM -> faster ... until you start hitting the page file then it gets significantly worse !!!)
+	// size the thread pool and the hash tables to what this process can actually use
+	// (more RAM -> faster ... until you start hitting the page file then it gets significantly worse !!!)
+	const unsigned int nUsableCpus = Utils::usableCpuCount();
+	const std::optional<size_t> nUsableMemory = Utils::usableMemory();
+	size_t nBytesToAllocate = 8589934592; // 8GiB, unless there's less than twice that available
+	if (nUsableMemory.has_value()) {
+		static constexpr size_t minBytesToAllocate = 16777216; // (16MiB: tables any smaller aren't worth having)
+		nBytesToAllocate = std::max(minBytesToAllocate, std::min(nBytesToAllocate, *nUsableMemory / 2));
+	}
+	theEngine.nNumCores = std::min(nUsableCpus, static_cast<unsigned int>(MAX_THREADS));
+
+	// command-line overrides
+	for (int i = 1; i < argc; i++) {
+		const std::string arg(argv[i]);
+		const bool hasValue = (i + 1 < argc);
+		if (arg == "--threads" && hasValue) {
+			theEngine.nNumCores = std::max(1, std::min(atoi(argv[++i]), MAX_THREADS));
+		} else if (arg == "--memory" && hasValue) {
+			nBytesToAllocate = Utils::bytes(argv[++i]);
+		} else if (arg == "--leaf-ratio" && hasValue) {
+			const int ratio = atoi(argv[++i]);
+			if (ratio < 1 || ratio > 16 || (ratio & (ratio - 1)) != 0) {
+				std::cout << "--leaf-ratio must be 1, 2, 4, 8 or 16" << std::endl;
+				return EXIT_FAILURE;
+			}
+			TableGroup::leafRatio = ratio;
+		} else {
+			std::cout << "usage: " << argv[0] << " [--threads <n>] [--memory <bytes>] [--leaf-ratio <1|2|4|8|16>]" << std::endl;
+			return EXIT_FAILURE;
+		}
+	}
 
-	// size_t nBytesToAllocate = 1ull << 34; // 16GiB
+	std::cout << "Usable cpus: " << nUsableCpus << ", usable memory: "
+			  << (nUsableMemory.has_value() ? Utils::memorySizeWithBinaryPrefix(*nUsableMemory) : std::string("unknown"))
+			  << "; using " << theEngine.nNumCores << " thread(s)" << std::endl;
 
 	if (!setMemory(nBytesToAllocate)) {
 		return EXIT_FAILURE;	// not going to end well ...
@@ -70,8 +107,6 @@ int main(int argc, char *argv[], char *envp[])
 	setProcessPriority();
 
 
-	// testMoveTables();
-
 	// ChessPosition X;
 	// readFen(&X, "r3k2r/1bp2pP1/5n2/1P1Q4/1pPq4/5N2/1B1P2p1/R3K2R b KQkq c3 0 1");
 	// readFen(&X, "1rb5/4r3/3p1npb/3kp1P1/1P3P1P/5nR1/2Q1BK2/bN4NR w - - 3 61");
@@ -111,10 +146,10 @@ int main(int argc, char *argv[], char *envp[])
 
 namespace juddperft {
 
-	bool setMemory(size_t nTotalBytes)
+	bool setMemory(size_t nTotalBytes, bool keepRecords)
 	{
 		std::cout << "\nAttempting to allocate up to " << nTotalBytes << " bytes of RAM ..." << std::endl;
-		return TableGroup::setMemory(nTotalBytes);
+		return TableGroup::setMemory(nTotalBytes, keepRecords);
 		return false;
 	}
 
@@ -31,7 +31,7 @@ SOFTWARE.
 
 namespace juddperft {
 
-bool setMemory(size_t nTotalBytes);
+bool setMemory(size_t nTotalBytes, bool keepRecords = false);
 void setProcessPriority();
 
 } // namespace juddperft
@@ -0,0 +1,203 @@
+/*
+
+MIT License
+
+Copyright(c) 2016-2025 Judd Niemann
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files(the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+
+#include "mempressure.h"
+#include "tablegroup.h"
+#include "utils.h"
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+namespace juddperft {
+
+namespace {
+
+std::thread monitor;
+std::mutex monitorMutex;
+std::condition_variable monitorCv;
+bool stopping{false};
+std::string eventsPath;
+std::string psiPath;
+double threshold{DEFAULT_PSI_THRESHOLD};
+size_t minimum{DEFAULT_AUTOSHRINK_MINIMUM};
+unsigned int nShrinks{0};
+
+// readEvents() : the number of "high" and "max" events in a cgroup memory.events file
+uint64_t readEvents(const std::string& path)
+{
+	std::ifstream f(path);
+	std::string key;
+	uint64_t value;
+	uint64_t n = 0;
+	while (f >> key >> value) {
+		if (key == "high" || key == "max") {
+			n += value;
+		}
+	}
+	return n;
+}
+
+// readPsi() : the "some avg10" figure from a PSI file
+double readPsi(const std::string& path)
+{
+	std::ifstream f(path);
+	std::string line;
+	double avg10 = 0.0;
+	while (std::getline(f, line)) {
+		if (sscanf(line.c_str(), "some avg10=%lf", &avg10) == 1) {
+			break;
+		}
+	}
+	return avg10;
+}
+
+// shrink() : halve the tables, if they are idle. Returns false if they are busy
+bool shrink()
+{
+	std::unique_lock<std::mutex> use(TableGroup::useMutex, std::try_to_lock);
+	if (!use.owns_lock()) {
+		return false;
+	}
+
+	if (TableGroup::perftTable.isMapped() || TableGroup::perftLeafTable.isMapped()) {
+		return true; // (not ours to shrink)
+	}
+
+	const size_t current = TableGroup::perftTable.getSize() + TableGroup::perftLeafTable.getSize();
+	if (current / 2 < minimum) {
+		return true; // (as small as allowed)
+	}
+
+	printf("\nMemory pressure: shrinking hash tables from %s to %s\n",
+		Utils::memorySizeWithBinaryPrefix(current).c_str(), Utils::memorySizeWithBinaryPrefix(current / 2).c_str());
+	TableGroup::halve(); // (in place: allocating new tables now would make things worse)
+	nShrinks++;
+	return true;
+}
+
+void monitorLoop()
+{
+	using namespace std::chrono;
+	static constexpr auto pollInterval = seconds(1);
+	static constexpr auto cooldown = seconds(10);
+
+	uint64_t lastEvents = eventsPath.empty() ? 0 : readEvents(eventsPath);
+	auto lastShrink = steady_clock::now() - cooldown;
+	bool pending = false;
+
+	std::unique_lock<std::mutex> lock(monitorMutex);
+	while (!monitorCv.wait_for(lock, pollInterval, [] { return stopping; })) {
+		bool pressure = false;
+		if (!eventsPath.empty()) {
+			const uint64_t events = readEvents(eventsPath);
+			pressure = (events > lastEvents);
+			lastEvents = events;
+		}
+		if (!psiPath.empty() && readPsi(psiPath) >= threshold) {
+			pressure = true;
+		}
+
+		if (pressure && steady_clock::now() - lastShrink >= cooldown) {
+			pending = true;
+		}
+
+		if (pending && shrink()) { // (if the tables are busy, try again next time)
+			pending = false;
+			lastShrink = steady_clock::now();
+		}
+	}
+}
+
+} // namespace
+
+bool MemoryPressureMonitor::start(double psiThreshold, size_t minimumBytes)
+{
+	stop();
+
+	eventsPath = Utils::cgroupFile("memory.events");
+	psiPath = Utils::cgroupFile("memory.pressure");
+	if (psiPath.empty()) {
+		std::ifstream f("/proc/pressure/memory");
+		if (f.good()) {
+			psiPath = "/proc/pressure/memory";
+		}
+	}
+	if (eventsPath.empty() && psiPath.empty()) {
+		return false;
+	}
+
+	threshold = psiThreshold;
+	minimum = minimumBytes;
+	stopping = false;
+	monitor = std::thread(monitorLoop);
+
+	// (stop the monitor before exit(); registered after the tables were constructed, so runs before their destructors)
+	static const bool stopAtExit = (std::atexit([] { MemoryPressureMonitor::stop(); }) == 0);
+	(void)stopAtExit;
+	return true;
+}
+
+void MemoryPressureMonitor::stop()
+{
+	if (!monitor.joinable()) {
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(monitorMutex);
+		stopping = true;
+	}
+	monitorCv.notify_one();
+	monitor.join();
+}
+
+bool MemoryPressureMonitor::isRunning()
+{
+	return monitor.joinable();
+}
+
+std::string MemoryPressureMonitor::sources()
+{
+	std::stringstream ss;
+	ss << (eventsPath.empty() ? "" : eventsPath) << ((!eventsPath.empty() && !psiPath.empty()) ? ", " : "") << psiPath;
+	return ss.str();
+}
+
+unsigned int MemoryPressureMonitor::shrinkCount()
+{
+	return nShrinks;
+}
+
+} // namespace juddperft
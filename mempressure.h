@@ -0,0 +1,67 @@
+/*
+
+MIT License
+
+Copyright(c) 2016-2025 Judd Niemann
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files(the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+
+//////////////////////////////////////////////
+// mempressure.h							//
+// Defines:									//
+// Memory-pressure monitor, which shrinks	//
+// the hash tables (keeping their records)	//
+//////////////////////////////////////////////
+
+#ifndef _MEMPRESSURE_H
+#define _MEMPRESSURE_H 1
+
+#include <cstddef>
+#include <string>
+
+namespace juddperft {
+
+// The monitor polls (once a second) the memory.events file of this process's cgroup (for new "high" or "max" events,
+// ie the cgroup hitting its memory limits), and the memory PSI (pressure stall information) file: the cgroup's
+// memory.pressure, or otherwise /proc/pressure/memory (for the "some" avg10 figure reaching psiThreshold percent).
+// On pressure, the hash tables are halved in size (keeping as many records as will fit; see TableGroup::setMemory()),
+// but only once the tables are idle (TableGroup::useMutex), and no smaller than minimumBytes.
+// After a shrink, the monitor waits 10 seconds (the PSI averaging period) before shrinking again.
+// Tables which are mapped from a file (see TableGroup::attachShared()) are left alone.
+
+constexpr double DEFAULT_PSI_THRESHOLD = 10.0;
+constexpr size_t DEFAULT_AUTOSHRINK_MINIMUM = 64ull << 20;
+
+class MemoryPressureMonitor
+{
+public:
+	// start() : returns false if there is nothing to monitor
+	static bool start(double psiThreshold, size_t minimumBytes);
+	static void stop();
+	static bool isRunning();
+	static std::string sources(); // the files being monitored
+	static unsigned int shrinkCount();
+};
+
+} // namespace juddperft
+
+#endif // _MEMPRESSURE_H
@@ -27,6 +27,7 @@ SOFTWARE.
 #include "movegen.h"
 
 #include "chessposition.h"
+#include "search.h"
 
 #include <cstring>
 #include <cstdio>
@@ -61,8 +62,6 @@ uint64_t movegen_total_cycles = 0;
 // generateMoves()
 ////////////////////////////////////////////
 
-MoveGenerator moveGenerator; // instance; to ensure movetable is initialised (todo: singleton ? hasn't been necessary so far ...)
-
 // helper functions for writing flags
 
 static inline void set_flag(ChessMove *m, const MoveFlags& f)
@@ -120,7 +119,8 @@ inline bool MoveGenerator::isInCheck(const ChessPosition& P, bool bIsBlack)
 // White Move Generation Functions:     //
 // generateWhiteMoves(),                //
 // isWhiteInCheck(),                    //
-// scanWhiteMoveForChecks()             //
+// scanWhiteMoveForChecks(),            //
+// whiteCanEscapeCheck()                //
 //////////////////////////////////////////
 
 inline void MoveGenerator::generateWhiteMoves(const ChessPosition& P, ChessMove* pM)
@@ -140,8 +140,8 @@ inline void MoveGenerator::generateWhiteMoves(const ChessPosition& P, ChessMove*
 	const Bitboard& PD = P.D;
 
 	const Bitboard PAB = PA & PB; // Bitboard containing EnPassants and kings
-	const Bitboard Occupied = PA | PB | PC;	// all squares occupied by something
-	const Bitboard BlackOccupied = Occupied & PD; // all squares occupied by B, including Black EP Squares
+	const Bitboard Occupied = P.getOccupied();	// all squares occupied by something
+	const Bitboard BlackOccupied = P.getBlackOccupied(); // all squares occupied by B, including Black EP Squares
 	const Bitboard BlackCapturables = BlackOccupied & ~PAB; // All black pieces except enpassants and black king
 	const Bitboard EP = PAB & ~PC; // E.P. squares (any color)
 	const Bitboard WhiteRoam // all squares where White is potentially free to go
@@ -223,6 +223,7 @@ inline void MoveGenerator::generateWhiteMoves(const ChessPosition& P, ChessMove*
 				Q.B &= ~X;
 				Q.C &= ~X;
 				Q.D &= ~X;
+				Q.removeDerived(X);
 			}
 
 			// clear old and new square:
@@ -236,6 +237,7 @@ inline void MoveGenerator::generateWhiteMoves(const ChessPosition& P, ChessMove*
 			Q.A |= static_cast<int64_t>(piece & 1) << dest;
 			Q.B |= static_cast<int64_t>((piece & 2) >> 1) << dest;
 			Q.C |= static_cast<int64_t>((piece & 4) >> 2) << dest;
+			Q.moveDerived(FROM, TO, false, piece == WKING);
 
 			// test if doing all this puts white in check. If so, move isn't legal
 			if (isWhiteInCheck(Q)) {
@@ -246,6 +248,7 @@ inline void MoveGenerator::generateWhiteMoves(const ChessPosition& P, ChessMove*
 				Q.B = PB;
 				Q.C = PC;
 				Q.D = PD;
+				Q.copyDerived(P);
 				continue; // go on to next potential move
 			}
 
@@ -258,6 +261,7 @@ inline void MoveGenerator::generateWhiteMoves(const ChessPosition& P, ChessMove*
 					Q.B |= x;
 					Q.C &= ~x;
 					Q.D &= ~x;
+					Q.addDerived(x, false);
 				} else if (TO & RANK8) {
 					// make an additional 3 copies for the underpromotions
 					*(pM + 1) = *pM;
@@ -294,6 +298,7 @@ inline void MoveGenerator::generateWhiteMoves(const ChessPosition& P, ChessMove*
 			Q.B = PB;
 			Q.C = PC;
 			Q.D = PD;
+			Q.copyDerived(P);
 
 		} // ends loop over mv
 
@@ -310,7 +315,7 @@ inline void MoveGenerator::generateWhiteMoves(const ChessPosition& P, ChessMove*
 	} // ends loop over origin
 
 	// castling
-	if (PA & PB & PC & ~PD & E1) { // King still in original position
+	if (P.getWhiteKing() & E1) { // King still in original position
 
 		// Conditionally generate O-O move:
 		if (P.whiteCanCastle && // White still has castle rights
@@ -329,10 +334,18 @@ inline void MoveGenerator::generateWhiteMoves(const ChessPosition& P, ChessMove*
 			Q.B ^= 0x000000000000000a;
 			Q.C ^= 0x000000000000000f;
 			Q.D &= 0xfffffffffffffff0;	// clear colour of e1, f1, g1, h1 (make white)
+			Q.castleDerived(0x000000000000000f, 0x000000000000000a, false);
 
 			scanWhiteMoveForChecks(Q, pM);
 			pM++; // Add to list (advance pointer)
 			pM->flags = 0;
+
+			// restore test board
+			Q.A = PA;
+			Q.B = PB;
+			Q.C = PC;
+			Q.D = PD;
+			Q.copyDerived(P);
 		}
 
 		// Conditionally generate O-O-O move:
@@ -353,10 +366,18 @@ inline void MoveGenerator::generateWhiteMoves(const ChessPosition& P, ChessMove*
 			Q.B ^= 0x0000000000000028;
 			Q.C ^= 0x00000000000000b8;
 			Q.D &= 0xffffffffffffff07;	// clear colour of a1, b1, c1, d1, e1 (make white)
+			Q.castleDerived(0x00000000000000b8, 0x0000000000000028, false);
 
 			scanWhiteMoveForChecks(Q, pM);
 			pM++; // Add to list (advance pointer)
 			pM->flags = 0;
+
+			// restore test board
+			Q.A = PA;
+			Q.B = PB;
+			Q.C = PC;
+			Q.D = PD;
+			Q.copyDerived(P);
 		}
 	} // ends castling
 
@@ -366,10 +387,10 @@ inline void MoveGenerator::generateWhiteMoves(const ChessPosition& P, ChessMove*
 
 inline Bitboard MoveGenerator::isWhiteInCheck(const ChessPosition& Z, Bitboard extend)
 {
-	const Bitboard WhiteKing = (Z.A & Z.B & Z.C & ~Z.D) | extend;
+	const Bitboard WhiteKing = Z.getWhiteKing() | extend;
 	const Bitboard V = (Z.A & Z.B & ~Z.C) |	// All EP squares, regardless of colour
 				 WhiteKing |			// White King
-				 ~(Z.A | Z.B | Z.C);	// All Unoccupied squares
+				 ~Z.getOccupied();	// All Unoccupied squares
 
 	const Bitboard A = Z.A & Z.D; // Black A-Plane
 	const Bitboard B = Z.B & Z.D; // Black B-Plane
@@ -400,11 +421,7 @@ inline void MoveGenerator::scanWhiteMoveForChecks(ChessPosition& Q, ChessMove* p
 	if (isBlackInCheck(Q))	{
 		set_flag(pM, check);
 		if (Q.dontDetectCheckmates == 0) {
-			Q.blackToMove = 1;
-			ChessMove blacksMoves[MOVELIST_SIZE];
-			Q.dontGenerateAllMoves = 1; // only need one or more moves to prove that black has at least one legal move
-			generateBlackMoves(Q, blacksMoves);
-			if (move_count(blacksMoves) == 0) { // black will be in check with no legal moves
+			if (!blackCanEscapeCheck(Q)) { // black will be in check with no legal moves
 				set_flag(pM, checkmate); // this move is a checkmating move
 			}
 		}
@@ -414,12 +431,197 @@ inline void MoveGenerator::scanWhiteMoveForChecks(ChessPosition& Q, ChessMove* p
 	}
 }
 
+// whiteCanEscapeCheck() : given a position in which White is in check, determines
+// whether White has at least one legal move. Only King moves, and (when there is
+// a single checking piece) captures of the checker and interpositions are tried,
+// stopping at the first legal one. Double checks are settled by King moves alone.
+
+inline bool MoveGenerator::whiteCanEscapeCheck(const ChessPosition& P)
+{
+	const Bitboard& PA = P.A;
+	const Bitboard& PB = P.B;
+	const Bitboard& PC = P.C;
+	const Bitboard& PD = P.D;
+
+	const Bitboard PAB = PA & PB; // Bitboard containing EnPassants and kings
+	const Bitboard Occupied = P.getOccupied(); // all squares occupied by something
+	const Bitboard BlackOccupied = P.getBlackOccupied(); // all squares occupied by B, including Black EP Squares
+	const Bitboard BlackCapturables = BlackOccupied & ~PAB; // All black pieces except enpassants and black king
+	const Bitboard EP = PAB & ~PC; // E.P. squares (any color)
+	const Bitboard Vacant = ~Occupied | EP; // squares which don't block sliding pieces
+	const Bitboard WhiteRoam = ~Occupied | BlackCapturables | EP; // all squares where White is potentially free to go
+	const Bitboard K = P.getWhiteKing();
+
+	// create test board
+	ChessPosition Q = P;
+
+	// King moves to vacant squares can all be tested at once
+	// (the King's current square remains transparent to sliders, so it can't hide behind itself)
+	const Bitboard kingMoves = fillKingAttacks(K) & WhiteRoam;
+	const Bitboard kingQuiet = kingMoves & ~BlackCapturables;
+	if (kingQuiet & ~isWhiteInCheck(P, kingQuiet)) {
+		return true;
+	}
+
+	// King captures need to be tested individually on the test board
+	Bitboard kingCaptures = kingMoves & BlackCapturables;
+	while (kingCaptures) {
+		const Bitboard TO = kingCaptures & (0 - kingCaptures); // isolate lowest bit
+		kingCaptures ^= TO;
+
+		const Bitboard CLEAR = ~(K | TO);
+		Q.A = (PA & CLEAR) | TO;
+		Q.B = (PB & CLEAR) | TO;
+		Q.C = (PC & CLEAR) | TO;
+		Q.D = PD & CLEAR;
+		Q.moveDerived(K, TO, false, true);
+		if (!isWhiteInCheck(Q)) {
+			return true;
+		}
+
+		// restore test board
+		Q.A = PA;
+		Q.B = PB;
+		Q.C = PC;
+		Q.D = PD;
+		Q.copyDerived(P);
+	}
+
+	// identify checking pieces, and the squares between the King and any checking slider
+	const Bitboard S = PC & ~PA & PD; // Black Straight-moving Pieces
+	const Bitboard D = PB & ~PA & PD; // Black Diagonal-moving Pieces
+	const Bitboard N = PA & ~PB & PC & PD; // Black Knights
+	const Bitboard BP = PA & ~PB & ~PC & PD; // Black Pawns
+
+	Bitboard checkers = (fillKnightAttacks(K) & N) | (MoveUpLeftRightSingle(K) & BP);
+	Bitboard blocks = 0;
+	int nCheckers = popCount(checkers);
+
+	auto scanRay = [&](Bitboard ray, Bitboard checker) {
+		if (checker) {
+			checkers |= checker;
+			blocks |= ray & ~K;
+			nCheckers++;
+		}
+	};
+
+	Bitboard ray;
+	ray = fillUpOccluded(K, Vacant);
+	scanRay(ray, moveUpSingleOccluded(ray, S));
+	ray = fillDownOccluded(K, Vacant);
+	scanRay(ray, moveDownSingleOccluded(ray, S));
+	ray = fillLeftOccluded(K, Vacant);
+	scanRay(ray, moveLeftSingleOccluded(ray, S));
+	ray = fillRightOccluded(K, Vacant);
+	scanRay(ray, moveRightSingleOccluded(ray, S));
+	ray = fillUpLeftOccluded(K, Vacant);
+	scanRay(ray, moveUpLeftSingleOccluded(ray, D));
+	ray = fillUpRightOccluded(K, Vacant);
+	scanRay(ray, moveUpRightSingleOccluded(ray, D));
+	ray = fillDownLeftOccluded(K, Vacant);
+	scanRay(ray, moveDownLeftSingleOccluded(ray, D));
+	ray = fillDownRightOccluded(K, Vacant);
+	scanRay(ray, moveDownRightSingleOccluded(ray, D));
+
+	if (nCheckers > 1) {
+		return false; // double check: only King moves could have helped
+	}
+
+	const Bitboard targets = checkers | blocks;
+
+	// a checking pawn which has just made a double move can also be captured en passant
+	const Bitboard epTarget = ((checkers & BP) << 8) & EP & BlackOccupied;
+
+	Bitboard pieces = P.getWhiteOccupied() & ~PAB; // all White pieces except King
+	while (pieces) {
+		const Bitboard FROM = pieces & (0 - pieces); // isolate lowest bit
+		pieces ^= FROM;
+		const piece_t piece = P.getPieceAtSquare(getSquareIndex(FROM));
+
+		Bitboard mask; // Bitboard representing the evasion squares where piece can go
+
+		switch (piece) {
+		case WPAWN:
+		{
+			const Bitboard push = moveUpSingleOccluded(FROM, ~Occupied);
+			mask = ((push | moveUpSingleOccluded(push & RANK3, ~Occupied)) & blocks)
+					| ((moveUpLeftSingleOccluded(FROM, checkers) | moveUpRightSingleOccluded(FROM, checkers)) & BlackCapturables)
+					| moveUpLeftSingleOccluded(FROM, epTarget)
+					| moveUpRightSingleOccluded(FROM, epTarget);
+		}
+			break;
+
+		case WKNIGHT:
+			mask = fillKnightAttacks(FROM) & targets;
+			break;
+
+		case WBISHOP:
+			mask = getDiagonalMoveSquares(FROM, WhiteRoam, BlackCapturables) & targets;
+			break;
+
+		case WROOK:
+			mask = getStraightMoveSquares(FROM, WhiteRoam, BlackCapturables) & targets;
+			break;
+
+		case WQUEEN:
+			mask = (getDiagonalMoveSquares(FROM, WhiteRoam, BlackCapturables)
+					| getStraightMoveSquares(FROM, WhiteRoam, BlackCapturables)) & targets;
+			break;
+
+		default:
+			continue;
+		}
+
+		while (mask) {
+			const Bitboard TO = mask & (0 - mask); // isolate lowest bit
+			mask ^= TO;
+
+			if (piece == WPAWN && (TO & epTarget)) {
+				// remove the actual pawn (dest was EP square)
+				const Bitboard X = TO >> 8;
+				Q.A &= ~X;
+				Q.B &= ~X;
+				Q.C &= ~X;
+				Q.D &= ~X;
+				Q.removeDerived(X);
+			}
+
+			// clear old and new square, and populate new square with piece
+			// (for the purpose of testing check, it doesn't matter what a pawn promotes to)
+			const Bitboard CLEAR = ~(FROM | TO);
+			const unsigned long dest = getSquareIndex(TO);
+			Q.A &= CLEAR;
+			Q.B &= CLEAR;
+			Q.C &= CLEAR;
+			Q.D &= CLEAR;
+			Q.A |= static_cast<int64_t>(piece & 1) << dest;
+			Q.B |= static_cast<int64_t>((piece & 2) >> 1) << dest;
+			Q.C |= static_cast<int64_t>((piece & 4) >> 2) << dest;
+			Q.moveDerived(FROM, TO, false, false);
+
+			if (!isWhiteInCheck(Q)) {
+				return true;
+			}
+
+			// restore test board
+			Q.A = PA;
+			Q.B = PB;
+			Q.C = PC;
+			Q.D = PD;
+			Q.copyDerived(P);
+		}
+	}
+
+	return false;
+}
+
 
 //////////////////////////////////////////
 // Black Move Generation Functions:     //
 // generateBlackMoves(),                //
 // isBlackInCheck()                     //
-// scanBlackMoveForChecks()             //
+// scanBlackMoveForChecks(),            //
+// blackCanEscapeCheck()                //
 //////////////////////////////////////////
 
 inline void MoveGenerator::generateBlackMoves(const ChessPosition& P, ChessMove* pM)
@@ -439,8 +641,8 @@ inline void MoveGenerator::generateBlackMoves(const ChessPosition& P, ChessMove*
 	const Bitboard& PD = P.D;
 
 	const Bitboard PAB = PA & PB; // Bitboard containing EnPassants and kings
-	const Bitboard Occupied = PA | PB | PC; // all squares occupied by something
-	const Bitboard WhiteOccupied = Occupied & ~PD; // all squares occupied by W, including white EP Squares
+	const Bitboard Occupied = P.getOccupied(); // all squares occupied by something
+	const Bitboard WhiteOccupied = P.getWhiteOccupied(); // all squares occupied by W, including white EP Squares
 	const Bitboard WhiteCapturables = WhiteOccupied & ~PAB; // All white pieces except enpassants and white king
 	const Bitboard EP = PAB & ~PC; // E.P. squares (any color)
 	const Bitboard BlackRoam // all squares where Black is potentially free to go
@@ -522,6 +724,7 @@ inline void MoveGenerator::generateBlackMoves(const ChessPosition& P, ChessMove*
 				Q.B &= ~X;
 				Q.C &= ~X;
 				Q.D &= ~X;
+				Q.removeDerived(X);
 			}
 
 			// clear old and new square
@@ -536,6 +739,7 @@ inline void MoveGenerator::generateBlackMoves(const ChessPosition& P, ChessMove*
 			Q.B |= static_cast<int64_t>((piece & 2) >> 1) << dest;
 			Q.C |= static_cast<int64_t>((piece & 4) >> 2) << dest;
 			Q.D |= TO;
+			Q.moveDerived(FROM, TO, true, piece == BKING);
 
 			// test if doing all this puts black in check. If so, move isn't legal
 			if (isBlackInCheck(Q)) {
@@ -546,6 +750,7 @@ inline void MoveGenerator::generateBlackMoves(const ChessPosition& P, ChessMove*
 				Q.B = PB;
 				Q.C = PC;
 				Q.D = PD;
+				Q.copyDerived(P);
 				continue; // go on to next potential move
 			}
 
@@ -558,6 +763,7 @@ inline void MoveGenerator::generateBlackMoves(const ChessPosition& P, ChessMove*
 					Q.B |= x;
 					Q.C &= ~x;
 					Q.D |= x;
+					Q.addDerived(x, true);
 				} else if (TO & RANK1) {
 					// make an additional 3 copies for underpromotions
 					*(pM + 1) = *pM;
@@ -594,6 +800,7 @@ inline void MoveGenerator::generateBlackMoves(const ChessPosition& P, ChessMove*
 			Q.B = PB;
 			Q.C = PC;
 			Q.D = PD;
+			Q.copyDerived(P);
 
 		} // ends loop over mv
 
@@ -610,7 +817,7 @@ inline void MoveGenerator::generateBlackMoves(const ChessPosition& P, ChessMove*
 	} // ends loop over origin;
 
 	// castling
-	if (PA & PB & PC & PD & E8) { // King still in original position
+	if (P.getBlackKing() & E8) { // King still in original position
 
 		// Conditionally generate O-O move:
 		if (P.blackCanCastle && // Black still has castle rights
@@ -629,10 +836,18 @@ inline void MoveGenerator::generateBlackMoves(const ChessPosition& P, ChessMove*
 			Q.B ^= 0x0a00000000000000;
 			Q.C ^= 0x0f00000000000000;
 			Q.D ^= 0x0f00000000000000;
+			Q.castleDerived(0x0f00000000000000, 0x0a00000000000000, true);
 
 			scanBlackMoveForChecks(Q, pM);
 			pM++; // Add to list (advance pointer)
 			pM->flags = 0;
+
+			// restore test board
+			Q.A = PA;
+			Q.B = PB;
+			Q.C = PC;
+			Q.D = PD;
+			Q.copyDerived(P);
 		}
 
 		// Conditionally generate O-O-O move:
@@ -652,10 +867,18 @@ inline void MoveGenerator::generateBlackMoves(const ChessPosition& P, ChessMove*
 			Q.B ^= 0x2800000000000000;
 			Q.C ^= 0xb800000000000000;
 			Q.D ^= 0xb800000000000000;
+			Q.castleDerived(0xb800000000000000, 0x2800000000000000, true);
 
 			scanBlackMoveForChecks(Q, pM);
 			pM++; // Add to list (advance pointer)
 			pM->flags = 0;
+
+			// restore test board
+			Q.A = PA;
+			Q.B = PB;
+			Q.C = PC;
+			Q.D = PD;
+			Q.copyDerived(P);
 		}
 
 	} // ends castling
@@ -666,10 +889,10 @@ inline void MoveGenerator::generateBlackMoves(const ChessPosition& P, ChessMove*
 
 inline Bitboard MoveGenerator::isBlackInCheck(const ChessPosition& Z, Bitboard extend)
 {
-	const Bitboard BlackKing = (Z.A & Z.B & Z.C & Z.D) | extend;
+	const Bitboard BlackKing = Z.getBlackKing() | extend;
 	const Bitboard V = (Z.A & Z.B & ~Z.C) |	// All EP squares, regardless of colour
 				 BlackKing |			// Black King
-				 ~(Z.A | Z.B | Z.C);	// All Unoccupied squares
+				 ~Z.getOccupied();	// All Unoccupied squares
 
 	const Bitboard A = Z.A & ~Z.D; // White A-Plane
 	const Bitboard B = Z.B & ~Z.D; // White B-Plane
@@ -700,11 +923,7 @@ inline void MoveGenerator::scanBlackMoveForChecks(ChessPosition& Q, ChessMove* p
 	if (isWhiteInCheck(Q))	{
 		set_flag(pM, check);
 		if (Q.dontDetectCheckmates == 0) {
-			Q.blackToMove = 0;
-			ChessMove whitesMoves[MOVELIST_SIZE];
-			Q.dontGenerateAllMoves = 1; // only need one or more moves to prove that white has at least one legal move
-			generateWhiteMoves(Q, whitesMoves);
-			if (move_count(whitesMoves) == 0) { // white will be in check with no legal moves
+			if (!whiteCanEscapeCheck(Q)) { // white will be in check with no legal moves
 				set_flag(pM, checkmate); // this move is a checkmating move
 			}
 		}
@@ -714,141 +933,581 @@ inline void MoveGenerator::scanBlackMoveForChecks(ChessPosition& Q, ChessMove* p
 	}
 }
 
-squareindex_t MoveGenerator::mvtable[16][64][32];
+// blackCanEscapeCheck() : given a position in which Black is in check, determines
+// whether Black has at least one legal move. Only King moves, and (when there is
+// a single checking piece) captures of the checker and interpositions are tried,
+// stopping at the first legal one. Double checks are settled by King moves alone.
 
-void MoveGenerator::populate_mvtable()
+inline bool MoveGenerator::blackCanEscapeCheck(const ChessPosition& P)
 {
-	memset(mvtable, xx, 16 * 64 * 32 * sizeof(squareindex_t));
-
-	for (int p = 0; p < 16; p++) {
-		for (int sq = 0; sq < 64; sq++) {
-			switch(p) {
-			case WPAWN:
-			{
-				int m = 0;
-
-				// captures
-				if (const auto captLeft = MoveUpLeftIndex[sq]; captLeft != xx) {
-					mvtable[p][sq][m++] = captLeft;
-				}
+	const Bitboard& PA = P.A;
+	const Bitboard& PB = P.B;
+	const Bitboard& PC = P.C;
+	const Bitboard& PD = P.D;
 
-				if (const auto captRight = MoveUpRightIndex[sq]; captRight != xx) {
-					mvtable[p][sq][m++] = captRight;
-				}
+	const Bitboard PAB = PA & PB; // Bitboard containing EnPassants and kings
+	const Bitboard Occupied = P.getOccupied(); // all squares occupied by something
+	const Bitboard WhiteOccupied = P.getWhiteOccupied(); // all squares occupied by W, including white EP Squares
+	const Bitboard WhiteCapturables = WhiteOccupied & ~PAB; // All white pieces except enpassants and white king
+	const Bitboard EP = PAB & ~PC; // E.P. squares (any color)
+	const Bitboard Vacant = ~Occupied | EP; // squares which don't block sliding pieces
+	const Bitboard BlackRoam = ~Occupied | WhiteCapturables | EP; // all squares where Black is potentially free to go
+	const Bitboard K = P.getBlackKing();
 
-				// advances
-				if (const auto step1 = MoveUpIndex[sq]; step1 != xx) {
-					mvtable[p][sq][m++] = step1;
-					if (sq >= h2 && sq <= a2) { // double pawn advance only available from rank 2
-						if (const auto step2 = MoveUpIndex[step1]; step2 != xx) {
-							mvtable[p][sq][m++] = step2;
-						}
-					}
-				}
+	// create test board
+	ChessPosition Q = P;
+
+	// King moves to vacant squares can all be tested at once
+	// (the King's current square remains transparent to sliders, so it can't hide behind itself)
+	const Bitboard kingMoves = fillKingAttacks(K) & BlackRoam;
+	const Bitboard kingQuiet = kingMoves & ~WhiteCapturables;
+	if (kingQuiet & ~isBlackInCheck(P, kingQuiet)) {
+		return true;
+	}
+
+	// King captures need to be tested individually on the test board
+	Bitboard kingCaptures = kingMoves & WhiteCapturables;
+	while (kingCaptures) {
+		const Bitboard TO = kingCaptures & (0 - kingCaptures); // isolate lowest bit
+		kingCaptures ^= TO;
+
+		const Bitboard CLEAR = ~(K | TO);
+		Q.A = (PA & CLEAR) | TO;
+		Q.B = (PB & CLEAR) | TO;
+		Q.C = (PC & CLEAR) | TO;
+		Q.D = (PD & CLEAR) | TO;
+		Q.moveDerived(K, TO, true, true);
+		if (!isBlackInCheck(Q)) {
+			return true;
+		}
+
+		// restore test board
+		Q.A = PA;
+		Q.B = PB;
+		Q.C = PC;
+		Q.D = PD;
+		Q.copyDerived(P);
+	}
+
+	// identify checking pieces, and the squares between the King and any checking slider
+	const Bitboard S = PC & ~PA & ~PD; // White Straight-moving Pieces
+	const Bitboard D = PB & ~PA & ~PD; // White Diagonal-moving Pieces
+	const Bitboard N = PA & ~PB & PC & ~PD; // White Knights
+	const Bitboard WP = PA & ~PB & ~PC & ~PD; // White Pawns
+
+	Bitboard checkers = (fillKnightAttacks(K) & N) | (MoveDownLeftRightSingle(K) & WP);
+	Bitboard blocks = 0;
+	int nCheckers = popCount(checkers);
+
+	auto scanRay = [&](Bitboard ray, Bitboard checker) {
+		if (checker) {
+			checkers |= checker;
+			blocks |= ray & ~K;
+			nCheckers++;
+		}
+	};
+
+	Bitboard ray;
+	ray = fillUpOccluded(K, Vacant);
+	scanRay(ray, moveUpSingleOccluded(ray, S));
+	ray = fillDownOccluded(K, Vacant);
+	scanRay(ray, moveDownSingleOccluded(ray, S));
+	ray = fillLeftOccluded(K, Vacant);
+	scanRay(ray, moveLeftSingleOccluded(ray, S));
+	ray = fillRightOccluded(K, Vacant);
+	scanRay(ray, moveRightSingleOccluded(ray, S));
+	ray = fillUpLeftOccluded(K, Vacant);
+	scanRay(ray, moveUpLeftSingleOccluded(ray, D));
+	ray = fillUpRightOccluded(K, Vacant);
+	scanRay(ray, moveUpRightSingleOccluded(ray, D));
+	ray = fillDownLeftOccluded(K, Vacant);
+	scanRay(ray, moveDownLeftSingleOccluded(ray, D));
+	ray = fillDownRightOccluded(K, Vacant);
+	scanRay(ray, moveDownRightSingleOccluded(ray, D));
+
+	if (nCheckers > 1) {
+		return false; // double check: only King moves could have helped
+	}
+
+	const Bitboard targets = checkers | blocks;
+
+	// a checking pawn which has just made a double move can also be captured en passant
+	const Bitboard epTarget = ((checkers & WP) >> 8) & EP & WhiteOccupied;
+
+	Bitboard pieces = P.getBlackOccupied() & ~PAB; // all Black pieces except King
+	while (pieces) {
+		const Bitboard FROM = pieces & (0 - pieces); // isolate lowest bit
+		pieces ^= FROM;
+		const piece_t piece = P.getPieceAtSquare(getSquareIndex(FROM));
+
+		Bitboard mask; // Bitboard representing the evasion squares where piece can go
+
+		switch (piece) {
+		case BPAWN:
+		{
+			const Bitboard push = moveDownSingleOccluded(FROM, ~Occupied);
+			mask = ((push | moveDownSingleOccluded(push & RANK6, ~Occupied)) & blocks)
+					| ((moveDownLeftSingleOccluded(FROM, checkers) | moveDownRightSingleOccluded(FROM, checkers)) & WhiteCapturables)
+					| moveDownLeftSingleOccluded(FROM, epTarget)
+					| moveDownRightSingleOccluded(FROM, epTarget);
+		}
+			break;
+
+		case BKNIGHT:
+			mask = fillKnightAttacks(FROM) & targets;
+			break;
+
+		case BBISHOP:
+			mask = getDiagonalMoveSquares(FROM, BlackRoam, WhiteCapturables) & targets;
+			break;
+
+		case BROOK:
+			mask = getStraightMoveSquares(FROM, BlackRoam, WhiteCapturables) & targets;
+			break;
+
+		case BQUEEN:
+			mask = (getDiagonalMoveSquares(FROM, BlackRoam, WhiteCapturables)
+					| getStraightMoveSquares(FROM, BlackRoam, WhiteCapturables)) & targets;
+			break;
+
+		default:
+			continue;
+		}
+
+		while (mask) {
+			const Bitboard TO = mask & (0 - mask); // isolate lowest bit
+			mask ^= TO;
+
+			if (piece == BPAWN && (TO & epTarget)) {
+				// remove the actual pawn (dest was EP square)
+				const Bitboard X = TO << 8;
+				Q.A &= ~X;
+				Q.B &= ~X;
+				Q.C &= ~X;
+				Q.D &= ~X;
+				Q.removeDerived(X);
 			}
-				break;
 
-			case BPAWN:
-			{
-				int m = 0;
+			// clear old and new square, and populate new square with piece
+			// (for the purpose of testing check, it doesn't matter what a pawn promotes to)
+			const Bitboard CLEAR = ~(FROM | TO);
+			const unsigned long dest = getSquareIndex(TO);
+			Q.A &= CLEAR;
+			Q.B &= CLEAR;
+			Q.C &= CLEAR;
+			Q.D &= CLEAR;
+			Q.A |= static_cast<int64_t>(piece & 1) << dest;
+			Q.B |= static_cast<int64_t>((piece & 2) >> 1) << dest;
+			Q.C |= static_cast<int64_t>((piece & 4) >> 2) << dest;
+			Q.D |= TO;
+			Q.moveDerived(FROM, TO, true, false);
 
-				// captures
-				if (const auto captLeft = MoveDownLeftIndex[sq]; captLeft != xx) {
-					mvtable[p][sq][m++] = captLeft;
-				}
+			if (!isBlackInCheck(Q)) {
+				return true;
+			}
 
-				if (const auto captRight = MoveDownRightIndex[sq]; captRight != xx) {
-					mvtable[p][sq][m++] = captRight;
-				}
+			// restore test board
+			Q.A = PA;
+			Q.B = PB;
+			Q.C = PC;
+			Q.D = PD;
+			Q.copyDerived(P);
+		}
+	}
 
-				// advances
-				if (const auto step1 = MoveDownIndex[sq]; step1 != xx) {
-					mvtable[p][sq][m++] = step1;
-					if (sq >= h7 && sq <= a7) { // double pawn advance only available from rank 7
-						if (const auto step2 = MoveDownIndex[step1]; step2 != xx) {
-							mvtable[p][sq][m++] = step2;
-						}
-					}
-				}
+	return false;
+}
+
+//////////////////////////////////////////
+// Leaf Statistics Functions:           //
+// generateLeafStats(),                 //
+// tallyWhiteLeafStats()                //
+//////////////////////////////////////////
+
+// generateLeafStats() : adds the number of legal moves in position P, along with the
+// numbers of captures, e.p. captures, castles, promotions, checks and checkmates amongst
+// them, to *pI, without generating a move list. Black's moves are tallied by turning the
+// position upside-down and tallying white's moves instead.
+
+void MoveGenerator::generateLeafStats(const ChessPosition& P, PerftInfo* pI)
+{
+	if (P.blackToMove) {
+		if (P.blackIsCheckmated || P.blackIsStalemated) {
+			return;
+		}
+
+		ChessPosition F = P;
+		tallyWhiteLeafStats(F.flipColours(), pI);
+	} else {
+		if (P.whiteIsCheckmated || P.whiteIsStalemated) {
+			return;
+		}
+
+		tallyWhiteLeafStats(P, pI);
+	}
+}
+
+// tallyWhiteLeafStats() : the work-horse of generateLeafStats().
+// Legality is established for whole destination masks at a time (using check-evasion and pin masks),
+// so that most counts are simply popcounts. Only moves which give check get individual treatment
+// (to test for checkmate), along with the rare move types (e.p. captures, promotions, castling),
+// which are played out on a test board.
+
+inline void MoveGenerator::tallyWhiteLeafStats(const ChessPosition& P, PerftInfo* pI)
+{
+	const Bitboard& PA = P.A;
+	const Bitboard& PB = P.B;
+	const Bitboard& PC = P.C;
+	const Bitboard& PD = P.D;
+
+	const Bitboard PAB = PA & PB; // Bitboard containing EnPassants and kings
+	const Bitboard Occupied = P.getOccupied(); // all squares occupied by something
+	const Bitboard BlackOccupied = P.getBlackOccupied(); // all squares occupied by B, including Black EP Squares
+	const Bitboard BlackCapturables = BlackOccupied & ~PAB; // All black pieces except enpassants and black king
+	const Bitboard EP = PAB & ~PC; // E.P. squares (any color)
+	const Bitboard Vacant = ~Occupied | EP; // squares which don't block sliding pieces
+	const Bitboard WhiteRoam = ~Occupied | BlackCapturables | EP; // all squares where White is potentially free to go
+	const Bitboard WhiteOccupied = P.getWhiteOccupied() & ~EP; // all White units, including King
+	const Bitboard K = P.getWhiteKing();
+	const Bitboard BK = P.getBlackKing();
+
+	const Bitboard BS = PC & ~PA & PD; // Black Straight-moving Pieces
+	const Bitboard BD = PB & ~PA & PD; // Black Diagonal-moving Pieces
+	const Bitboard BN = PA & ~PB & PC & PD; // Black Knights
+	const Bitboard BP = PA & ~PB & ~PC & PD; // Black Pawns
+	const Bitboard WS = PC & ~PA & ~PD; // White Straight-moving Pieces
+	const Bitboard WD = PB & ~PA & ~PD; // White Diagonal-moving Pieces
+
+	const bool detectChecks = !P.dontDetectChecks;
+	const bool detectCheckmates = detectChecks && !P.dontDetectCheckmates;
+
+	// squares attacked by Black. The White King is removed, so that it can't retreat along a line of attack
+	const Bitboard X = Vacant | K;
+	const Bitboard attacked = fillKnightAttacks(BN)
+			| MoveDownLeftRightSingle(BP)
+			| fillKingAttacks(BK)
+			| moveUpSingleOccluded(fillUpOccluded(BS, X), ~0ull)
+			| moveDownSingleOccluded(fillDownOccluded(BS, X), ~0ull)
+			| moveLeftSingleOccluded(fillLeftOccluded(BS, X), ~0ull)
+			| moveRightSingleOccluded(fillRightOccluded(BS, X), ~0ull)
+			| moveUpLeftSingleOccluded(fillUpLeftOccluded(BD, X), ~0ull)
+			| moveUpRightSingleOccluded(fillUpRightOccluded(BD, X), ~0ull)
+			| moveDownLeftSingleOccluded(fillDownLeftOccluded(BD, X), ~0ull)
+			| moveDownRightSingleOccluded(fillDownRightOccluded(BD, X), ~0ull);
+
+	// Pieces giving check to the White King (and the squares in between), and White pieces pinned against it
+	Bitboard checkers = (fillKnightAttacks(K) & BN) | (MoveUpLeftRightSingle(K) & BP);
+	Bitboard blocks = 0;
+	Bitboard pinned = 0;
+	Bitboard pinLine[64]; // (only valid for squares in pinned) squares a pinned piece may move to
+
+	// Squares from which each type of White piece would give check to the Black King, and
+	// White pieces which would discover check (from a White slider behind them) by leaving their line
+	Bitboard straightChecks = 0;
+	Bitboard diagonalChecks = 0;
+	Bitboard discoverers = 0;
+	Bitboard discoveryLine[64]; // (only valid for squares in discoverers) squares which don't uncover the check
+
+	auto scanLines = [&](auto fill, auto step, Bitboard blackSliders, Bitboard whiteSliders, Bitboard& checkSquares) {
+		// from White King:
+		const Bitboard ray = fill(K, Vacant);
+		const Bitboard first = step(ray, ~Vacant); // first unit encountered along the line (if any)
+		if (first & blackSliders) {
+			checkers |= first;
+			blocks |= ray & ~K;
+		} else if (first & WhiteOccupied) {
+			const Bitboard ray2 = fill(first, Vacant);
+			const Bitboard second = step(ray2, ~Vacant);
+			if (second & blackSliders) {
+				pinned |= first;
+				pinLine[getSquareIndex(first)] = ray | ray2 | second;
 			}
-				break;
-
-			case WBISHOP:
-			case BBISHOP:
-			{
-				int m = 0;
-				Bitboard D = fillDiagonalAttacksOccluded(1ull << sq, -1ll);
-				for (squareindex_t dsq = 0; dsq < 64; dsq++) {
-					if ((1ull << dsq) & D) {
-						mvtable[p][sq][m++] = dsq;
-					}
-				}
+		}
+
+		// from Black King:
+		const Bitboard rayB = fill(BK, Vacant);
+		const Bitboard firstB = step(rayB, ~Vacant);
+		checkSquares |= (rayB & ~BK) | firstB;
+		if (firstB & WhiteOccupied) {
+			const Bitboard ray2 = fill(firstB, Vacant);
+			const Bitboard second = step(ray2, ~Vacant);
+			if (second & whiteSliders) {
+				discoverers |= firstB;
+				discoveryLine[getSquareIndex(firstB)] = rayB | ray2 | second;
 			}
-				break;
-
-			case WROOK:
-			case BROOK:
-			{
-				int m = 0;
-				Bitboard S = fillStraightAttacksOccluded(1ull << sq, -1ll);
-				for (squareindex_t dsq = 0; dsq < 64; dsq++) {
-					if ((1ull << dsq) & S) {
-						mvtable[p][sq][m++] = dsq;
-					}
-				}
+		}
+	};
+
+	scanLines(fillUpOccluded, moveUpSingleOccluded, BS, WS, straightChecks);
+	scanLines(fillDownOccluded, moveDownSingleOccluded, BS, WS, straightChecks);
+	scanLines(fillLeftOccluded, moveLeftSingleOccluded, BS, WS, straightChecks);
+	scanLines(fillRightOccluded, moveRightSingleOccluded, BS, WS, straightChecks);
+	scanLines(fillUpLeftOccluded, moveUpLeftSingleOccluded, BD, WD, diagonalChecks);
+	scanLines(fillUpRightOccluded, moveUpRightSingleOccluded, BD, WD, diagonalChecks);
+	scanLines(fillDownLeftOccluded, moveDownLeftSingleOccluded, BD, WD, diagonalChecks);
+	scanLines(fillDownRightOccluded, moveDownRightSingleOccluded, BD, WD, diagonalChecks);
+
+	const Bitboard pawnChecks = MoveDownLeftRightSingle(BK);
+	const Bitboard knightChecks = fillKnightAttacks(BK);
+
+	const int nCheckers = popCount(checkers);
+	const Bitboard evasions = nCheckers ? (checkers | blocks) : ~0ull; // squares which resolve a check (if any)
+
+	// create test board
+	ChessPosition Q = P;
+
+	// restoreTestBoard() : undo any changes made to the test board
+	auto restoreTestBoard = [&]() {
+		Q.A = PA;
+		Q.B = PB;
+		Q.C = PC;
+		Q.D = PD;
+		Q.copyDerived(P);
+	};
+
+	// playOnTestBoard() : play an ordinary (non-castling, non-e.p.) move on the test board
+	auto playOnTestBoard = [&](Bitboard FROM, Bitboard TO, piece_t piece) {
+		const unsigned long dest = getSquareIndex(TO);
+		const Bitboard CLEAR = ~(FROM | TO);
+		Q.A &= CLEAR;
+		Q.B &= CLEAR;
+		Q.C &= CLEAR;
+		Q.D &= CLEAR;
+		Q.A |= static_cast<int64_t>(piece & 1) << dest;
+		Q.B |= static_cast<int64_t>((piece & 2) >> 1) << dest;
+		Q.C |= static_cast<int64_t>((piece & 4) >> 2) << dest;
+		Q.moveDerived(FROM, TO, false, piece == WKING);
+
+		if (piece == WPAWN && (FROM & RANK2) && (TO & RANK4)) {
+			// e.p. square (black may be able to escape check by capturing e.p.)
+			const Bitboard x = TO >> 8;
+			Q.A |= x;
+			Q.B |= x;
+			Q.C &= ~x;
+			Q.D &= ~x;
+			Q.addDerived(x, false);
+		}
+	};
+
+	// tallyCheckOnTestBoard() : having played a move on the test board, tally check and checkmate
+	auto tallyCheckOnTestBoard = [&]() {
+		if (detectChecks && isBlackInCheck(Q)) {
+			pI->nCheck++;
+			if (detectCheckmates && !blackCanEscapeCheck(Q)) {
+				pI->nCheckmate++;
 			}
-				break;
-
-			case WKNIGHT:
-			case BKNIGHT:
-			{
-				int m = 0;
-				Bitboard N = fillKnightAttacks(1ull << sq);
-				for (squareindex_t dsq = 0; dsq < 64; dsq++) {
-					if ((1ull << dsq) & N) {
-						mvtable[p][sq][m++] = dsq;
+		}
+	};
+
+	// tallyMoves() : tally ordinary moves by piece from FROM to each square in DEST.
+	// CHECKS is the subset of DEST which is known to give check.
+	auto tallyMoves = [&](Bitboard FROM, Bitboard DEST, Bitboard CHECKS, piece_t piece) {
+		pI->nMoves += popCount(DEST);
+		pI->nCapture += popCount(DEST & BlackCapturables);
+		if (detectChecks) {
+			pI->nCheck += popCount(CHECKS);
+			if (detectCheckmates) {
+				while (CHECKS) {
+					const Bitboard TO = CHECKS & (0 - CHECKS); // isolate lowest bit
+					CHECKS ^= TO;
+					playOnTestBoard(FROM, TO, piece);
+					if (!blackCanEscapeCheck(Q)) {
+						pI->nCheckmate++;
 					}
+					restoreTestBoard();
 				}
 			}
-				break;
-
-			case WQUEEN:
-			case BQUEEN:
-			{
-				int m = 0;
-				Bitboard D = fillDiagonalAttacksOccluded(1ull << sq, -1ll);
-				Bitboard S = fillStraightAttacksOccluded(1ull << sq, -1ll);
-				for (squareindex_t dsq = 0; dsq < 64; dsq++) {
-					if ((1ull << dsq) & D) {
-						mvtable[p][sq][m++] = dsq;
-					}
-					if ((1ull << dsq) & S) {
-						mvtable[p][sq][m++] = dsq;
+		}
+	};
+
+	// discoveredChecks() : subset of DEST which uncovers a check by moving the piece at FROM off its line
+	auto discoveredChecks = [&](Bitboard FROM, Bitboard DEST) -> Bitboard {
+		return (FROM & discoverers) ? DEST & ~discoveryLine[getSquareIndex(FROM)] : 0;
+	};
+
+	// King moves
+	{
+		const Bitboard DEST = fillKingAttacks(K) & WhiteRoam & ~attacked;
+		tallyMoves(K, DEST, discoveredChecks(K, DEST), WKING);
+	}
+
+	if (nCheckers > 1) {
+		return; // double check: only the King can move
+	}
+
+	// Knights, Bishops, Rooks and Queens
+	Bitboard pieces = WhiteOccupied & ~PAB & ~(PA & ~PB & ~PC); // all White pieces except King and Pawns
+	while (pieces) {
+		const Bitboard FROM = pieces & (0 - pieces); // isolate lowest bit
+		pieces ^= FROM;
+		const piece_t piece = P.getPieceAtSquare(getSquareIndex(FROM));
+		const Bitboard allowed = evasions & ((FROM & pinned) ? pinLine[getSquareIndex(FROM)] : ~0ull);
+
+		Bitboard DEST;
+		Bitboard directChecks;
+		switch (piece) {
+		case WKNIGHT:
+			DEST = fillKnightAttacks(FROM) & WhiteRoam;
+			directChecks = knightChecks;
+			break;
+
+		case WBISHOP:
+			DEST = getDiagonalMoveSquares(FROM, WhiteRoam, BlackCapturables);
+			directChecks = diagonalChecks;
+			break;
+
+		case WROOK:
+			DEST = getStraightMoveSquares(FROM, WhiteRoam, BlackCapturables);
+			directChecks = straightChecks;
+			break;
+
+		case WQUEEN:
+			DEST = getDiagonalMoveSquares(FROM, WhiteRoam, BlackCapturables)
+					| getStraightMoveSquares(FROM, WhiteRoam, BlackCapturables);
+			directChecks = diagonalChecks | straightChecks;
+			break;
+
+		default:
+			continue;
+		}
+
+		DEST &= allowed;
+		tallyMoves(FROM, DEST, (DEST & directChecks) | discoveredChecks(FROM, DEST), piece);
+	}
+
+	// Pawns
+	// tallyPawnMoves() : tally pawn moves by the pawns in PAWNS, which are all confined to ALLOWED,
+	// and which uncover a check by moving to any square in DISCOVERIES. The four kinds of pawn move
+	// are tallied separately, so that the origin of any individual move can be recovered from its destination.
+	auto tallyPawnMoves = [&](Bitboard PAWNS, Bitboard ALLOWED, Bitboard DISCOVERIES) {
+		const Bitboard push = moveUpSingleOccluded(PAWNS, ~Occupied);
+		const Bitboard pawnMoves[4] = {
+			push & ALLOWED,
+			moveUpSingleOccluded(push & RANK3, ~Occupied) & ALLOWED,
+			moveUpLeftSingleOccluded(PAWNS, BlackCapturables) & ALLOWED,
+			moveUpRightSingleOccluded(PAWNS, BlackCapturables) & ALLOWED
+		};
+		static constexpr int backShift[4] = {8, 16, 9, 7};
+
+		for (int k = 0; k < 4; k++) {
+			const Bitboard DEST = pawnMoves[k] & ~RANK8;
+			pI->nMoves += popCount(DEST);
+			pI->nCapture += popCount(DEST & BlackCapturables);
+
+			if (detectChecks) {
+				Bitboard CHECKS = DEST & (pawnChecks | DISCOVERIES);
+				pI->nCheck += popCount(CHECKS);
+				if (detectCheckmates) {
+					while (CHECKS) {
+						const Bitboard TO = CHECKS & (0 - CHECKS); // isolate lowest bit
+						CHECKS ^= TO;
+						playOnTestBoard(TO >> backShift[k], TO, WPAWN);
+						if (!blackCanEscapeCheck(Q)) {
+							pI->nCheckmate++;
+						}
+						restoreTestBoard();
 					}
 				}
 			}
-				break;
-
-			case WKING:
-			case BKING:
-			{
-				int m = 0;
-				Bitboard K = fillKingAttacks(1ull << sq);
-				for (squareindex_t dsq = 0; dsq < 64; dsq++) {
-					if ((1ull << dsq) & K) {
-						mvtable[p][sq][m++] = dsq;
+
+			// promotions (4 moves each)
+			Bitboard PROMOTIONS = pawnMoves[k] & RANK8;
+			if (PROMOTIONS) {
+				const int nPromotions = popCount(PROMOTIONS);
+				pI->nMoves += 4 * nPromotions;
+				pI->nPromotion += 4 * nPromotions;
+				pI->nCapture += 4 * popCount(PROMOTIONS & BlackCapturables);
+
+				while (detectChecks && PROMOTIONS) {
+					const Bitboard TO = PROMOTIONS & (0 - PROMOTIONS); // isolate lowest bit
+					PROMOTIONS ^= TO;
+					for (piece_t promoted : {WKNIGHT, WROOK, WQUEEN, WBISHOP}) {
+						playOnTestBoard(TO >> backShift[k], TO, promoted);
+						tallyCheckOnTestBoard();
+						restoreTestBoard();
 					}
 				}
 			}
-				break;
+		}
+	};
+
+	const Bitboard WP = PA & ~PB & ~PC & ~PD; // White Pawns
+	Bitboard PAWNS = WP & (pinned | discoverers); // pawns which need individual treatment
+	tallyPawnMoves(WP & ~PAWNS, evasions, 0);
+	while (PAWNS) {
+		const Bitboard FROM = PAWNS & (0 - PAWNS); // isolate lowest bit
+		PAWNS ^= FROM;
+		const unsigned long sq = getSquareIndex(FROM);
+		tallyPawnMoves(FROM,
+					   evasions & ((FROM & pinned) ? pinLine[sq] : ~0ull),
+					   (FROM & discoverers) ? ~discoveryLine[sq] : 0);
+	}
 
-			default:
-				break;
+	// e.p. captures (always played out on the test board, as they can uncover an attack along the 5th rank)
+	const Bitboard EPSquare = EP & BlackOccupied;
+	if (EPSquare) {
+		Bitboard capturers = WP & MoveDownLeftRightSingle(EPSquare);
+		while (capturers) {
+			const Bitboard FROM = capturers & (0 - capturers); // isolate lowest bit
+			capturers ^= FROM;
+
+			// remove the actual pawn (dest was EP square)
+			const Bitboard X = EPSquare >> 8;
+			Q.A &= ~X;
+			Q.B &= ~X;
+			Q.C &= ~X;
+			Q.D &= ~X;
+			Q.removeDerived(X);
+			playOnTestBoard(FROM, EPSquare, WPAWN);
+
+			if (!isWhiteInCheck(Q)) {
+				pI->nMoves++;
+				pI->nEPCapture++;
+				tallyCheckOnTestBoard();
 			}
+
+			restoreTestBoard();
 		}
 	}
-}
 
+	// castling
+	if (nCheckers == 0 && (K & E1)) { // King still in original position (and not in check)
+
+		// O-O:
+		if (P.whiteCanCastle && // White still has castle rights
+				(~PA & ~PB & PC & ~PD & H1) && // Kingside rook is in correct position
+				(WHITECASTLEZONE & Occupied) == 0 && // Castle Zone (f1, g1) is clear
+				!isWhiteInCheck(P, WHITECASTLECHECKZONE)) // King is not in Check (in e1, f1, g1)
+		{
+			pI->nMoves++;
+			pI->nCastle++;
+			Q.A ^= 0x000000000000000a;
+			Q.B ^= 0x000000000000000a;
+			Q.C ^= 0x000000000000000f;
+			Q.D &= 0xfffffffffffffff0;	// clear colour of e1, f1, g1, h1 (make white)
+			Q.castleDerived(0x000000000000000f, 0x000000000000000a, false);
+			tallyCheckOnTestBoard();
+			restoreTestBoard();
+		}
+
+		// O-O-O:
+		if (P.whiteCanCastleLong && // White still has castle-long rights
+				(~PA & ~PB & PC & ~PD & A1) && // Queenside rook is in correct Position
+				(WHITECASTLELONGZONE & Occupied) == 0 && // Castle-long zone (b1, c1, d1) is clear
+				!isWhiteInCheck(P, WHITECASTLELONGCHECKZONE)) // King is not in check (in e1, d1, c1)
+		{
+			pI->nMoves++;
+			pI->nCastleLong++;
+			Q.A ^= 0x0000000000000028;
+			Q.B ^= 0x0000000000000028;
+			Q.C ^= 0x00000000000000b8;
+			Q.D &= 0xffffffffffffff07;	// clear colour of a1, b1, c1, d1, e1 (make white)
+			Q.castleDerived(0x00000000000000b8, 0x0000000000000028, false);
+			tallyCheckOnTestBoard();
+			restoreTestBoard();
+		}
+	}
+}
 
 inline Bitboard genWhiteAttacks(const ChessPosition& Z)
 {
@@ -933,19 +1592,21 @@ void printMove(const ChessMove& mv, MoveNotationStyle style /* = LongAlgebraic *
 
 	if (style != CoOrdinate)
 	{
+		const char* terminator = (style == LongAlgebraicNoNewline) ? " " : "\n";
+
 		if (get_flag(mv, castle)) {
 			if (pBuffer == nullptr)
-				printf(" O-O\n");
+				printf(" O-O%s", terminator);
 			else
-				sprintf (pBuffer, " O-O\n");
+				sprintf (pBuffer, " O-O%s", terminator);
 			return;
 		}
 
 		if (get_flag(mv, castleLong)) {
 			if (pBuffer == nullptr)
-				printf(" O-O-O\n");
+				printf(" O-O-O%s", terminator);
 			else
-				sprintf (pBuffer, " O-O-O\n");
+				sprintf (pBuffer, " O-O-O%s", terminator);
 			return;
 		}
 	}
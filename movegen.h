@@ -46,14 +46,18 @@ SOFTWARE.
 
 #endif
 
+#include "chessposition.h"
+
 #include <cstdint>
 
+#include <array>
 #include <bitset>
 #include <iostream>
 #include <sstream>
 #include <stdexcept>
 #include <string>
 #include <type_traits>
+#include <utility>
 
 // Build Options:
 #define _USE_HASH 1								// if undefined, entire hash table system will be excluded from build
@@ -101,11 +105,67 @@ SOFTWARE.
 namespace juddperft {
 
 class ChessPosition;
+struct PerftInfo;
 
 using Bitboard = uint64_t;
 using nodecount_t = uint64_t;
 using squareindex_t = uint8_t;
 
+// WideNodeCount : a 128-bit node count, for root totals which can be too big for a nodecount_t
+// (perft 14 and beyond, from the start position)
+struct WideNodeCount
+{
+	uint64_t lo{0};
+	uint64_t hi{0};
+
+	WideNodeCount& operator+=(nodecount_t n)
+	{
+		lo += n;
+		hi += (lo < n); // carry
+		return *this;
+	}
+
+	WideNodeCount& operator+=(const WideNodeCount& w)
+	{
+		*this += w.lo;
+		hi += w.hi;
+		return *this;
+	}
+
+	// fits() : true if the count fits in a nodecount_t
+	bool fits() const
+	{
+		return hi == 0;
+	}
+
+	double toDouble() const
+	{
+		return hi * 18446744073709551616.0 + lo;
+	}
+
+	// toString() : the count in decimal
+	std::string toString() const
+	{
+		if (hi == 0) {
+			return std::to_string(lo);
+		}
+
+		// long division by 10, one 32-bit limb at a time
+		uint32_t limbs[4] = {static_cast<uint32_t>(hi >> 32), static_cast<uint32_t>(hi), static_cast<uint32_t>(lo >> 32), static_cast<uint32_t>(lo)};
+		std::string s;
+		while (limbs[0] | limbs[1] | limbs[2] | limbs[3]) {
+			uint64_t r = 0;
+			for (uint32_t& limb : limbs) {
+				const uint64_t v = (r << 32) | limb;
+				limb = static_cast<uint32_t>(v / 10);
+				r = v % 10;
+			}
+			s.insert(s.begin(), static_cast<char>('0' + r));
+		}
+		return s;
+	}
+};
+
 #ifdef COUNT_MOVEGEN_CPU_CYCLES
 extern uint64_t movegen_call_count;
 extern uint64_t movegen_total_cycles;
@@ -201,29 +261,25 @@ enum MoveNotationStyle{
 class MoveGenerator
 {
 public:
-	MoveGenerator() {
-		populate_mvtable();
-	};
-
 	static void generateMoves(const ChessPosition & P, ChessMove * pM);
 	static bool isInCheck(const ChessPosition& P, bool bIsBlack);
+	static void generateLeafStats(const ChessPosition& P, PerftInfo* pI); // tallies legal moves (and their captures, checks ... etc) without generating them
 
 private:
 	// White Move-Generation Functions:
 	static inline void generateWhiteMoves(const ChessPosition& P, ChessMove*);
 	static inline Bitboard isWhiteInCheck(const ChessPosition & Z, Bitboard extend = 0);
 	static inline void scanWhiteMoveForChecks(ChessPosition& Q, ChessMove* pM); // detects whether white's proposed move will put black in check or checkmate. updates pM->Check and pM->Checkmate
+	static inline bool whiteCanEscapeCheck(const ChessPosition& P); // given that white is in check, determines whether white has at least one legal move
 
 	// Black Move-Generation Functions:
 	static inline void generateBlackMoves(const ChessPosition& P, ChessMove*);
 	static inline Bitboard isBlackInCheck(const ChessPosition & Z, Bitboard extend = 0);
 	static inline void scanBlackMoveForChecks(ChessPosition& Q, ChessMove* pM); // detects whether black's proposed move will put white in check or checkmate. updates pM->Check and pM->Checkmate
+	static inline bool blackCanEscapeCheck(const ChessPosition& P); // given that black is in check, determines whether black has at least one legal move
 
-	// precomputed move table: contains potential moves (except castling) for every piece on every square
-	static squareindex_t mvtable[16][64][32]; // piece(16) x origin-square(64) x dest-square(32) = 32k ... (max dest squares = 27 for queen, but using 32 for alignment)
-
-	// function to initialise the move table
-	static void populate_mvtable();
+	// Leaf Statistics Functions:
+	static inline void tallyWhiteLeafStats(const ChessPosition& P, PerftInfo* pI);
 };
 
 // Print I/O functions:
@@ -435,99 +491,51 @@ enum Regions : Bitboard {
 	RIGHTMASK = 0x7f7f7f7f7f7f7f7f
 };
 
-// Pre-calculated move tables: BitBoards
-
-constexpr Bitboard MoveUp[64] = {
-	0x0000000000000100, 0x0000000000000200, 0x0000000000000400, 0x0000000000000800, 0x00000000001000, 0x0000000000002000, 0x0000000000004000, 0x0000000000008000,
-	0x0000000000010000, 0x0000000000020000, 0x0000000000040000, 0x0000000000080000, 0x00000000100000, 0x0000000000200000, 0x0000000000400000, 0x0000000000800000,
-	0x0000000001000000, 0x0000000002000000, 0x0000000004000000, 0x0000000008000000, 0x00000010000000, 0x0000000020000000, 0x0000000040000000, 0x0000000080000000,
-	0x0000000100000000, 0x0000000200000000, 0x0000000400000000, 0x0000000800000000, 0x00001000000000, 0x0000002000000000, 0x0000004000000000, 0x0000008000000000,
-	0x0000010000000000, 0x0000020000000000, 0x0000040000000000, 0x0000080000000000, 0x00100000000000, 0x0000200000000000, 0x0000400000000000, 0x0000800000000000,
-	0x0001000000000000, 0x0002000000000000, 0x0004000000000000, 0x0008000000000000, 0x10000000000000, 0x0020000000000000, 0x0040000000000000, 0x0080000000000000,
-	0x0100000000000000, 0x0200000000000000, 0x0400000000000000, 0x0800000000000000, 0x1000000000000000, 0x2000000000000000, 0x4000000000000000, 0x8000000000000000,
-	000000000000000000, 000000000000000000, 000000000000000000, 000000000000000000, 0000000000000000, 000000000000000000, 000000000000000000, 000000000000000000
-};
-
-constexpr Bitboard MoveUpRight[64] = {
-	000000000000000000, 0x0000000000000100, 0x0000000000000200, 0x0000000000000400, 0x00000000000800, 0x0000000000001000, 0x0000000000002000, 0x0000000000004000,
-	000000000000000000, 0x0000000000010000, 0x0000000000020000, 0x0000000000040000, 0x00000000080000, 0x0000000000100000, 0x0000000000200000, 0x0000000000400000,
-	000000000000000000, 0x0000000001000000, 0x0000000002000000, 0x0000000004000000, 0x00000008000000, 0x0000000010000000, 0x0000000020000000, 0x0000000040000000,
-	000000000000000000, 0x0000000100000000, 0x0000000200000000, 0x0000000400000000, 0x00000800000000, 0x0000001000000000, 0x0000002000000000, 0x0000004000000000,
-	000000000000000000, 0x0000010000000000, 0x0000020000000000, 0x0000040000000000, 0x00080000000000, 0x0000100000000000, 0x0000200000000000, 0x0000400000000000,
-	000000000000000000, 0x0001000000000000, 0x0002000000000000, 0x0004000000000000, 0x08000000000000, 0x0010000000000000, 0x0020000000000000, 0x0040000000000000,
-	000000000000000000, 0x0100000000000000, 0x0200000000000000, 0x0400000000000000, 0x800000000000000, 0x1000000000000000, 0x2000000000000000, 0x4000000000000000,
-	000000000000000000, 000000000000000000, 000000000000000000, 000000000000000000, 0000000000000000, 000000000000000000, 000000000000000000, 000000000000000000
-};
+// Pre-calculated move tables
+// --------------------------
+// All of the lookup tables below are generated at compile-time from a (rank, file) step,
+// so the Bitboard tables, the square-index tables and the move table cannot disagree with each other.
+// They are constexpr (ie read-only), and each one is aligned to a cache-line boundary.
 
-constexpr Bitboard MoveRight[64] = {
-	000000000000000000, 0x0000000000000001, 0x0000000000000002, 0x0000000000000004, 0x00000000000008, 0x0000000000000010, 0x0000000000000020, 0x0000000000000040,
-	000000000000000000, 0x0000000000000100, 0x0000000000000200, 0x0000000000000400, 0x00000000000800, 0x0000000000001000, 0x0000000000002000, 0x0000000000004000,
-	000000000000000000, 0x0000000000010000, 0x0000000000020000, 0x0000000000040000, 0x00000000080000, 0x0000000000100000, 0x0000000000200000, 0x0000000000400000,
-	000000000000000000, 0x0000000001000000, 0x0000000002000000, 0x0000000004000000, 0x00000008000000, 0x0000000010000000, 0x0000000020000000, 0x0000000040000000,
-	000000000000000000, 0x0000000100000000, 0x0000000200000000, 0x0000000400000000, 0x00000800000000, 0x0000001000000000, 0x0000002000000000, 0x0000004000000000,
-	000000000000000000, 0x0000010000000000, 0x0000020000000000, 0x0000040000000000, 0x00080000000000, 0x0000100000000000, 0x0000200000000000, 0x0000400000000000,
-	000000000000000000, 0x0001000000000000, 0x0002000000000000, 0x0004000000000000, 0x08000000000000, 0x0010000000000000, 0x0020000000000000, 0x0040000000000000,
-	000000000000000000, 0x0100000000000000, 0x0200000000000000, 0x0400000000000000, 0x800000000000000, 0x1000000000000000, 0x2000000000000000, 0x4000000000000000
-};
-
-constexpr Bitboard MoveDownRight[64] = {
-	000000000000000000, 000000000000000000, 000000000000000000, 000000000000000000, 0000000000000000, 000000000000000000, 000000000000000000, 000000000000000000,
-	000000000000000000, 0x0000000000000001, 0x0000000000000002, 0x0000000000000004, 0x00000000000008, 0x0000000000000010, 0x0000000000000020, 0x0000000000000040,
-	000000000000000000, 0x0000000000000100, 0x0000000000000200, 0x0000000000000400, 0x00000000000800, 0x0000000000001000, 0x0000000000002000, 0x0000000000004000,
-	000000000000000000, 0x0000000000010000, 0x0000000000020000, 0x0000000000040000, 0x00000000080000, 0x0000000000100000, 0x0000000000200000, 0x0000000000400000,
-	000000000000000000, 0x0000000001000000, 0x0000000002000000, 0x0000000004000000, 0x00000008000000, 0x0000000010000000, 0x0000000020000000, 0x0000000040000000,
-	000000000000000000, 0x0000000100000000, 0x0000000200000000, 0x0000000400000000, 0x00000800000000, 0x0000001000000000, 0x0000002000000000, 0x0000004000000000,
-	000000000000000000, 0x0000010000000000, 0x0000020000000000, 0x0000040000000000, 0x00080000000000, 0x0000100000000000, 0x0000200000000000, 0x0000400000000000,
-	000000000000000000, 0x0001000000000000, 0x0002000000000000, 0x0004000000000000, 0x08000000000000, 0x0010000000000000, 0x0020000000000000, 0x0040000000000000
-};
+using MoveBitboardTable = std::array<Bitboard, 64>;
+using MoveIndexTable = std::array<int, 64>;
 
-constexpr Bitboard MoveDown[64] = {
-	000000000000000000, 000000000000000000, 000000000000000000, 000000000000000000, 0000000000000000, 000000000000000000, 000000000000000000, 000000000000000000,
-	0x0000000000000001, 0x0000000000000002, 0x0000000000000004, 0x0000000000000008, 0x00000000000010, 0x0000000000000020, 0x0000000000000040, 0x0000000000000080,
-	0x0000000000000100, 0x0000000000000200, 0x0000000000000400, 0x0000000000000800, 0x00000000001000, 0x0000000000002000, 0x0000000000004000, 0x0000000000008000,
-	0x0000000000010000, 0x0000000000020000, 0x0000000000040000, 0x0000000000080000, 0x00000000100000, 0x0000000000200000, 0x0000000000400000, 0x0000000000800000,
-	0x0000000001000000, 0x0000000002000000, 0x0000000004000000, 0x0000000008000000, 0x00000010000000, 0x0000000020000000, 0x0000000040000000, 0x0000000080000000,
-	0x0000000100000000, 0x0000000200000000, 0x0000000400000000, 0x0000000800000000, 0x00001000000000, 0x0000002000000000, 0x0000004000000000, 0x0000008000000000,
-	0x0000010000000000, 0x0000020000000000, 0x0000040000000000, 0x0000080000000000, 0x00100000000000, 0x0000200000000000, 0x0000400000000000, 0x0000800000000000,
-	0x0001000000000000, 0x0002000000000000, 0x0004000000000000, 0x0008000000000000, 0x10000000000000, 0x0020000000000000, 0x0040000000000000, 0x0080000000000000
-};
+// makeMoveIndexTable() : for every origin square, the square reached by stepping up (+ve) or down (-ve) by 'up' ranks,
+// and right (+ve) or left (-ve) by 'right' files, or xx if that would leave the board
+constexpr MoveIndexTable makeMoveIndexTable(int up, int right)
+{
+	MoveIndexTable t{};
+	for (int sq = 0; sq < 64; sq++) {
+		const int rank = sq / 8 + up;
+		const int file = sq % 8 - right; // (file 0 is the h-file)
+		t[sq] = (rank >= 0 && rank < 8 && file >= 0 && file < 8) ? (rank * 8 + file) : xx;
+	}
+	return t;
+}
 
-constexpr Bitboard MoveDownLeft[64] = {
-	000000000000000000, 000000000000000000, 000000000000000000, 000000000000000000, 0000000000000000, 000000000000000000, 000000000000000000, 000000000000000000,
-	0x0000000000000002, 0x0000000000000004, 0x0000000000000008, 0x0000000000000010, 0x00000000000020, 0x0000000000000040, 0x0000000000000080, 000000000000000000,
-	0x0000000000000200, 0x0000000000000400, 0x0000000000000800, 0x0000000000001000, 0x00000000002000, 0x0000000000004000, 0x0000000000008000, 000000000000000000,
-	0x0000000000020000, 0x0000000000040000, 0x0000000000080000, 0x0000000000100000, 0x00000000200000, 0x0000000000400000, 0x0000000000800000, 000000000000000000,
-	0x0000000002000000, 0x0000000004000000, 0x0000000008000000, 0x0000000010000000, 0x00000020000000, 0x0000000040000000, 0x0000000080000000, 000000000000000000,
-	0x0000000200000000, 0x0000000400000000, 0x0000000800000000, 0x0000001000000000, 0x00002000000000, 0x0000004000000000, 0x0000008000000000, 000000000000000000,
-	0x0000020000000000, 0x0000040000000000, 0x0000080000000000, 0x0000100000000000, 0x00200000000000, 0x0000400000000000, 0x0000800000000000, 000000000000000000,
-	0x0002000000000000, 0x0004000000000000, 0x0008000000000000, 0x0010000000000000, 0x20000000000000, 0x0040000000000000, 0x0080000000000000, 000000000000000000
-};
+// makeMoveBitboardTable() : Bitboard version of a square-index table (0 for "no square")
+constexpr MoveBitboardTable makeMoveBitboardTable(const MoveIndexTable& idx)
+{
+	MoveBitboardTable t{};
+	for (int sq = 0; sq < 64; sq++) {
+		t[sq] = (idx[sq] == xx) ? 0ull : (1ull << idx[sq]);
+	}
+	return t;
+}
 
-constexpr Bitboard MoveLeft[64] = {
-	0x0000000000000002, 0x0000000000000004, 0x0000000000000008, 0x0000000000000010, 0x00000000000020, 0x0000000000000040, 0x0000000000000080, 000000000000000000,
-	0x0000000000000200, 0x0000000000000400, 0x0000000000000800, 0x0000000000001000, 0x00000000002000, 0x0000000000004000, 0x0000000000008000, 000000000000000000,
-	0x0000000000020000, 0x0000000000040000, 0x0000000000080000, 0x0000000000100000, 0x00000000200000, 0x0000000000400000, 0x0000000000800000, 000000000000000000,
-	0x0000000002000000, 0x0000000004000000, 0x0000000008000000, 0x0000000010000000, 0x00000020000000, 0x0000000040000000, 0x0000000080000000, 000000000000000000,
-	0x0000000200000000, 0x0000000400000000, 0x0000000800000000, 0x0000001000000000, 0x00002000000000, 0x0000004000000000, 0x0000008000000000, 000000000000000000,
-	0x0000020000000000, 0x0000040000000000, 0x0000080000000000, 0x0000100000000000, 0x00200000000000, 0x0000400000000000, 0x0000800000000000, 000000000000000000,
-	0x0002000000000000, 0x0004000000000000, 0x0008000000000000, 0x0010000000000000, 0x20000000000000, 0x0040000000000000, 0x0080000000000000, 000000000000000000,
-	0x0200000000000000, 0x0400000000000000, 0x0800000000000000, 0x1000000000000000, 0x2000000000000000, 0x4000000000000000, 0x8000000000000000, 000000000000000000
-};
+// Pre-Calculated Move tables: Square-Index
 
-constexpr Bitboard MoveUpLeft[64] = {
-	0x0000000000000200, 0x0000000000000400, 0x0000000000000800, 0x0000000000001000, 0x00000000002000, 0x0000000000004000, 0x0000000000008000, 000000000000000000,
-	0x0000000000020000, 0x0000000000040000, 0x0000000000080000, 0x0000000000100000, 0x00000000200000, 0x0000000000400000, 0x0000000000800000, 000000000000000000,
-	0x0000000002000000, 0x0000000004000000, 0x0000000008000000, 0x0000000010000000, 0x00000020000000, 0x0000000040000000, 0x0000000080000000, 000000000000000000,
-	0x0000000200000000, 0x0000000400000000, 0x0000000800000000, 0x0000001000000000, 0x00002000000000, 0x0000004000000000, 0x0000008000000000, 000000000000000000,
-	0x0000020000000000, 0x0000040000000000, 0x0000080000000000, 0x0000100000000000, 0x00200000000000, 0x0000400000000000, 0x0000800000000000, 000000000000000000,
-	0x0002000000000000, 0x0004000000000000, 0x0008000000000000, 0x0010000000000000, 0x20000000000000, 0x0040000000000000, 0x0080000000000000, 000000000000000000,
-	0x0200000000000000, 0x0400000000000000, 0x0800000000000000, 0x1000000000000000, 0x2000000000000000, 0x4000000000000000, 0x8000000000000000, 000000000000000000,
-	000000000000000000, 000000000000000000, 000000000000000000, 000000000000000000, 0000000000000000, 000000000000000000, 000000000000000000, 000000000000000000
-};
+alignas(64) inline constexpr MoveIndexTable MoveUpIndex = makeMoveIndexTable(1, 0);
+alignas(64) inline constexpr MoveIndexTable MoveUpRightIndex = makeMoveIndexTable(1, 1);
+alignas(64) inline constexpr MoveIndexTable MoveRightIndex = makeMoveIndexTable(0, 1);
+alignas(64) inline constexpr MoveIndexTable MoveDownRightIndex = makeMoveIndexTable(-1, 1);
+alignas(64) inline constexpr MoveIndexTable MoveDownIndex = makeMoveIndexTable(-1, 0);
+alignas(64) inline constexpr MoveIndexTable MoveDownLeftIndex = makeMoveIndexTable(-1, -1);
+alignas(64) inline constexpr MoveIndexTable MoveLeftIndex = makeMoveIndexTable(0, -1);
+alignas(64) inline constexpr MoveIndexTable MoveUpLeftIndex = makeMoveIndexTable(1, -1);
 
 /*
-representations of Knight moves as Bitboards.
-They go in a clockwise direction, starting with 2xup, 1xright
+Knight moves go in a clockwise direction, starting with 2xup, 1xright
 eg, if starting square was e4, relative N moves are:
 
 . . . . . . . .
@@ -544,315 +552,193 @@ eg 1|2|4|5|7|8|10|11 O-clock ... )
 
 */
 
-constexpr Bitboard MoveKnight1[64] = {
-	000000000000000000, 0x0000000000010000, 0x0000000000020000, 0x0000000000040000, 0x00000000080000, 0x0000000000100000, 0x0000000000200000, 0x0000000000400000,
-	000000000000000000, 0x0000000001000000, 0x0000000002000000, 0x0000000004000000, 0x00000008000000, 0x0000000010000000, 0x0000000020000000, 0x0000000040000000,
-	000000000000000000, 0x0000000100000000, 0x0000000200000000, 0x0000000400000000, 0x00000800000000, 0x0000001000000000, 0x0000002000000000, 0x0000004000000000,
-	000000000000000000, 0x0000010000000000, 0x0000020000000000, 0x0000040000000000, 0x00080000000000, 0x0000100000000000, 0x0000200000000000, 0x0000400000000000,
-	000000000000000000, 0x0001000000000000, 0x0002000000000000, 0x0004000000000000, 0x08000000000000, 0x0010000000000000, 0x0020000000000000, 0x0040000000000000,
-	000000000000000000, 0x0100000000000000, 0x0200000000000000, 0x0400000000000000, 0x800000000000000, 0x1000000000000000, 0x2000000000000000, 0x4000000000000000,
-	000000000000000000, 000000000000000000, 000000000000000000, 000000000000000000, 0000000000000000, 000000000000000000, 000000000000000000, 000000000000000000,
-	000000000000000000, 000000000000000000, 000000000000000000, 000000000000000000, 0000000000000000, 000000000000000000, 000000000000000000, 000000000000000000
-};
-
-constexpr Bitboard MoveKnight2[64] = {
-	000000000000000000, 000000000000000000, 0x0000000000000100, 0x0000000000000200, 0x00000000000400, 0x0000000000000800, 0x0000000000001000, 0x0000000000002000,
-	000000000000000000, 000000000000000000, 0x0000000000010000, 0x0000000000020000, 0x00000000040000, 0x0000000000080000, 0x0000000000100000, 0x0000000000200000,
-	000000000000000000, 000000000000000000, 0x0000000001000000, 0x0000000002000000, 0x00000004000000, 0x0000000008000000, 0x0000000010000000, 0x0000000020000000,
-	000000000000000000, 000000000000000000, 0x0000000100000000, 0x0000000200000000, 0x00000400000000, 0x0000000800000000, 0x0000001000000000, 0x0000002000000000,
-	000000000000000000, 000000000000000000, 0x0000010000000000, 0x0000020000000000, 0x00040000000000, 0x0000080000000000, 0x0000100000000000, 0x0000200000000000,
-	000000000000000000, 000000000000000000, 0x0001000000000000, 0x0002000000000000, 0x04000000000000, 0x0008000000000000, 0x0010000000000000, 0x0020000000000000,
-	000000000000000000, 000000000000000000, 0x0100000000000000, 0x0200000000000000, 0x400000000000000, 0x0800000000000000, 0x1000000000000000, 0x2000000000000000,
-	000000000000000000, 000000000000000000, 000000000000000000, 000000000000000000, 0000000000000000, 000000000000000000, 000000000000000000, 000000000000000000
-};
-
-constexpr Bitboard MoveKnight3[64] = {
-	000000000000000000, 000000000000000000, 000000000000000000, 000000000000000000, 0000000000000000, 000000000000000000, 000000000000000000, 000000000000000000,
-	000000000000000000, 000000000000000000, 0x0000000000000001, 0x0000000000000002, 0x00000000000004, 0x0000000000000008, 0x0000000000000010, 0x0000000000000020,
-	000000000000000000, 000000000000000000, 0x0000000000000100, 0x0000000000000200, 0x00000000000400, 0x0000000000000800, 0x0000000000001000, 0x0000000000002000,
-	000000000000000000, 000000000000000000, 0x0000000000010000, 0x0000000000020000, 0x00000000040000, 0x0000000000080000, 0x0000000000100000, 0x0000000000200000,
-	000000000000000000, 000000000000000000, 0x0000000001000000, 0x0000000002000000, 0x00000004000000, 0x0000000008000000, 0x0000000010000000, 0x0000000020000000,
-	000000000000000000, 000000000000000000, 0x0000000100000000, 0x0000000200000000, 0x00000400000000, 0x0000000800000000, 0x0000001000000000, 0x0000002000000000,
-	000000000000000000, 000000000000000000, 0x0000010000000000, 0x0000020000000000, 0x00040000000000, 0x0000080000000000, 0x0000100000000000, 0x0000200000000000,
-	000000000000000000, 000000000000000000, 0x0001000000000000, 0x0002000000000000, 0x04000000000000, 0x0008000000000000, 0x0010000000000000, 0x0020000000000000
-};
-
-constexpr Bitboard MoveKnight4[64] = {
-	000000000000000000, 000000000000000000, 000000000000000000, 000000000000000000, 0000000000000000, 000000000000000000, 000000000000000000, 000000000000000000,
-	000000000000000000, 000000000000000000, 000000000000000000, 000000000000000000, 0000000000000000, 000000000000000000, 000000000000000000, 000000000000000000,
-	000000000000000000, 0x0000000000000001, 0x0000000000000002, 0x0000000000000004, 0x00000000000008, 0x0000000000000010, 0x0000000000000020, 0x0000000000000040,
-	000000000000000000, 0x0000000000000100, 0x0000000000000200, 0x0000000000000400, 0x00000000000800, 0x0000000000001000, 0x0000000000002000, 0x0000000000004000,
-	000000000000000000, 0x0000000000010000, 0x0000000000020000, 0x0000000000040000, 0x00000000080000, 0x0000000000100000, 0x0000000000200000, 0x0000000000400000,
-	000000000000000000, 0x0000000001000000, 0x0000000002000000, 0x0000000004000000, 0x00000008000000, 0x0000000010000000, 0x0000000020000000, 0x0000000040000000,
-	000000000000000000, 0x0000000100000000, 0x0000000200000000, 0x0000000400000000, 0x00000800000000, 0x0000001000000000, 0x0000002000000000, 0x0000004000000000,
-	000000000000000000, 0x0000010000000000, 0x0000020000000000, 0x0000040000000000, 0x00080000000000, 0x0000100000000000, 0x0000200000000000, 0x0000400000000000
-};
-
-constexpr Bitboard MoveKnight5[64] = {
-	000000000000000000, 000000000000000000, 000000000000000000, 000000000000000000, 0000000000000000, 000000000000000000, 000000000000000000, 000000000000000000,
-	000000000000000000, 000000000000000000, 000000000000000000, 000000000000000000, 0000000000000000, 000000000000000000, 000000000000000000, 000000000000000000,
-	0x0000000000000002, 0x0000000000000004, 0x0000000000000008, 0x0000000000000010, 0x00000000000020, 0x0000000000000040, 0x0000000000000080, 000000000000000000,
-	0x0000000000000200, 0x0000000000000400, 0x0000000000000800, 0x0000000000001000, 0x00000000002000, 0x0000000000004000, 0x0000000000008000, 000000000000000000,
-	0x0000000000020000, 0x0000000000040000, 0x0000000000080000, 0x0000000000100000, 0x00000000200000, 0x0000000000400000, 0x0000000000800000, 000000000000000000,
-	0x0000000002000000, 0x0000000004000000, 0x0000000008000000, 0x0000000010000000, 0x00000020000000, 0x0000000040000000, 0x0000000080000000, 000000000000000000,
-	0x0000000200000000, 0x0000000400000000, 0x0000000800000000, 0x0000001000000000, 0x00002000000000, 0x0000004000000000, 0x0000008000000000, 000000000000000000,
-	0x0000020000000000, 0x0000040000000000, 0x0000080000000000, 0x0000100000000000, 0x00200000000000, 0x0000400000000000, 0x0000800000000000, 000000000000000000
-};
-
-constexpr Bitboard MoveKnight6[64] = {
-	000000000000000000, 000000000000000000, 000000000000000000, 000000000000000000, 0000000000000000, 000000000000000000, 000000000000000000, 000000000000000000,
-	0x0000000000000004, 0x0000000000000008, 0x0000000000000010, 0x0000000000000020, 0x00000000000040, 0x0000000000000080, 000000000000000000, 000000000000000000,
-	0x0000000000000400, 0x0000000000000800, 0x0000000000001000, 0x0000000000002000, 0x00000000004000, 0x0000000000008000, 000000000000000000, 000000000000000000,
-	0x0000000000040000, 0x0000000000080000, 0x0000000000100000, 0x0000000000200000, 0x00000000400000, 0x0000000000800000, 000000000000000000, 000000000000000000,
-	0x0000000004000000, 0x0000000008000000, 0x0000000010000000, 0x0000000020000000, 0x00000040000000, 0x0000000080000000, 000000000000000000, 000000000000000000,
-	0x0000000400000000, 0x0000000800000000, 0x0000001000000000, 0x0000002000000000, 0x00004000000000, 0x0000008000000000, 000000000000000000, 000000000000000000,
-	0x0000040000000000, 0x0000080000000000, 0x0000100000000000, 0x0000200000000000, 0x00400000000000, 0x0000800000000000, 000000000000000000, 000000000000000000,
-	0x0004000000000000, 0x0008000000000000, 0x0010000000000000, 0x0020000000000000, 0x40000000000000, 0x0080000000000000, 000000000000000000, 000000000000000000
-};
-
-constexpr Bitboard MoveKnight7[64] = {
-	0x0000000000000400, 0x0000000000000800, 0x0000000000001000, 0x0000000000002000, 0x00000000004000, 0x0000000000008000, 000000000000000000, 000000000000000000,
-	0x0000000000040000, 0x0000000000080000, 0x0000000000100000, 0x0000000000200000, 0x00000000400000, 0x0000000000800000, 000000000000000000, 000000000000000000,
-	0x0000000004000000, 0x0000000008000000, 0x0000000010000000, 0x0000000020000000, 0x00000040000000, 0x0000000080000000, 000000000000000000, 000000000000000000,
-	0x0000000400000000, 0x0000000800000000, 0x0000001000000000, 0x0000002000000000, 0x00004000000000, 0x0000008000000000, 000000000000000000, 000000000000000000,
-	0x0000040000000000, 0x0000080000000000, 0x0000100000000000, 0x0000200000000000, 0x00400000000000, 0x0000800000000000, 000000000000000000, 000000000000000000,
-	0x0004000000000000, 0x0008000000000000, 0x0010000000000000, 0x0020000000000000, 0x40000000000000, 0x0080000000000000, 000000000000000000, 000000000000000000,
-	0x0400000000000000, 0x0800000000000000, 0x1000000000000000, 0x2000000000000000, 0x4000000000000000, 0x8000000000000000, 000000000000000000, 000000000000000000,
-	000000000000000000, 000000000000000000, 000000000000000000, 000000000000000000, 0000000000000000, 000000000000000000, 000000000000000000, 000000000000000000
-};
-
-constexpr Bitboard MoveKnight8[64] = {
-	0x0000000000020000, 0x0000000000040000, 0x0000000000080000, 0x0000000000100000, 0x00000000200000, 0x0000000000400000, 0x0000000000800000, 000000000000000000,
-	0x0000000002000000, 0x0000000004000000, 0x0000000008000000, 0x0000000010000000, 0x00000020000000, 0x0000000040000000, 0x0000000080000000, 000000000000000000,
-	0x0000000200000000, 0x0000000400000000, 0x0000000800000000, 0x0000001000000000, 0x00002000000000, 0x0000004000000000, 0x0000008000000000, 000000000000000000,
-	0x0000020000000000, 0x0000040000000000, 0x0000080000000000, 0x0000100000000000, 0x00200000000000, 0x0000400000000000, 0x0000800000000000, 000000000000000000,
-	0x0002000000000000, 0x0004000000000000, 0x0008000000000000, 0x0010000000000000, 0x20000000000000, 0x0040000000000000, 0x0080000000000000, 000000000000000000,
-	0x0200000000000000, 0x0400000000000000, 0x0800000000000000, 0x1000000000000000, 0x2000000000000000, 0x4000000000000000, 0x8000000000000000, 000000000000000000,
-	000000000000000000, 000000000000000000, 000000000000000000, 000000000000000000, 0000000000000000, 000000000000000000, 000000000000000000, 000000000000000000,
-	000000000000000000, 000000000000000000, 000000000000000000, 000000000000000000, 0000000000000000, 000000000000000000, 000000000000000000, 000000000000000000
-};
-
-// Pre-Calculated Move tables: Square-Index (the logarithm of the bitboard versions)
-
-constexpr int MoveUpIndex[64] = {
-	8, 9, 10, 11, 12, 13, 14, 15,
-	16, 17, 18, 19, 20, 21, 22, 23,
-	24, 25, 26, 27, 28, 29, 30, 31,
-	32, 33, 34, 35, 36, 37, 38, 39,
-	40, 41, 42, 43, 44, 45, 46, 47,
-	48, 49, 50, 51, 52, 53, 54, 55,
-	56, 57, 58, 59, 60, 61, 62, 63,
-	xx, xx, xx, xx, xx, xx, xx, xx
-};
+alignas(64) inline constexpr MoveIndexTable MoveKnight1Index = makeMoveIndexTable(2, 1);
+alignas(64) inline constexpr MoveIndexTable MoveKnight2Index = makeMoveIndexTable(1, 2);
+alignas(64) inline constexpr MoveIndexTable MoveKnight3Index = makeMoveIndexTable(-1, 2);
+alignas(64) inline constexpr MoveIndexTable MoveKnight4Index = makeMoveIndexTable(-2, 1);
+alignas(64) inline constexpr MoveIndexTable MoveKnight5Index = makeMoveIndexTable(-2, -1);
+alignas(64) inline constexpr MoveIndexTable MoveKnight6Index = makeMoveIndexTable(-1, -2);
+alignas(64) inline constexpr MoveIndexTable MoveKnight7Index = makeMoveIndexTable(1, -2);
+alignas(64) inline constexpr MoveIndexTable MoveKnight8Index = makeMoveIndexTable(2, -1);
 
-constexpr int MoveUpRightIndex[64] = {
-	xx, 8, 9, 10, 11, 12, 13, 14,
-	xx, 16, 17, 18, 19, 20, 21, 22,
-	xx, 24, 25, 26, 27, 28, 29, 30,
-	xx, 32, 33, 34, 35, 36, 37, 38,
-	xx, 40, 41, 42, 43, 44, 45, 46,
-	xx, 48, 49, 50, 51, 52, 53, 54,
-	xx, 56, 57, 58, 59, 60, 61, 62,
-	xx, xx, xx, xx, xx, xx, xx, xx
-};
-
-constexpr int MoveRightIndex[64] = {
-	xx, 0, 1, 2, 3, 4, 5, 6,
-	xx, 8, 9, 10, 11, 12, 13, 14,
-	xx, 16, 17, 18, 19, 20, 21, 22,
-	xx, 24, 25, 26, 27, 28, 29, 30,
-	xx, 32, 33, 34, 35, 36, 37, 38,
-	xx, 40, 41, 42, 43, 44, 45, 46,
-	xx, 48, 49, 50, 51, 52, 53, 54,
-	xx, 56, 57, 58, 59, 60, 61, 62
-};
-
-constexpr int MoveDownRightIndex[64] = {
-	xx, xx, xx, xx, xx, xx, xx, xx,
-	xx, 0, 1, 2, 3, 4, 5, 6,
-	xx, 8, 9, 10, 11, 12, 13, 14,
-	xx, 16, 17, 18, 19, 20, 21, 22,
-	xx, 24, 25, 26, 27, 28, 29, 30,
-	xx, 32, 33, 34, 35, 36, 37, 38,
-	xx, 40, 41, 42, 43, 44, 45, 46,
-	xx, 48, 49, 50, 51, 52, 53, 54
-};
-
-constexpr int MoveDownIndex[64] = {
-	xx, xx, xx, xx, xx, xx, xx, xx,
-	0, 1, 2, 3, 4, 5, 6, 7,
-	8, 9, 10, 11, 12, 13, 14, 15,
-	16, 17, 18, 19, 20, 21, 22, 23,
-	24, 25, 26, 27, 28, 29, 30, 31,
-	32, 33, 34, 35, 36, 37, 38, 39,
-	40, 41, 42, 43, 44, 45, 46, 47,
-	48, 49, 50, 51, 52, 53, 54, 55
-};
-
-constexpr int MoveDownLeftIndex[64] = {
-	xx, xx, xx, xx, xx, xx, xx, xx,
-	1, 2, 3, 4, 5, 6, 7, xx,
-	9, 10, 11, 12, 13, 14, 15, xx,
-	17, 18, 19, 20, 21, 22, 23, xx,
-	25, 26, 27, 28, 29, 30, 31, xx,
-	33, 34, 35, 36, 37, 38, 39, xx,
-	41, 42, 43, 44, 45, 46, 47, xx,
-	49, 50, 51, 52, 53, 54, 55, xx
-};
-
-constexpr int MoveLeftIndex[64] = {
-	1, 2, 3, 4, 5, 6, 7, xx,
-	9, 10, 11, 12, 13, 14, 15, xx,
-	17, 18, 19, 20, 21, 22, 23, xx,
-	25, 26, 27, 28, 29, 30, 31, xx,
-	33, 34, 35, 36, 37, 38, 39, xx,
-	41, 42, 43, 44, 45, 46, 47, xx,
-	49, 50, 51, 52, 53, 54, 55, xx,
-	57, 58, 59, 60, 61, 62, 63, xx
-};
-
-constexpr int MoveUpLeftIndex[64] = {
-	9, 10, 11, 12, 13, 14, 15, xx,
-	17, 18, 19, 20, 21, 22, 23, xx,
-	25, 26, 27, 28, 29, 30, 31, xx,
-	33, 34, 35, 36, 37, 38, 39, xx,
-	41, 42, 43, 44, 45, 46, 47, xx,
-	49, 50, 51, 52, 53, 54, 55, xx,
-	57, 58, 59, 60, 61, 62, 63, xx,
-	xx, xx, xx, xx, xx, xx, xx, xx
-};
+// Pre-calculated move tables: BitBoards
 
-constexpr int MoveKnight1Index[64] = {
-	xx, 16, 17, 18, 19, 20, 21, 22,
-	xx, 24, 25, 26, 27, 28, 29, 30,
-	xx, 32, 33, 34, 35, 36, 37, 38,
-	xx, 40, 41, 42, 43, 44, 45, 46,
-	xx, 48, 49, 50, 51, 52, 53, 54,
-	xx, 56, 57, 58, 59, 60, 61, 62,
-	xx, xx, xx, xx, xx, xx, xx, xx,
-	xx, xx, xx, xx, xx, xx, xx, xx
-};
+alignas(64) inline constexpr MoveBitboardTable MoveUp = makeMoveBitboardTable(MoveUpIndex);
+alignas(64) inline constexpr MoveBitboardTable MoveUpRight = makeMoveBitboardTable(MoveUpRightIndex);
+alignas(64) inline constexpr MoveBitboardTable MoveRight = makeMoveBitboardTable(MoveRightIndex);
+alignas(64) inline constexpr MoveBitboardTable MoveDownRight = makeMoveBitboardTable(MoveDownRightIndex);
+alignas(64) inline constexpr MoveBitboardTable MoveDown = makeMoveBitboardTable(MoveDownIndex);
+alignas(64) inline constexpr MoveBitboardTable MoveDownLeft = makeMoveBitboardTable(MoveDownLeftIndex);
+alignas(64) inline constexpr MoveBitboardTable MoveLeft = makeMoveBitboardTable(MoveLeftIndex);
+alignas(64) inline constexpr MoveBitboardTable MoveUpLeft = makeMoveBitboardTable(MoveUpLeftIndex);
+
+alignas(64) inline constexpr MoveBitboardTable MoveKnight1 = makeMoveBitboardTable(MoveKnight1Index);
+alignas(64) inline constexpr MoveBitboardTable MoveKnight2 = makeMoveBitboardTable(MoveKnight2Index);
+alignas(64) inline constexpr MoveBitboardTable MoveKnight3 = makeMoveBitboardTable(MoveKnight3Index);
+alignas(64) inline constexpr MoveBitboardTable MoveKnight4 = makeMoveBitboardTable(MoveKnight4Index);
+alignas(64) inline constexpr MoveBitboardTable MoveKnight5 = makeMoveBitboardTable(MoveKnight5Index);
+alignas(64) inline constexpr MoveBitboardTable MoveKnight6 = makeMoveBitboardTable(MoveKnight6Index);
+alignas(64) inline constexpr MoveBitboardTable MoveKnight7 = makeMoveBitboardTable(MoveKnight7Index);
+alignas(64) inline constexpr MoveBitboardTable MoveKnight8 = makeMoveBitboardTable(MoveKnight8Index);
+
+// Move table: contains potential moves (except castling) for every piece on every square
+// piece(16) x origin-square(64) x dest-square(32) = 32k ... (max dest squares = 27 for queen, but using 32 for alignment)
+// Unused entries are 0xff (ie > a8), which terminates the list of destinations for a given piece/square
+
+using MoveTable = std::array<std::array<std::array<squareindex_t, 32>, 64>, 16>;
+
+// makeMoveTable() : generates the move table. Destinations are in ascending order of square index,
+// except for pawns, which have their captures first, followed by their advances
+constexpr MoveTable makeMoveTable()
+{
+	constexpr std::array<const MoveIndexTable*, 8> kingSteps {
+		&MoveUpIndex, &MoveUpRightIndex, &MoveRightIndex, &MoveDownRightIndex,
+		&MoveDownIndex, &MoveDownLeftIndex, &MoveLeftIndex, &MoveUpLeftIndex
+	};
 
-constexpr int MoveKnight2Index[64] = {
-	xx, xx, 8, 9, 10, 11, 12, 13,
-	xx, xx, 16, 17, 18, 19, 20, 21,
-	xx, xx, 24, 25, 26, 27, 28, 29,
-	xx, xx, 32, 33, 34, 35, 36, 37,
-	xx, xx, 40, 41, 42, 43, 44, 45,
-	xx, xx, 48, 49, 50, 51, 52, 53,
-	xx, xx, 56, 57, 58, 59, 60, 61,
-	xx, xx, xx, xx, xx, xx, xx, xx
-};
+	constexpr std::array<const MoveIndexTable*, 8> knightSteps {
+		&MoveKnight1Index, &MoveKnight2Index, &MoveKnight3Index, &MoveKnight4Index,
+		&MoveKnight5Index, &MoveKnight6Index, &MoveKnight7Index, &MoveKnight8Index
+	};
 
-constexpr int MoveKnight3Index[64] = {
-	xx, xx, xx, xx, xx, xx, xx, xx,
-	xx, xx, 0, 1, 2, 3, 4, 5,
-	xx, xx, 8, 9, 10, 11, 12, 13,
-	xx, xx, 16, 17, 18, 19, 20, 21,
-	xx, xx, 24, 25, 26, 27, 28, 29,
-	xx, xx, 32, 33, 34, 35, 36, 37,
-	xx, xx, 40, 41, 42, 43, 44, 45,
-	xx, xx, 48, 49, 50, 51, 52, 53
-};
+	MoveTable t{};
+	for (auto& piece : t) {
+		for (auto& origin : piece) {
+			for (auto& dest : origin) {
+				dest = static_cast<squareindex_t>(xx);
+			}
+		}
+	}
 
-constexpr int MoveKnight4Index[64] = {
-	xx, xx, xx, xx, xx, xx, xx, xx,
-	xx, xx, xx, xx, xx, xx, xx, xx,
-	xx, 0, 1, 2, 3, 4, 5, 6,
-	xx, 8, 9, 10, 11, 12, 13, 14,
-	xx, 16, 17, 18, 19, 20, 21, 22,
-	xx, 24, 25, 26, 27, 28, 29, 30,
-	xx, 32, 33, 34, 35, 36, 37, 38,
-	xx, 40, 41, 42, 43, 44, 45, 46
-};
+	for (int p = 0; p < 16; p++) {
+		for (int sq = 0; sq < 64; sq++) {
+			int m = 0;
+			Bitboard dests = 0;
+
+			switch(p) {
+			case WPAWN:
+			case BPAWN:
+			{
+				const bool black = (p == BPAWN);
+				const MoveIndexTable& captLeft = black ? MoveDownLeftIndex : MoveUpLeftIndex;
+				const MoveIndexTable& captRight = black ? MoveDownRightIndex : MoveUpRightIndex;
+				const MoveIndexTable& advance = black ? MoveDownIndex : MoveUpIndex;
+				const int homeRank = black ? 6 : 1; // double pawn advance only available from rank 2 (white) or 7 (black)
+
+				// captures
+				if (captLeft[sq] != xx) {
+					t[p][sq][m++] = static_cast<squareindex_t>(captLeft[sq]);
+				}
+
+				if (captRight[sq] != xx) {
+					t[p][sq][m++] = static_cast<squareindex_t>(captRight[sq]);
+				}
+
+				// advances
+				if (const int step1 = advance[sq]; step1 != xx) {
+					t[p][sq][m++] = static_cast<squareindex_t>(step1);
+					if (sq / 8 == homeRank && advance[step1] != xx) {
+						t[p][sq][m++] = static_cast<squareindex_t>(advance[step1]);
+					}
+				}
+			}
+				continue;
+
+			case WBISHOP:
+			case BBISHOP:
+			case WROOK:
+			case BROOK:
+			case WQUEEN:
+			case BQUEEN:
+			{
+				const bool diagonal = (p & 2);
+				const bool straight = (p & 4);
+				for (int d = 0; d < 8; d++) {
+					if ((d & 1) ? diagonal : straight) { // (odd-numbered steps are diagonal)
+						for (int s = (*kingSteps[d])[sq]; s != xx; s = (*kingSteps[d])[s]) {
+							dests |= 1ull << s;
+						}
+					}
+				}
+			}
+				break;
+
+			case WKNIGHT:
+			case BKNIGHT:
+				for (const MoveIndexTable* step : knightSteps) {
+					if ((*step)[sq] != xx) {
+						dests |= 1ull << (*step)[sq];
+					}
+				}
+				break;
+
+			case WKING:
+			case BKING:
+				for (const MoveIndexTable* step : kingSteps) {
+					if ((*step)[sq] != xx) {
+						dests |= 1ull << (*step)[sq];
+					}
+				}
+				break;
+
+			default:
+				continue;
+			}
 
-constexpr int MoveKnight5Index[64] = {
-	xx, xx, xx, xx, xx, xx, xx, xx,
-	xx, xx, xx, xx, xx, xx, xx, xx,
-	1, 2, 3, 4, 5, 6, 7, xx,
-	9, 10, 11, 12, 13, 14, 15, xx,
-	17, 18, 19, 20, 21, 22, 23, xx,
-	25, 26, 27, 28, 29, 30, 31, xx,
-	33, 34, 35, 36, 37, 38, 39, xx,
-	41, 42, 43, 44, 45, 46, 47, xx
-};
+			for (int dsq = 0; dsq < 64; dsq++) {
+				if ((1ull << dsq) & dests) {
+					t[p][sq][m++] = static_cast<squareindex_t>(dsq);
+				}
+			}
+		}
+	}
 
-constexpr int MoveKnight6Index[64] = {
-	xx, xx, xx, xx, xx, xx, xx, xx,
-	2, 3, 4, 5, 6, 7, xx, xx,
-	10, 11, 12, 13, 14, 15, xx, xx,
-	18, 19, 20, 21, 22, 23, xx, xx,
-	26, 27, 28, 29, 30, 31, xx, xx,
-	34, 35, 36, 37, 38, 39, xx, xx,
-	42, 43, 44, 45, 46, 47, xx, xx,
-	50, 51, 52, 53, 54, 55, xx, xx
-};
+	return t;
+}
 
-constexpr int MoveKnight7Index[64] = {
-	10, 11, 12, 13, 14, 15, xx, xx,
-	18, 19, 20, 21, 22, 23, xx, xx,
-	26, 27, 28, 29, 30, 31, xx, xx,
-	34, 35, 36, 37, 38, 39, xx, xx,
-	42, 43, 44, 45, 46, 47, xx, xx,
-	50, 51, 52, 53, 54, 55, xx, xx,
-	58, 59, 60, 61, 62, 63, xx, xx,
-	xx, xx, xx, xx, xx, xx, xx, xx
-};
+alignas(64) inline constexpr MoveTable mvtable = makeMoveTable();
 
-constexpr int MoveKnight8Index[64] = {
-	17, 18, 19, 20, 21, 22, 23, xx,
-	25, 26, 27, 28, 29, 30, 31, xx,
-	33, 34, 35, 36, 37, 38, 39, xx,
-	41, 42, 43, 44, 45, 46, 47, xx,
-	49, 50, 51, 52, 53, 54, 55, xx,
-	57, 58, 59, 60, 61, 62, 63, xx,
-	xx, xx, xx, xx, xx, xx, xx, xx,
-	xx, xx, xx, xx, xx, xx, xx, xx
-};
+// compile-time checks that the lookup tables are in agreement
 
-// unit test to verify that the lookup tables are in agreement
-inline bool testMoveTables()
+constexpr bool moveTablesAgree()
 {
-	auto t = [](std::string name, int q, Bitboard bitboard, int sqindex) -> void {
-		const bool ok = ((bitboard == 0 && sqindex == xx) || (bitboard == (1ull << sqindex)));
-		if (!ok) {
-			std::stringstream e;
-			e << __func__ << "(): name=" << name << " failed at index " << q << ": " << "index=" << sqindex << " bitboard="<<  std::hex << bitboard;
-			throw std::invalid_argument(e.str());
-		}
-	};
-
-	try {
+	constexpr std::array<std::pair<const MoveBitboardTable*, const MoveIndexTable*>, 16> tables {{
+		{&MoveUp, &MoveUpIndex}, {&MoveUpRight, &MoveUpRightIndex}, {&MoveRight, &MoveRightIndex}, {&MoveDownRight, &MoveDownRightIndex},
+		{&MoveDown, &MoveDownIndex}, {&MoveDownLeft, &MoveDownLeftIndex}, {&MoveLeft, &MoveLeftIndex}, {&MoveUpLeft, &MoveUpLeftIndex},
+		{&MoveKnight1, &MoveKnight1Index}, {&MoveKnight2, &MoveKnight2Index}, {&MoveKnight3, &MoveKnight3Index}, {&MoveKnight4, &MoveKnight4Index},
+		{&MoveKnight5, &MoveKnight5Index}, {&MoveKnight6, &MoveKnight6Index}, {&MoveKnight7, &MoveKnight7Index}, {&MoveKnight8, &MoveKnight8Index}
+	}};
+
+	for (const auto& [bitboards, indexes] : tables) {
 		for (int q = 0; q < 64; q++) {
-			// K
-			t("Up", q, MoveUp[q], MoveUpIndex[q]);
-			t("UpRight", q, MoveUpRight[q], MoveUpRightIndex[q]);
-			t("Right", q, MoveRight[q], MoveRightIndex[q]);
-			t("DownRight", q, MoveDownRight[q], MoveDownRightIndex[q]);
-			t("Down", q, MoveDown[q], MoveDownIndex[q]);
-			t("DownLeft", q, MoveDownLeft[q], MoveDownLeftIndex[q]);
-			t("Left", q, MoveLeft[q], MoveLeftIndex[q]);
-			t("UpLeft", q, MoveUpLeft[q], MoveUpLeftIndex[q]);
-
-			// N
-			t("MoveKnight1", q, MoveKnight1[q], MoveKnight1Index[q]);
-			t("MoveKnight2", q, MoveKnight2[q], MoveKnight2Index[q]);
-			t("MoveKnight3", q, MoveKnight3[q], MoveKnight3Index[q]);
-			t("MoveKnight4", q, MoveKnight4[q], MoveKnight4Index[q]);
-			t("MoveKnight5", q, MoveKnight5[q], MoveKnight5Index[q]);
-			t("MoveKnight6", q, MoveKnight6[q], MoveKnight6Index[q]);
-			t("MoveKnight7", q, MoveKnight7[q], MoveKnight7Index[q]);
-			t("MoveKnight8", q, MoveKnight8[q], MoveKnight8Index[q]);
+			const Bitboard bitboard = (*bitboards)[q];
+			const int sqindex = (*indexes)[q];
+			if (!((bitboard == 0 && sqindex == xx) || (sqindex != xx && bitboard == (1ull << sqindex)))) {
+				return false;
+			}
 		}
-	} catch (const std::invalid_argument& e) {
-		std::cout << e.what() << std::endl;
-		return false;
 	}
-
-	std::cout << __func__ << "() passed" << std::endl;
 	return true;
 }
 
+// countMoveTableEntries() : number of potential destinations for a piece, summed over all origin squares
+constexpr int countMoveTableEntries(int piece)
+{
+	int n = 0;
+	for (int sq = 0; sq < 64; sq++) {
+		for (int m = 0; m < 32 && mvtable[piece][sq][m] <= 63; m++) {
+			n++;
+		}
+	}
+	return n;
+}
+
+static_assert(moveTablesAgree(), "Bitboard and Square-Index move tables disagree");
+static_assert(MoveUp[e2] == E3 && MoveKnight1[e4] == F6 && MoveKnight8[e4] == D6 && MoveUpRightIndex[h2] == xx);
+static_assert(countMoveTableEntries(WKNIGHT) == 336 && countMoveTableEntries(WKING) == 420);
+static_assert(countMoveTableEntries(WBISHOP) == 560 && countMoveTableEntries(WROOK) == 896 && countMoveTableEntries(WQUEEN) == 1456);
+static_assert(mvtable[WPAWN][e2][0] == d3 && mvtable[WPAWN][e2][3] == e4 && mvtable[BPAWN][e7][3] == e5 && mvtable[WPAWN][e3][3] > a8);
+
 
 // Note : Inline Functions to follow
 inline unsigned long getSquareIndex(Bitboard b);
@@ -1283,30 +1169,6 @@ inline void getFirstAndLastPiece(const Bitboard& B, unsigned long& a, unsigned l
 #endif
 }
 
-// utility function to generate the move lookup index tables from the move lookup bitboard tables
-inline bool genIdxTbl(std::string name, const Bitboard *bb)
-{
-	std::cout << "const int " << name << "[64] = {\n";
-	for (int r = 0; r < 64; r+= 8) {
-		std::cout << "\t";
-		for (int f = 0; f < 8; f++) {
-			int q = r | f;
-
-			if (bb[q] == 0) {
-				std::cout << "xx";
-			} else {
-				std::cout << getSquareIndex(bb[q]);
-			}
-			if (q != 63) {
-				std::cout << ", ";
-			}
-		}
-		std::cout << "\n";
-	}
-	std::cout << "};" << std::endl;
-	return true;
-}
-
 } // namespace juddperft
 
 #endif // _MOVEGEN
@@ -0,0 +1,178 @@
+/*
+
+MIT License
+
+Copyright(c) 2016-2025 Judd Niemann
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files(the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#ifndef _MOVESTACK_H
+#define _MOVESTACK_H 1
+
+#include "chessposition.h"
+#include "movegen.h"
+#include "zobristkeyset.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+
+namespace juddperft {
+
+// CompactMove : 16-bit move format for perft hot-paths
+// bits 0-5:	origin square
+// bits 6-11:	destination square
+// bits 12-14:	promotion piece (piece & 7, ie WKNIGHT, WBISHOP, WROOK or WQUEEN), or 0 for no promotion
+// Everything else (piece, colour, captures, castling, e.p. etc) is derived from the position
+// that the move is played from - see expandMove()
+
+using CompactMove = uint16_t;
+
+inline CompactMove compactMove(const ChessMove& m)
+{
+	piece_t promotion = 0;
+	if (get_flag(m, promoteQueen)) {
+		promotion = WQUEEN;
+	} else if (get_flag(m, promoteKnight)) {
+		promotion = WKNIGHT;
+	} else if (get_flag(m, promoteRook)) {
+		promotion = WROOK;
+	} else if (get_flag(m, promoteBishop)) {
+		promotion = WBISHOP;
+	}
+
+	return static_cast<CompactMove>(m.origin | (m.destination << 6) | (promotion << 12));
+}
+
+// expandMove() : recreate the ChessMove (as produced by the move generator) for a CompactMove played
+// from position P. Note: check and checkmate flags are not recreated.
+
+inline ChessMove expandMove(const ChessPosition& P, CompactMove cm)
+{
+	ChessMove m;
+	m.origin = cm & 0x3f;
+	m.destination = (cm >> 6) & 0x3f;
+	m.blackToMove = P.blackToMove;
+	m.piece = P.getPieceAtSquare(m.origin);
+	m.flags = 0;
+
+	const Bitboard TO = 1ull << m.destination;
+	const Bitboard EP = P.A & P.B & ~P.C;
+	const Bitboard enemies = P.blackToMove ? P.getWhiteOccupied() : P.getBlackOccupied();
+	if (TO & enemies & ~EP) {
+		m.flags |= capture;
+	}
+
+	switch (m.piece & 7) {
+	case WPAWN:
+		if (TO & EP) {
+			m.flags |= enPassantCapture;
+		} else if (m.destination - m.origin == 16 || m.origin - m.destination == 16) {
+			m.flags |= doublePawnMove;
+		} else {
+			switch ((cm >> 12) & 7) {
+			case WQUEEN:
+				m.flags |= promoteQueen;
+				break;
+			case WKNIGHT:
+				m.flags |= promoteKnight;
+				break;
+			case WROOK:
+				m.flags |= promoteRook;
+				break;
+			case WBISHOP:
+				m.flags |= promoteBishop;
+				break;
+			default:
+				break;
+			}
+		}
+		break;
+
+	case WKING:
+		if (m.origin - m.destination == 2) {
+			m.flags |= castle; // e1 -> g1 (or e8 -> g8)
+		} else if (m.destination - m.origin == 2) {
+			m.flags |= castleLong; // e1 -> c1 (or e8 -> c8)
+		}
+		break;
+
+	default:
+		break;
+	}
+
+	return m;
+}
+
+// MoveStack : per-thread arena for move lists.
+// The move generator writes into a single (reused) scratch list of ChessMoves;
+// callers which need to keep the moves while recursing push a compacted copy,
+// sized to the real move count, onto the stack, and pop it off again afterwards.
+
+class MoveStack
+{
+public:
+	// enough for maximum-sized move lists at every ply of the deepest search allowed (depths are checked against PERFT_DEPTH_KEYS
+	// before searching; see parseDepth())
+	static constexpr size_t capacity = PERFT_DEPTH_KEYS * MOVELIST_SIZE;
+
+	// forThisThread() : get the calling thread's MoveStack
+	static MoveStack& forThisThread()
+	{
+		thread_local MoveStack moveStack;
+		return moveStack;
+	}
+
+	ChessMove* scratch()
+	{
+		return scratchList;
+	}
+
+	const CompactMove* push(const ChessMove* moveList, size_t n)
+	{
+		if (top + n > capacity) {
+			// (can't happen for a checked depth; stop, rather than scribble over whatever follows the arena)
+			fprintf(stderr, "MoveStack overflow: search is deeper than %d plies\n", PERFT_DEPTH_KEYS);
+			std::abort();
+		}
+		CompactMove* p = moves + top;
+		for (size_t i = 0; i < n; i++) {
+			p[i] = compactMove(moveList[i]);
+		}
+		top += n;
+		return p;
+	}
+
+	void pop(size_t n)
+	{
+		top -= n;
+	}
+
+private:
+	alignas(64) CompactMove moves[capacity];
+	alignas(64) ChessMove scratchList[MOVELIST_SIZE];
+	size_t top{0};
+};
+
+} // namespace juddperft
+
+#endif // _MOVESTACK_H
@@ -43,7 +43,7 @@ public:
 		return std::chrono::duration_cast<std::chrono::milliseconds>(t - beginTimer).count();
 	}
 
-	void setNodes(size_t n)
+	void setNodes(double n)
 	{
 		nodes = n;
 	}
@@ -71,7 +71,7 @@ private:
 		return stream.str();
 	}
 
-	size_t nodes{0};
+	double nodes{0.0};
 };
 
 
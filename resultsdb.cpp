@@ -0,0 +1,366 @@
+/*
+
+MIT License
+
+Copyright(c) 2016-2025 Judd Niemann
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files(the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+
+#include "resultsdb.h"
+#include "utils.h"
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+
+#include <filesystem>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#if !defined(_MSC_VER)
+#include <sys/mman.h>
+#endif
+
+namespace juddperft {
+
+namespace {
+
+struct ResultsDBHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t recordSize;
+};
+
+constexpr char RESULTSDB_MAGIC[8] = "JPRESDB";
+constexpr uint32_t RESULTSDB_VERSION = 1;
+constexpr uint8_t RESULT_HAS_STATS = 1;
+
+// FNV-1a, used both for record checksums and for indexing
+uint64_t fnv1a(const void* data, size_t len, uint64_t h = 0xcbf29ce484222325ull)
+{
+	const uint8_t* p = static_cast<const uint8_t*>(data);
+	for (size_t i = 0; i < len; i++) {
+		h = (h ^ p[i]) * 0x100000001b3ull;
+	}
+	return h;
+}
+
+uint32_t recordChecksum(ResultRecord r)
+{
+	r.checksum = 0;
+	const uint64_t h = fnv1a(&r, sizeof(r));
+	return static_cast<uint32_t>(h ^ (h >> 32));
+}
+
+uint64_t keyHash(const PackedPosition& position, uint8_t depth)
+{
+	return fnv1a(&depth, 1, fnv1a(&position, sizeof(position)));
+}
+
+// the state of the open database. Records 0 .. nMapped - 1 are in the file mapping;
+// records added since the file was opened are kept in appended[] (as well as being written to the file)
+struct Database
+{
+	std::string path;
+	FILE* f{nullptr};
+	const ResultRecord* mapped{nullptr};
+	size_t nMapped{0};
+	size_t mappedBytes{0};
+	std::vector<char> unmapped;	// (holds the existing records, if they can't be memory-mapped)
+	std::vector<ResultRecord> appended;
+	std::unordered_multimap<uint64_t, size_t> index; // key hash -> record number
+	std::mutex mutex;
+
+	const ResultRecord& record(size_t n) const {
+		return (n < nMapped) ? mapped[n] : appended[n - nMapped];
+	}
+
+	// find() : the record number of the current result for (position, depth), or SIZE_MAX if there isn't one
+	size_t find(const PackedPosition& position, uint8_t depth, uint64_t h) const {
+		const auto range = index.equal_range(h);
+		for (auto it = range.first; it != range.second; ++it) {
+			const ResultRecord& r = record(it->second);
+			if (r.depth == depth && r.position == position) {
+				return it->second;
+			}
+		}
+		return SIZE_MAX;
+	}
+
+	// addToIndex() : index record n, replacing any earlier record for the same (position, depth)
+	void addToIndex(size_t n) {
+		const ResultRecord& r = record(n);
+		const uint64_t h = keyHash(r.position, r.depth);
+		const auto range = index.equal_range(h);
+		for (auto it = range.first; it != range.second; ++it) {
+			const ResultRecord& s = record(it->second);
+			if (s.depth == r.depth && s.position == r.position) {
+				it->second = n;
+				return;
+			}
+		}
+		index.emplace(h, n);
+	}
+};
+
+Database db;
+
+void closeDatabase()
+{
+	if (db.f != nullptr) {
+		fclose(db.f);
+		db.f = nullptr;
+	}
+#if !defined(_MSC_VER)
+	if (db.mapped != nullptr && db.unmapped.empty()) {
+		munmap(const_cast<ResultRecord*>(db.mapped), db.mappedBytes);
+	}
+#endif
+	db.mapped = nullptr;
+	db.nMapped = 0;
+	db.mappedBytes = 0;
+	db.unmapped.clear();
+	db.unmapped.shrink_to_fit();
+	db.appended.clear();
+	db.index.clear();
+	db.path.clear();
+}
+
+} // namespace
+
+bool ResultsDB::open(const std::string& path)
+{
+	std::lock_guard<std::mutex> lock(db.mutex);
+	closeDatabase();
+
+	ResultsDBHeader expected;
+	memcpy(expected.magic, RESULTSDB_MAGIC, sizeof(expected.magic));
+	expected.version = RESULTSDB_VERSION;
+	expected.recordSize = sizeof(ResultRecord);
+
+	std::error_code ec;
+	if (!std::filesystem::exists(path, ec)) {
+		FILE* f = fopen(path.c_str(), "wb");
+		if (f == nullptr) {
+			return false;
+		}
+		const bool ok = (fwrite(&expected, sizeof(expected), 1, f) == 1) && Utils::flushToDisk(f);
+		fclose(f);
+		if (!ok) {
+			return false;
+		}
+	}
+
+	FILE* f = fopen(path.c_str(), "rb");
+	if (f == nullptr) {
+		return false;
+	}
+	ResultsDBHeader h;
+	const bool headerOk = (fread(&h, sizeof(h), 1, f) == 1) && (memcmp(&h, &expected, sizeof(h)) == 0);
+	if (!headerOk) {
+		fclose(f);
+		return false;
+	}
+
+	const uint64_t fileSize = std::filesystem::file_size(path, ec);
+	if (ec) {
+		fclose(f);
+		return false;
+	}
+	size_t nRecords = (fileSize - sizeof(ResultsDBHeader)) / sizeof(ResultRecord);
+
+	// map the existing records (the header is small, so the whole file is mapped, and the records start after it)
+	const char* base = nullptr;
+	const size_t bytes = sizeof(ResultsDBHeader) + nRecords * sizeof(ResultRecord);
+	if (nRecords != 0) {
+#if !defined(_MSC_VER)
+		void* p = mmap(nullptr, bytes, PROT_READ, MAP_SHARED, fileno(f), 0);
+		if (p != MAP_FAILED) {
+			base = static_cast<const char*>(p);
+		}
+#endif
+		if (base == nullptr) {
+			db.unmapped.resize(bytes);
+			fseek(f, 0, SEEK_SET);
+			if (fread(db.unmapped.data(), 1, bytes, f) != bytes) {
+				db.unmapped.clear();
+				fclose(f);
+				return false;
+			}
+			base = db.unmapped.data();
+		}
+	}
+	fclose(f);
+
+	db.mapped = reinterpret_cast<const ResultRecord*>(base + sizeof(ResultsDBHeader));
+	db.mappedBytes = bytes;
+
+	// index the records, stopping at the first damaged one (which can only be the result of a torn append)
+	db.index.reserve(nRecords);
+	db.nMapped = nRecords;
+	for (size_t n = 0; n < nRecords; n++) {
+		if (recordChecksum(db.mapped[n]) != db.mapped[n].checksum) {
+			printf("%s: discarding %zu damaged record(s) from the end of the file\n", path.c_str(), nRecords - n);
+			nRecords = n;
+			break;
+		}
+		db.addToIndex(n);
+	}
+	db.nMapped = nRecords;
+
+	// discard anything after the last good record, so that new records are appended in the right place
+	const uint64_t validBytes = sizeof(ResultsDBHeader) + nRecords * sizeof(ResultRecord);
+	if (fileSize != validBytes) {
+		std::filesystem::resize_file(path, validBytes, ec);
+	}
+
+	db.f = fopen(path.c_str(), "ab");
+	if (db.f == nullptr || ec) {
+		closeDatabase();
+		return false;
+	}
+
+	db.path = path;
+	return true;
+}
+
+void ResultsDB::close()
+{
+	std::lock_guard<std::mutex> lock(db.mutex);
+	closeDatabase();
+}
+
+bool ResultsDB::isOpen()
+{
+	std::lock_guard<std::mutex> lock(db.mutex);
+	return db.f != nullptr;
+}
+
+std::string ResultsDB::path()
+{
+	std::lock_guard<std::mutex> lock(db.mutex);
+	return db.path;
+}
+
+size_t ResultsDB::size()
+{
+	std::lock_guard<std::mutex> lock(db.mutex);
+	return db.index.size();
+}
+
+bool ResultsDB::lookup(const ChessPosition& P, int depth, bool statsRequired, PerftInfo& info)
+{
+	std::lock_guard<std::mutex> lock(db.mutex);
+	if (db.f == nullptr || depth < 0 || depth > UINT8_MAX) {
+		return false;
+	}
+
+	const PackedPosition position = packPosition(P);
+	const size_t n = db.find(position, static_cast<uint8_t>(depth), keyHash(position, static_cast<uint8_t>(depth)));
+	if (n == SIZE_MAX) {
+		return false;
+	}
+
+	const ResultRecord& r = db.record(n);
+	if (statsRequired && (r.flags & RESULT_HAS_STATS) == 0) {
+		return false;
+	}
+
+	if (r.flags & RESULT_HAS_STATS) {
+		info = r.info;
+	} else {
+		info = PerftInfo{};
+		info.nMoves = r.info.nMoves;
+	}
+	return true;
+}
+
+void ResultsDB::store(const ChessPosition& P, int depth, bool hasStats, const PerftInfo& info)
+{
+	std::lock_guard<std::mutex> lock(db.mutex);
+	if (db.f == nullptr || depth < 0 || depth > UINT8_MAX) {
+		return;
+	}
+
+	ResultRecord r{};
+	r.position = packPosition(P);
+	r.depth = static_cast<uint8_t>(depth);
+	r.flags = hasStats ? RESULT_HAS_STATS : 0;
+	if (hasStats) {
+		r.info = info;
+	} else {
+		r.info.nMoves = info.nMoves;
+	}
+	r.checksum = recordChecksum(r);
+
+	const size_t n = db.find(r.position, r.depth, keyHash(r.position, r.depth));
+	if (n != SIZE_MAX) {
+		const ResultRecord& existing = db.record(n);
+		if (existing.info.nMoves != r.info.nMoves) {
+			printf("Warning: results database %s has perft %d = %" PRIu64 " for this position, but it has just been calculated as %" PRIu64 "\n",
+				db.path.c_str(), depth, existing.info.nMoves, r.info.nMoves);
+			return;
+		}
+		if ((existing.flags & RESULT_HAS_STATS) || !hasStats) {
+			return; // (nothing new)
+		}
+	}
+
+	if (fwrite(&r, sizeof(r), 1, db.f) != 1 || !Utils::flushToDisk(db.f)) {
+		printf("Warning: unable to write to results database %s\n", db.path.c_str());
+		return;
+	}
+	db.appended.push_back(r);
+	db.addToIndex(db.nMapped + db.appended.size() - 1);
+}
+
+void ResultsDB::store(const ChessPosition& P, int depth, nodecount_t nNodes)
+{
+	PerftInfo info;
+	info.nMoves = nNodes;
+	store(P, depth, false, info);
+}
+
+void perftFastCached(const ChessPosition& P, int depth, nodecount_t& nNodes)
+{
+	PerftInfo info;
+	if (ResultsDB::lookup(P, depth, false, info)) {
+		nNodes = info.nMoves;
+		return;
+	}
+	perftFastMT(P, depth, nNodes);
+	ResultsDB::store(P, depth, nNodes);
+}
+
+void perftCached(const ChessPosition& P, int depth, PerftInfo& info)
+{
+	if (ResultsDB::lookup(P, depth, true, info)) {
+		return;
+	}
+	info = PerftInfo{};
+	perftMT(P, depth, 1, &info);
+	ResultsDB::store(P, depth, true, info);
+}
+
+} // namespace juddperft
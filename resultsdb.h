@@ -0,0 +1,99 @@
+/*
+
+MIT License
+
+Copyright(c) 2016-2025 Judd Niemann
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files(the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+
+//////////////////////////////////////////////
+// resultsdb.h								//
+// Defines:									//
+// Persistent database of perft results		//
+//////////////////////////////////////////////
+
+#ifndef _RESULTSDB_H
+#define _RESULTSDB_H 1
+
+#include "chessposition.h"
+#include "extperft.h"
+#include "movegen.h"
+#include "search.h"
+
+#include <cstdint>
+#include <string>
+
+namespace juddperft {
+
+// The results database remembers every perft result that has been calculated while it is open,
+// so that asking for the same (position, depth) again - in a later session, or from a different command - is just a lookup.
+// Positions are keyed by their PackedPosition (see extperft.h), so move counters, and e.p. squares which can't be used,
+// don't stop a result from being found.
+//
+// File format: a ResultsDBHeader, followed by fixed-size ResultRecords, in the order they were added.
+// Records are only ever appended (and each one is flushed to disk as it is added). Each record carries a checksum,
+// so that a record torn by a crash is detected (and discarded) the next time the file is opened.
+// The existing records are memory-mapped when the file is opened, and indexed in memory.
+// A record may be superseded by a later record for the same (position, depth), when the later one carries stats.
+
+#pragma pack(push, 1)
+struct ResultRecord
+{
+	PackedPosition position;
+	uint8_t depth;
+	uint8_t flags;			// bit 0: info holds full stats (otherwise, only info.nMoves is valid)
+	uint32_t checksum;		// (of the whole record, calculated with checksum = 0)
+	PerftInfo info;
+};
+#pragma pack(pop)
+
+static_assert(sizeof(ResultRecord) == 96);
+
+class ResultsDB
+{
+public:
+	// open() : open (or create) the database file at path. Any previously open database is closed first
+	static bool open(const std::string& path);
+	static void close();
+	static bool isOpen();
+	static std::string path();
+	static size_t size(); // number of distinct (position, depth) results
+
+	// lookup() : if there is a result for (P, depth) (with full stats, if statsRequired), copy it to info and return true
+	static bool lookup(const ChessPosition& P, int depth, bool statsRequired, PerftInfo& info);
+
+	// store() : add a result (unless the database already has it). If the database holds a different count
+	// for the same (position, depth), a warning is printed, and the new result is not stored
+	static void store(const ChessPosition& P, int depth, bool hasStats, const PerftInfo& info);
+	static void store(const ChessPosition& P, int depth, nodecount_t nNodes);
+};
+
+// perftFastCached() : perftFastMT(), unless the database already has the answer (in which case, nNodes = the stored count).
+// The result is stored in the database (if one is open)
+void perftFastCached(const ChessPosition& P, int depth, nodecount_t& nNodes);
+
+// perftCached() : as perftFastCached(), for perftMT() (with full stats)
+void perftCached(const ChessPosition& P, int depth, PerftInfo& info);
+
+} // namespace juddperft
+
+#endif // _RESULTSDB_H
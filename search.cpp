@@ -26,135 +26,133 @@ SOFTWARE.
 
 #include "search.h"
 #include "engine.h"
+#include "extperft.h"
 //#include "fen.h"
 #include "zobristkeyset.h"
 #include "hash_table.h"
 #include "tablegroup.h"
 #include "movegen.h"
+#include "movestack.h"
+#include "resultsdb.h"
+#include "spilltable.h"
+#include "hashverifier.h"
+#include "tablestats.h"
 
 
 #include <algorithm>
 #include <cassert>
 #include <chrono>
+#include <cmath>
 #include <condition_variable>
 #include <numeric>
 //#include <fstream>
 #include <queue>
+#include <random>
 //#include <string>
 #include <thread>
+#include <unordered_map>
 #include <vector>
 
 namespace juddperft {
 
 nodecount_t perft(const ChessPosition P, int maxdepth, int depth, PerftInfo* pI)
 {
-	ChessMove moveList[MOVELIST_SIZE];
-	ChessPosition Q = P;
-	ChessMove* pM;
-
-	MoveGenerator::generateMoves(P, moveList);
-	const int movecount = move_count(moveList);
-
 	if (depth == maxdepth) {
-		pM = moveList;
-		for (int i = 0; i < movecount; i++, pM++) {
-			pI->nMoves++;
-			if (get_flag(pM, capture)) {
-				pI->nCapture++;
-			}
-
-			if (get_flag(pM, castle)) {
-				pI->nCastle++;
-			}
-
-			if (get_flag(pM, castleLong)) {
-				pI->nCastleLong++;
-			}
-
-			if (get_flag(pM, enPassantCapture)) {
-				pI->nEPCapture++;
-			}
-
-			if (get_flag(pM, promoteBishop) ||
-				get_flag(pM, promoteKnight) ||
-				get_flag(pM, promoteQueen) ||
-				get_flag(pM, promoteRook)) {
-				pI->nPromotion++;
-			}
-
-			if (get_flag(pM, check)) {
-				pI->nCheck++;
-			}
-
-			if (get_flag(pM, checkmate)) {
-				pI->nCheckmate++;
-
-				// std::ofstream outfile;
-				// outfile.open("checkmates.txt", std::ios::app);
+		MoveGenerator::generateLeafStats(P, pI);
+		return pI->nMoves;
+	}
 
-				// if (outfile.is_open()) {
+	MoveStack& moveStack = MoveStack::forThisThread();
+	ChessMove* moveList = moveStack.scratch();
+	ChessPosition Q = P;
 
-				// 	char buf[4096];
-				// 	memset(buf, 0, 4096);
-				// 	writeFen(buf, &P);
+	Q.dontDetectChecks = 1; // checks (and checkmates) are only tallied at leaf nodes
+	MoveGenerator::generateMoves(Q, moveList);
+	const int movecount = move_count(moveList);
+	const CompactMove* moves = moveStack.push(moveList, movecount);
 
-				// 	outfile << "\"" << buf << "\"\n";
-				// 	outfile.close();
-				// 	//printChessPosition(*this);
-				// }
-			}
-		}
-	} else {
-		pM = moveList;
-		for (int i = 0; i<movecount; i++, pM++) {
-			Q.performMoveNoHash(*pM).switchSides();
-			perft(Q, maxdepth, depth + 1, pI);
-			Q = P; // unmake move
-		}
+	Q = P;
+	for (int i = 0; i < movecount; i++) {
+		Q.performMoveNoHash(expandMove(P, moves[i])).switchSides();
+		perft(Q, maxdepth, depth + 1, pI);
+		Q = P; // unmake move
 	}
 
+	moveStack.pop(movecount);
+
 	return pI->nMoves;
 }
 
+#if defined(HT_PERFT_SPILL_TABLE) && defined(HT_PERFT_DEPTH_TALLY)
+// promoteSpilledRecord() : put a record found in the spill table back into the RAM table
+// (whatever it displaces may in turn be spilled)
+static inline void promoteSpilledRecord(std::atomic<PerftRecord>* pAtomicRecord, const PerftRecord& record)
+{
+	PerftRecord displaced = pAtomicRecord->load();
+	while (!pAtomicRecord->compare_exchange_weak(displaced, record));
+	SpillTable::evicted(displaced, record.hk);
+}
+#endif
+
 void perftFast(const ChessPosition& P, int depth, nodecount_t& nNodes)
 {
 
 #if !defined(HT_PERFT_LEAF_TABLE)
 	// Consult the HashTable:
-	const HashKey hk = P.hk ^ zobristKeys.zkPerftDepth[depth];
+	const HashKey hk = P.getCanonicalHash() ^ zobristKeys.zkPerftDepth[depth];
 
 	std::atomic<PerftRecord> *pAtomicRecord = TableGroup::perftTable.getAddress(hk); // get address
 	PerftRecord retrievedRecord = pAtomicRecord->load(); // Load a copy of the record
-	if (retrievedRecord.hk == hk) {
-		nNodes += retrievedRecord.count;
+	if (retrievedRecord.hk == hk && HashVerifier::verifies(retrievedRecord, P)) {
+		TableStats::forThisThread().hit(STATS_PERFT_TABLE, depth);
+		nNodes += retrievedRecord.getCount();
+		HashVerifier::sample(P, depth, retrievedRecord.getCount());
 		return;
 	}
 
-	PerftRecord newRecord;
-	newRecord.hk = hk;
+	TableCounters& stats = TableStats::forThisThread();
+	stats.missed(STATS_PERFT_TABLE, depth);
 
-#if defined(HT_PERFT_DEPTH_TALLY)
-	newRecord.depth = depth;
+#if defined(HT_PERFT_SPILL_TABLE) && defined(HT_PERFT_DEPTH_TALLY)
+	if (depth > 1 && SpillTable::probe(hk, depth, retrievedRecord) && HashVerifier::verifies(retrievedRecord, P)) {
+		nNodes += retrievedRecord.getCount();
+		HashVerifier::sample(P, depth, retrievedRecord.getCount());
+		promoteSpilledRecord(pAtomicRecord, retrievedRecord);
+		return;
+	}
 #endif
 
-	ChessMove moveList[MOVELIST_SIZE];
+	PerftRecord newRecord;
+	newRecord.hk = hk;
+
+	MoveStack& moveStack = MoveStack::forThisThread();
+	ChessMove* moveList = moveStack.scratch();
 	nodecount_t orig_nNodes = nNodes;
 	MoveGenerator::generateMoves(P, moveList);
-	const int movecount = moveList->moveCount;
+	const int movecount = move_count(moveList);
 	if (depth == 1) { /* Leaf Node*/
-		newRecord.count = movecount;
 		nNodes += movecount;
 	} else { /* Branch Node */
+		const CompactMove* moves = moveStack.push(moveList, movecount);
 		ChessPosition Q = P;
 		for (int i = 0; i < movecount; i++) {
-			Q.performMove(moveList[i]).switchSides(); // make move
+			Q.performMove(expandMove(P, moves[i])).switchSides(); // make move
 			perftFast(Q, depth - 1, nNodes);
 			Q = P; // unmake move
 		}
-		newRecord.count = nNodes - orig_nNodes; // record RELATIVE increase in nodecount
+		moveStack.pop(movecount);
 	}
 
-	while (!pAtomicRecord->compare_exchange_weak(retrievedRecord, newRecord)); // loop until successfully written;
+	// record RELATIVE increase in nodecount (unless there are too many nodes for a record)
+	if (newRecord.set(depth, nNodes - orig_nNodes, HashVerifier::verificationKey(P), TableGroup::generation)) {
+		while (!pAtomicRecord->compare_exchange_weak(retrievedRecord, newRecord)) { // loop until successfully written
+			stats.casRetry(STATS_PERFT_TABLE, depth);
+		}
+		stats.stored(STATS_PERFT_TABLE, depth, retrievedRecord.hk != hk && retrievedRecord.getDepth() > depth);
+#if defined(HT_PERFT_SPILL_TABLE) && defined(HT_PERFT_DEPTH_TALLY)
+		SpillTable::evicted(retrievedRecord, hk);
+#endif
+	}
 #else
 	// leaf-table code
 
@@ -162,95 +160,224 @@ void perftFast(const ChessPosition& P, int depth, nodecount_t& nNodes)
 
 	if (depth == 1) { /* Leaf Node */
 
-		static constexpr uint64_t hk_mask = 0xffffffffffffff00;
-		static constexpr uint64_t mc_mask = 0x00000000000000ff;
-
-		const HashKey hk = P.hk;
-		const uint64_t hk_validate = hk & hk_mask;
+		const HashKey hk = P.getCanonicalHash();
+		const uint64_t hk_validate = hk & LEAF_HK_MASK;
 
 		// Consult the HashTable:
 		std::atomic<PerftLeafRecord> *pAtomicRecord = TableGroup::perftLeafTable.getAddress(hk);
 		PerftLeafRecord retrievedRecord = pAtomicRecord->load();
 
-		// validate the top 56 bits
-		if ((retrievedRecord & hk_mask) == hk_validate) {
-			nNodes += (retrievedRecord & mc_mask);
+		// validate the top bits (the rest are implied by the slot)
+		if ((retrievedRecord & LEAF_HK_MASK) == hk_validate) {
+			TableStats::forThisThread().hit(STATS_LEAF_TABLE, 1);
+			nNodes += (retrievedRecord & LEAF_COUNT_MASK);
+			HashVerifier::sample(P, 1, retrievedRecord & LEAF_COUNT_MASK);
 			return;
 		}
 
-		ChessMove moveList[MOVELIST_SIZE];
+		TableCounters& stats = TableStats::forThisThread();
+		stats.missed(STATS_LEAF_TABLE, 1);
+
+		ChessMove* moveList = MoveStack::forThisThread().scratch();
 		MoveGenerator::generateMoves(P, moveList);
 		const uint64_t movecount = move_count(moveList);
-		PerftLeafRecord newRecord = hk_validate | movecount;
+		PerftLeafRecord newRecord = hk_validate | ((static_cast<uint64_t>(TableGroup::generation) << LEAF_GENERATION_SHIFT) & LEAF_GENERATION_MASK) | movecount;
 		nNodes += movecount;
 
-		while (!pAtomicRecord->compare_exchange_weak(retrievedRecord, newRecord)); // loop until successfully written;
+		while (!pAtomicRecord->compare_exchange_weak(retrievedRecord, newRecord)) { // loop until successfully written
+			stats.casRetry(STATS_LEAF_TABLE, 1);
+		}
+		stats.stored(STATS_LEAF_TABLE, 1, retrievedRecord != 0 && (retrievedRecord & LEAF_HK_MASK) != hk_validate);
 
 	} else { /* Branch Node */
 
 		// Consult the HashTable:
-		const HashKey hk = P.hk ^ zobristKeys.zkPerftDepth[depth];
+		const HashKey hk = P.getCanonicalHash() ^ zobristKeys.zkPerftDepth[depth];
 		std::atomic<PerftRecord> *pAtomicRecord = TableGroup::perftTable.getAddress(hk);
 		PerftRecord retrievedRecord = pAtomicRecord->load();
 
 		// validate entire hk
-		if (retrievedRecord.hk == hk) {
-			nNodes += retrievedRecord.count;
+		if (retrievedRecord.hk == hk && HashVerifier::verifies(retrievedRecord, P)) {
+			TableStats::forThisThread().hit(STATS_PERFT_TABLE, depth);
+			nNodes += retrievedRecord.getCount();
+			HashVerifier::sample(P, depth, retrievedRecord.getCount());
 			return;
 		}
 
-		PerftRecord newRecord;
-		newRecord.hk = hk;
+		TableCounters& stats = TableStats::forThisThread();
+		stats.missed(STATS_PERFT_TABLE, depth);
 
-#if defined(HT_PERFT_DEPTH_TALLY)
-		newRecord.depth = depth;
+#if defined(HT_PERFT_SPILL_TABLE) && defined(HT_PERFT_DEPTH_TALLY)
+		if (SpillTable::probe(hk, depth, retrievedRecord) && HashVerifier::verifies(retrievedRecord, P)) {
+			nNodes += retrievedRecord.getCount();
+			HashVerifier::sample(P, depth, retrievedRecord.getCount());
+			promoteSpilledRecord(pAtomicRecord, retrievedRecord);
+			return;
+		}
 #endif
 
-		ChessMove moveList[MOVELIST_SIZE];
+		PerftRecord newRecord;
+		newRecord.hk = hk;
+
+		MoveStack& moveStack = MoveStack::forThisThread();
+		ChessMove* moveList = moveStack.scratch();
 		nodecount_t orig_nNodes = nNodes;
 		MoveGenerator::generateMoves(P, moveList);
 		const int movecount = move_count(moveList);
+		const CompactMove* moves = moveStack.push(moveList, movecount);
 
 		ChessPosition Q = P;
 		for (int i = 0; i < movecount; i++) {
-			Q.performMove(moveList[i]).switchSides(); // make move
+			Q.performMove(expandMove(P, moves[i])).switchSides(); // make move
 			perftFast(Q, depth - 1, nNodes);
 			Q = P; // unmake move
 		}
 
-		newRecord.count = nNodes - orig_nNodes; // record RELATIVE increase in nodecount
+		moveStack.pop(movecount);
 
-		while (!pAtomicRecord->compare_exchange_weak(retrievedRecord, newRecord)); // loop until successfully written;
+		// record RELATIVE increase in nodecount (unless there are too many nodes for a record)
+		if (newRecord.set(depth, nNodes - orig_nNodes, HashVerifier::verificationKey(P), TableGroup::generation)) {
+			while (!pAtomicRecord->compare_exchange_weak(retrievedRecord, newRecord)) { // loop until successfully written
+				stats.casRetry(STATS_PERFT_TABLE, depth);
+			}
+			stats.stored(STATS_PERFT_TABLE, depth, retrievedRecord.hk != hk && retrievedRecord.getDepth() > depth);
+#if defined(HT_PERFT_SPILL_TABLE) && defined(HT_PERFT_DEPTH_TALLY)
+			SpillTable::evicted(retrievedRecord, hk);
+#endif
+		}
 	}
 #endif
 }
 
-void perftMT(ChessPosition P, int maxdepth, int depth, PerftInfo* pI)
-{
-	ChessMove MoveList[MOVELIST_SIZE];
-	MoveGenerator::generateMoves(P, MoveList);
+// perftMulti() : like perft(), but tallies stats at every depth along the way, instead of just at maxdepth.
+// Each node tallies the stats of its own moves into pI[depth], so the cost over perft(maxdepth) is just one
+// extra (stats-only) generation per interior node
 
+void perftMulti(const ChessPosition& P, int maxdepth, int depth, PerftInfo* pI)
+{
+	MoveGenerator::generateLeafStats(P, &pI[depth]);
 	if (depth == maxdepth) {
-		for (ChessMove* pM = MoveList; !get_flag(pM, endOfMoveList); pM++)
-		{
-			pI->nMoves++;
-			if (get_flag(pM, capture))
-				pI->nCapture++;
-			if (get_flag(pM, castle))
-				pI->nCastle++;
-			if (get_flag(pM, castleLong))
-				pI->nCastleLong++;
-			if (get_flag(pM, enPassantCapture))
-				pI->nEPCapture++;
-			if (get_flag(pM, promoteBishop) ||
-				get_flag(pM, promoteKnight) ||
-				get_flag(pM, promoteQueen) ||
-				get_flag(pM, promoteRook))
-				pI->nPromotion++;
+		return;
+	}
+
+	MoveStack& moveStack = MoveStack::forThisThread();
+	ChessMove* moveList = moveStack.scratch();
+	ChessPosition Q = P;
+
+	Q.dontDetectChecks = 1; // checks (and checkmates) are tallied by generateLeafStats()
+	MoveGenerator::generateMoves(Q, moveList);
+	const int movecount = move_count(moveList);
+	const CompactMove* moves = moveStack.push(moveList, movecount);
+
+	Q = P;
+	for (int i = 0; i < movecount; i++) {
+		Q.performMoveNoHash(expandMove(P, moves[i])).switchSides();
+		perftMulti(Q, maxdepth, depth + 1, pI);
+		Q = P; // unmake move
+	}
+
+	moveStack.pop(movecount);
+}
+
+// perftFastMulti() : like perftFast(), but counts the nodes at every depth from 1 to depth (nNodes[0] .. nNodes[depth - 1]).
+// The hashtable records are the same ones that perftFast() uses (one per position per depth):
+// records are probed from the deepest down, and only the depths which aren't found are searched.
+// Once searched, a record is written for each depth.
+
+void perftFastMulti(const ChessPosition& P, int depth, nodecount_t* nNodes)
+{
+	if (depth == 1) {
+		perftFast(P, 1, nNodes[0]); // (nothing to gain over perftFast() at depth 1)
+		return;
+	}
+
+	assert(depth < PERFT_DEPTH_KEYS);
+
+	// Consult the HashTable, deepest first:
+	const HashKey hkCanonical = P.getCanonicalHash();
+	const uint64_t vk = HashVerifier::verificationKey(P);
+	TableCounters& stats = TableStats::forThisThread();
+	int d = depth;
+	for (; d >= 2; d--) {
+		const HashKey hk = hkCanonical ^ zobristKeys.zkPerftDepth[d];
+		std::atomic<PerftRecord> *pAtomicRecord = TableGroup::perftTable.getAddress(hk);
+		PerftRecord retrievedRecord = pAtomicRecord->load();
+		if (retrievedRecord.hk != hk || !HashVerifier::verifies(retrievedRecord, vk)) {
+			stats.missed(STATS_PERFT_TABLE, d);
+#if defined(HT_PERFT_SPILL_TABLE) && defined(HT_PERFT_DEPTH_TALLY)
+			if (SpillTable::probe(hk, d, retrievedRecord) && HashVerifier::verifies(retrievedRecord, vk)) {
+				nNodes[d - 1] += retrievedRecord.getCount();
+				HashVerifier::sample(P, d, retrievedRecord.getCount());
+				promoteSpilledRecord(pAtomicRecord, retrievedRecord);
+				continue;
+			}
+#endif
+			// depths 1 .. d need to be searched; the shallower ones aren't probed, but they are stored afterwards,
+			// so count them as misses (to keep the table statistics' probes and stores in step)
+			for (int k = d - 1; k >= 2; k--) {
+				stats.missed(STATS_PERFT_TABLE, k);
+			}
+			break;
 		}
+		stats.hit(STATS_PERFT_TABLE, d);
+		nNodes[d - 1] += retrievedRecord.getCount();
+		HashVerifier::sample(P, d, retrievedRecord.getCount());
+	}
+
+	if (d == 1) {
+		perftFast(P, 1, nNodes[0]);
 		return;
 	}
 
+	nodecount_t orig_nNodes[PERFT_DEPTH_KEYS];
+	std::copy(nNodes, nNodes + d, orig_nNodes);
+
+	MoveStack& moveStack = MoveStack::forThisThread();
+	ChessMove* moveList = moveStack.scratch();
+	MoveGenerator::generateMoves(P, moveList);
+	const int movecount = move_count(moveList);
+	nNodes[0] += movecount;
+
+	const CompactMove* moves = moveStack.push(moveList, movecount);
+	ChessPosition Q = P;
+	for (int i = 0; i < movecount; i++) {
+		Q.performMove(expandMove(P, moves[i])).switchSides(); // make move
+		perftFastMulti(Q, d - 1, nNodes + 1);
+		Q = P; // unmake move
+	}
+	moveStack.pop(movecount);
+
+	// record RELATIVE increase in nodecount, for each depth searched
+	for (int k = 2; k <= d; k++) {
+		PerftRecord newRecord;
+		newRecord.hk = hkCanonical ^ zobristKeys.zkPerftDepth[k];
+		if (!newRecord.set(k, nNodes[k - 1] - orig_nNodes[k - 1], vk, TableGroup::generation)) {
+			continue; // (too many nodes for a record)
+		}
+		std::atomic<PerftRecord> *pAtomicRecord = TableGroup::perftTable.getAddress(newRecord.hk);
+		PerftRecord retrievedRecord = pAtomicRecord->load();
+		while (!pAtomicRecord->compare_exchange_weak(retrievedRecord, newRecord)) { // loop until successfully written
+			stats.casRetry(STATS_PERFT_TABLE, k);
+		}
+		stats.stored(STATS_PERFT_TABLE, k, retrievedRecord.hk != newRecord.hk && retrievedRecord.getDepth() > k);
+#if defined(HT_PERFT_SPILL_TABLE) && defined(HT_PERFT_DEPTH_TALLY)
+		SpillTable::evicted(retrievedRecord, newRecord.hk);
+#endif
+	}
+}
+
+void perftMT(ChessPosition P, int maxdepth, int depth, PerftInfo* pI)
+{
+	if (depth == maxdepth) {
+		MoveGenerator::generateLeafStats(P, pI);
+		return;
+	}
+
+	ChessMove MoveList[MOVELIST_SIZE];
+	ChessPosition G = P;
+	G.dontDetectChecks = 1; // checks (and checkmates) are only tallied at leaf nodes
+	MoveGenerator::generateMoves(G, MoveList);
+
 	// determine number of threads. Note:
 	// MAX_THREADS is compile-time hard limit.
 	// theEngine.nNumCores is how many cores user wants.
@@ -420,4 +547,511 @@ void perftFastMT(ChessPosition P, int depth, nodecount_t& nNodes)
 	nNodes = std::accumulate(subTotal.begin(), subTotal.end(), 0ull);
 }
 
+// perftMultiMT() - Multi-threaded perftMulti() driver: stats for perft 1 .. maxdepth in a single pass.
+// pI[0] .. pI[maxdepth] are overwritten.
+
+void perftMultiMT(ChessPosition P, int maxdepth, PerftInfo* pI)
+{
+	std::fill(pI, pI + maxdepth + 1, PerftInfo{});
+	pI[0].nMoves = 1;
+
+	if (maxdepth < 1) {
+		return;
+	}
+
+	MoveGenerator::generateLeafStats(P, &pI[1]);
+	if (maxdepth == 1) {
+		return;
+	}
+
+	ChessMove movelist[MOVELIST_SIZE];
+	ChessPosition G = P;
+	G.dontDetectChecks = 1;
+	MoveGenerator::generateMoves(G, movelist);
+	const unsigned int movecount = move_count(movelist);
+
+	unsigned int nThreads = std::min(std::thread::hardware_concurrency(), std::min(theEngine.nNumCores, static_cast<unsigned int>(MAX_THREADS)));
+	nThreads = std::max(1u, std::min(nThreads, movecount));
+	std::vector<std::vector<PerftInfo>> partial(nThreads, std::vector<PerftInfo>(maxdepth + 1));
+	std::atomic<unsigned int> nextMove{0};
+	std::atomic<int> progressDots{0};
+
+	std::vector<std::thread> threads;
+	for (unsigned int t = 0; t < nThreads; t++) {
+		threads.emplace_back([&, t] {
+			for (unsigned int i = nextMove++; i < movecount; i = nextMove++) {
+				ChessPosition Q = P;
+				Q.performMoveNoHash(movelist[i]).switchSides();
+				perftMulti(Q, maxdepth, 2, partial[t].data());
+				std::cout << ".";								// show progress
+				progressDots++;
+			}
+		});
+	}
+
+	for (auto & th : threads) {
+		th.join();
+	}
+
+	// rub-out the progress dots
+	for (int c = 0; c < progressDots; c++) {
+		std::cout << "\b \b";
+	}
+
+	// add up totals:
+	for (const auto& p : partial) {
+		for (int d = 2; d <= maxdepth; d++) {
+			pI[d].nCapture += p[d].nCapture;
+			pI[d].nCastle += p[d].nCastle;
+			pI[d].nCastleLong += p[d].nCastleLong;
+			pI[d].nEPCapture += p[d].nEPCapture;
+			pI[d].nMoves += p[d].nMoves;
+			pI[d].nPromotion += p[d].nPromotion;
+			pI[d].nCheck += p[d].nCheck;
+			pI[d].nCheckmate += p[d].nCheckmate;
+		}
+	}
+}
+
+// perftFastMultiMT() - Multi-threaded perftFastMulti() driver: perft 1 .. depth in a single pass.
+// nNodes[0] .. nNodes[depth] are overwritten. Each root move is counted in 64 bits, and the root totals in 128 bits.
+
+void perftFastMultiMT(ChessPosition P, int depth, WideNodeCount* nNodes)
+{
+	std::fill(nNodes, nNodes + depth + 1, WideNodeCount{});
+	nNodes[0] += 1;
+
+	if (depth < 1) {
+		return;
+	}
+
+	P.dontDetectChecks = 1; // (see perftFastMT())
+
+	ChessMove movelist[MOVELIST_SIZE];
+	MoveGenerator::generateMoves(P, movelist);
+	const unsigned int movecount = move_count(movelist);
+	nNodes[1] += movecount;
+
+	if (depth == 1) {
+		return;
+	}
+
+	unsigned int nThreads = std::min(std::thread::hardware_concurrency(), std::min(theEngine.nNumCores, static_cast<unsigned int>(MAX_THREADS)));
+	nThreads = std::max(1u, std::min(nThreads, movecount));
+	std::vector<std::vector<WideNodeCount>> partial(nThreads, std::vector<WideNodeCount>(depth + 1));
+	std::atomic<unsigned int> nextMove{0};
+	std::atomic<int> progressDots{0};
+
+	std::vector<std::thread> threads;
+	for (unsigned int t = 0; t < nThreads; t++) {
+		threads.emplace_back([&, t] {
+			for (unsigned int i = nextMove++; i < movecount; i = nextMove++) {
+				ChessPosition Q = P;
+				Q.performMove(movelist[i]).switchSides();
+				nodecount_t n[PERFT_DEPTH_KEYS] = {};
+				perftFastMulti(Q, depth - 1, n); // (perft d of the root is perft d - 1 of its children)
+				for (int d = 2; d <= depth; d++) {
+					partial[t][d] += n[d - 2];
+				}
+				std::cout << ".";								// show progress
+				progressDots++;
+			}
+		});
+	}
+
+	for (auto & th : threads) {
+		th.join();
+	}
+
+	// rub-out the progress dots
+	for (int c = 0; c < progressDots; c++) {
+		std::cout << "\b \b";
+	}
+
+	// add up totals:
+	for (const auto& p : partial) {
+		for (int d = 2; d <= depth; d++) {
+			nNodes[d] += p[d];
+		}
+	}
+}
+
+// divideMT() - Multi-threaded divide.
+// Rather than running a separate multi-threaded perft for each root move one after another (with a barrier and a thread
+// spin-up for each), all root moves (or, with levels = 2, all pairs of root move + reply) are put into a single pool of tasks.
+// If there are fewer tasks than threads (eg a narrow position, or a machine with many cores), the tasks are split into work
+// items a ply deeper (as many times as it takes), and the results of each task's work items are added back up.
+// Results are held until all earlier tasks have completed, so that they are reported in a deterministic order.
+
+static void addPerftInfo(PerftInfo& total, const PerftInfo& t)
+{
+	total.nMoves += t.nMoves;
+	total.nCapture += t.nCapture;
+	total.nEPCapture += t.nEPCapture;
+	total.nCastle += t.nCastle;
+	total.nCastleLong += t.nCastleLong;
+	total.nPromotion += t.nPromotion;
+	total.nCheck += t.nCheck;
+	total.nCheckmate += t.nCheckmate;
+}
+
+void divideMT(ChessPosition P, int depth, int levels, bool collectStats, const std::function<void(const DivideResult&)>& onResult)
+{
+	assert(levels == 1 || (levels == 2 && depth > 2)); // (checked by the caller)
+
+	struct DivideTask
+	{
+		ChessPosition Q;
+		DivideResult result;
+	};
+
+	std::vector<DivideTask> tasks;
+
+	ChessMove movelist[MOVELIST_SIZE];
+	MoveGenerator::generateMoves(P, movelist);
+	for (unsigned int i = 0; i < move_count(movelist); i++) {
+		ChessPosition Q = P;
+		Q.performMove(movelist[i]).switchSides();
+
+		ChessMove replies[MOVELIST_SIZE];
+		unsigned int nReplies = 0;
+		if (levels == 2) {
+			MoveGenerator::generateMoves(Q, replies);
+			nReplies = move_count(replies);
+		}
+
+		if (nReplies == 0) { // (levels == 1, or no legal replies)
+			DivideTask task;
+			task.Q = Q;
+			task.result.moves[0] = movelist[i];
+			task.result.nMoves = 1;
+			tasks.push_back(task);
+		}
+
+		for (unsigned int j = 0; j < nReplies; j++) {
+			DivideTask task;
+			task.Q = Q;
+			task.Q.performMove(replies[j]).switchSides();
+			task.result.moves[0] = movelist[i];
+			task.result.moves[1] = replies[j];
+			task.result.nMoves = 2;
+			task.result.lastInGroup = (j == nReplies - 1);
+			tasks.push_back(task);
+		}
+	}
+
+	// a work item: a position, remaining plies below it, and the task whose result it adds to
+	struct WorkItem
+	{
+		size_t task;
+		ChessPosition Q;
+		int remaining;
+	};
+
+	std::vector<WorkItem> work;
+	std::vector<size_t> pending(tasks.size(), 0); // (work items still to do, per task)
+	std::vector<char> done(tasks.size(), 0);
+	for (size_t i = 0; i < tasks.size(); i++) {
+		const int remaining = depth - tasks[i].result.nMoves;
+		if (ResultsDB::lookup(tasks[i].Q, remaining, collectStats, tasks[i].result.info)) {
+			done[i] = 1; // (already known)
+		} else {
+			work.push_back({i, tasks[i].Q, remaining});
+			pending[i] = 1;
+		}
+	}
+
+	const unsigned int nMaxThreads = std::max(1u, std::min(std::thread::hardware_concurrency(), std::min(theEngine.nNumCores, static_cast<unsigned int>(MAX_THREADS))));
+	const size_t nTopLevelItems = work.size();
+	while (work.size() < nMaxThreads) {
+		std::vector<WorkItem> next;
+		bool split = false;
+		for (const WorkItem& w : work) {
+			if (w.remaining < 2) {
+				next.push_back(w); // (perft 1 is just a move count: not worth splitting)
+				continue;
+			}
+			MoveGenerator::generateMoves(w.Q, movelist);
+			pending[w.task] = pending[w.task] - 1 + move_count(movelist); // (this item is replaced by its children)
+			for (unsigned int k = 0; k < move_count(movelist); k++) {
+				WorkItem child{w.task, w.Q, w.remaining - 1};
+				child.Q.performMove(movelist[k]).switchSides();
+				next.push_back(child);
+			}
+			split = true;
+		}
+		if (!split) {
+			break;
+		}
+		work.swap(next);
+	}
+	const bool splitTasks = (work.size() != nTopLevelItems);
+
+	// (tasks whose work items all turned out to be dead ends are already complete)
+	for (size_t i = 0; i < tasks.size(); i++) {
+		if (pending[i] == 0) {
+			done[i] = 1;
+		}
+	}
+
+	const unsigned int nThreads = std::max(1u, std::min(nMaxThreads, static_cast<unsigned int>(work.size())));
+	std::atomic<size_t> nextItem{0};
+	size_t nextToReport = 0;
+	std::mutex reportMutex;
+
+	auto reportCompleted = [&] {
+		while (nextToReport < tasks.size() && done[nextToReport]) {
+			onResult(tasks[nextToReport++].result);
+		}
+	};
+
+	{
+		std::lock_guard<std::mutex> lock(reportMutex);
+		reportCompleted();
+	}
+
+	std::vector<std::thread> threads;
+	for (unsigned int t = 0; t < nThreads; t++) {
+		threads.emplace_back([&] {
+			for (size_t i = nextItem++; i < work.size(); i = nextItem++) {
+				WorkItem& w = work[i];
+				PerftInfo info;
+				if (ResultsDB::lookup(w.Q, w.remaining, collectStats, info)) {
+					// (already known)
+				} else if (collectStats) {
+					perft(w.Q, w.remaining, 1, &info);
+					ResultsDB::store(w.Q, w.remaining, true, info);
+				} else {
+					w.Q.dontDetectChecks = 1;
+					perftFast(w.Q, w.remaining, info.nMoves);
+					ResultsDB::store(w.Q, w.remaining, info.nMoves);
+				}
+
+				// add this result to its task; if that completes the task, report it, and any others that were waiting on it
+				std::lock_guard<std::mutex> lock(reportMutex);
+				DivideTask& task = tasks[w.task];
+				addPerftInfo(task.result.info, info);
+				if (--pending[w.task] == 0) {
+					if (splitTasks) {
+						const int remaining = depth - task.result.nMoves;
+						if (collectStats) {
+							ResultsDB::store(task.Q, remaining, true, task.result.info);
+						} else {
+							ResultsDB::store(task.Q, remaining, task.result.info.nMoves);
+						}
+					}
+					done[w.task] = 1;
+					reportCompleted();
+				}
+			}
+		});
+	}
+
+	for (auto & th : threads) {
+		th.join();
+	}
+}
+
+// perftFrontierMT() - Multi-threaded perftFast() driver, frontier version.
+// The tree is first expanded breadth-first to frontierDepth, and positions which are reached by more than one path
+// (ie transpositions) are merged into a single frontier position, with a multiplicity (the number of paths leading to it).
+// perftFast() is then run once for each unique frontier position, and the result is multiplied by the multiplicity.
+// For deep perfts, this avoids having several threads working through the same transposing subtrees at once,
+// which the hash table only partly protects against.
+
+void perftFrontierMT(ChessPosition P, int depth, int frontierDepth, nodecount_t& nNodes, size_t* pFrontierSize)
+{
+	nNodes = 0;
+
+	// perftFast() needs at least 1 ply below the frontier
+	frontierDepth = std::min(frontierDepth, depth - 1);
+	if (frontierDepth < 1) {
+		perftFastMT(P, depth, nNodes);
+		if (pFrontierSize != nullptr) {
+			*pFrontierSize = 1;
+		}
+		return;
+	}
+
+	P.dontDetectChecks = 1; // (see perftFastMT())
+
+	struct FrontierNode
+	{
+		ChessPosition P;
+		nodecount_t multiplicity;
+	};
+
+	// Expand the frontier, one ply at a time:
+	std::vector<FrontierNode> frontier{{P, 1}};
+	for (int ply = 0; ply < frontierDepth; ply++) {
+		std::vector<FrontierNode> next;
+		std::unordered_map<HashKey, size_t> index; // (canonical) hash key of normalised position -> position in next
+		index.reserve(frontier.size() * 32);
+		ChessMove movelist[MOVELIST_SIZE];
+		for (const FrontierNode& node : frontier) {
+			MoveGenerator::generateMoves(node.P, movelist);
+			for (unsigned int i = 0; i < move_count(movelist); i++) {
+				ChessPosition Q = node.P;
+				Q.performMove(movelist[i]).switchSides();
+				Q = unpackPosition(packPosition(Q)); // (drop any e.p. square with no legal capture, so that transpositions are merged)
+				Q.dontDetectChecks = 1;
+				const auto [it, inserted] = index.try_emplace(Q.getCanonicalHash(), next.size());
+				if (inserted) {
+					next.push_back({Q, node.multiplicity});
+				} else {
+					next[it->second].multiplicity += node.multiplicity; // transposition (or mirror image)
+				}
+			}
+		}
+		frontier.swap(next);
+	}
+
+	if (pFrontierSize != nullptr) {
+		*pFrontierSize = frontier.size();
+	}
+
+	// determine number of threads (see perftFastMT())
+	unsigned int nThreads = std::min(std::thread::hardware_concurrency(), std::min(theEngine.nNumCores, static_cast<unsigned int>(MAX_THREADS)));
+	nThreads = std::max(1u, std::min(nThreads, static_cast<unsigned int>(frontier.size())));
+	std::vector<std::thread> threads;
+	std::vector<nodecount_t> subTotal(nThreads, 0);
+	std::atomic<size_t> nextNode{0};
+	std::atomic<int> progressDots{0};
+	const size_t progressInterval = std::max<size_t>(1, frontier.size() / 64);
+
+	// each thread grabs the next unprocessed frontier position until there are none left:
+	for (unsigned int t = 0; t < nThreads; t++) {
+		threads.emplace_back([&, t] {
+			nodecount_t total = 0;								// local accumulator for thread
+			for (size_t i = nextNode++; i < frontier.size(); i = nextNode++) {
+				nodecount_t s = 0;
+				perftFast(frontier[i].P, depth - frontierDepth, s);
+				total += s * frontier[i].multiplicity;
+				if (i % progressInterval == 0) {
+					std::cout << ".";							// show progress
+					progressDots++;
+				}
+			}
+			subTotal[t] = total;								// record subtotal
+		});
+	}
+
+	//Join Threads:
+	for (auto & th : threads) {
+		th.join();
+	}
+
+	// rub-out the progress dots
+	for (int c = 0; c < progressDots; c++) {
+		std::cout << "\b \b";
+	}
+
+	// add up total:
+	nNodes = std::accumulate(subTotal.begin(), subTotal.end(), 0ull);
+}
+
+// perftEstimateMT() - Multi-threaded Monte-Carlo estimate of perft.
+// Uses Knuth's random-walk estimator: walk down the tree choosing a move at random at each ply, and take the product of the
+// number of moves available at each ply along the way. The expected value of the product is exactly the number of leaf nodes.
+// The walks are stratified by root move (each root move gets an equal share of the samples, and the subtree estimates are added up),
+// which removes the variance due to the choice of root move. The standard error is calculated from the per-stratum variances.
+
+void perftEstimateMT(ChessPosition P, int depth, uint64_t samples, PerftEstimate& result)
+{
+	result = PerftEstimate{};
+
+	P.dontDetectChecks = 1;
+	ChessMove movelist[MOVELIST_SIZE];
+	MoveGenerator::generateMoves(P, movelist);
+	const unsigned int nStrata = move_count(movelist);
+
+	if (depth <= 1 || nStrata == 0) {
+		result.estimate = (depth <= 0) ? 1.0 : nStrata; // (exact)
+		return;
+	}
+
+	const uint64_t samplesPerStratum = std::max<uint64_t>(2, samples / nStrata);
+
+	// accumulated samples for one stratum
+	struct StratumTally
+	{
+		uint64_t n{0};
+		double sum{0.0};
+		double sumSq{0.0};
+	};
+
+	unsigned int nThreads = std::min(std::thread::hardware_concurrency(), std::min(theEngine.nNumCores, static_cast<unsigned int>(MAX_THREADS)));
+	nThreads = std::max(1u, nThreads);
+	std::vector<std::vector<StratumTally>> tallies(nThreads, std::vector<StratumTally>(nStrata));
+
+	// work is handed out in batches of samples (stratum = batch % nStrata), so that all threads are kept busy,
+	// regardless of how many root moves there are
+	constexpr uint64_t batchSize = 256;
+	const uint64_t batchesPerStratum = (samplesPerStratum + batchSize - 1) / batchSize;
+	const uint64_t nBatches = batchesPerStratum * nStrata;
+	std::atomic<uint64_t> nextBatch{0};
+	std::random_device rd;
+	const uint64_t seed = (static_cast<uint64_t>(rd()) << 32) ^ rd();
+
+	const auto start = std::chrono::steady_clock::now();
+	std::vector<std::thread> threads;
+	for (unsigned int t = 0; t < nThreads; t++) {
+		threads.emplace_back([&, t] {
+			std::mt19937_64 rng(seed + t); // per-thread RNG
+			ChessMove walkMoves[MOVELIST_SIZE];
+			for (uint64_t b = nextBatch++; b < nBatches; b = nextBatch++) {
+				const unsigned int stratum = b % nStrata;
+				const uint64_t first = (b / nStrata) * batchSize;
+				const uint64_t n = std::min(batchSize, samplesPerStratum - first);
+				StratumTally& tally = tallies[t][stratum];
+
+				ChessPosition Q = P;
+				Q.performMoveNoHash(movelist[stratum]).switchSides();
+
+				for (uint64_t i = 0; i < n; i++) {
+					ChessPosition X = Q;
+					double w = 1.0;
+					for (int ply = 1; ply < depth; ply++) {
+						MoveGenerator::generateMoves(X, walkMoves);
+						const unsigned int nMoves = move_count(walkMoves);
+						w *= nMoves;
+						if (nMoves == 0 || ply == depth - 1) {
+							break;
+						}
+						X.performMoveNoHash(walkMoves[rng() % nMoves]).switchSides();
+					}
+					tally.n++;
+					tally.sum += w;
+					tally.sumSq += w * w;
+				}
+			}
+		});
+	}
+
+	for (auto& th : threads) {
+		th.join();
+	}
+
+	const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	// combine: estimate = sum of stratum means; variance = sum of (stratum variance / stratum samples)
+	double variance = 0.0;
+	for (unsigned int s = 0; s < nStrata; s++) {
+		StratumTally total;
+		for (unsigned int t = 0; t < nThreads; t++) {
+			total.n += tallies[t][s].n;
+			total.sum += tallies[t][s].sum;
+			total.sumSq += tallies[t][s].sumSq;
+		}
+		const double mean = total.sum / total.n;
+		const double sampleVariance = std::max(0.0, (total.sumSq - total.n * mean * mean) / (total.n - 1));
+		result.estimate += mean;
+		variance += sampleVariance / total.n;
+		result.samples += total.n;
+	}
+
+	result.standardError = std::sqrt(variance);
+	result.samplesPerSecond = result.samples / std::max(seconds, 1e-6);
+}
+
 } // namespace juddperft
@@ -30,6 +30,7 @@ SOFTWARE.
 #include "chessposition.h"
 #include "movegen.h"
 
+#include <functional>
 
 
 namespace juddperft {
@@ -65,6 +66,52 @@ void perftMT(ChessPosition P, int maxdepth, int depth, PerftInfo* pI);
 // Multi-Threaded driver for perftFast()
 void perftFastMT(ChessPosition P, int depth, nodecount_t& nNodes);
 
+// perftMulti() : single-threaded perft(), collecting stats for every depth from depth to maxdepth in one traversal
+// (pI[d] receives the stats for perft d)
+void perftMulti(const ChessPosition& P, int maxdepth, int depth, PerftInfo* pI);
+
+// perftFastMulti() : single-threaded perftFast(), counting nodes at every depth from 1 to depth in one traversal
+// (nNodes[d - 1] is increased by perft d); uses (and updates) the same hashtable records as perftFast()
+void perftFastMulti(const ChessPosition& P, int depth, nodecount_t* nNodes);
+
+// Multi-Threaded driver for perftMulti(): pI must point to maxdepth + 1 PerftInfos (pI[0] gets the root)
+void perftMultiMT(ChessPosition P, int maxdepth, PerftInfo* pI);
+
+// Multi-Threaded driver for perftFastMulti(): nNodes must point to depth + 1 nodecounts (nNodes[d] = perft d).
+// The totals are accumulated in 128 bits (each root move's subtree must fit in a nodecount_t)
+void perftFastMultiMT(ChessPosition P, int depth, WideNodeCount* nNodes);
+
+// Multi-Threaded driver for perftFast(), which first expands the tree breadth-first to frontierDepth, merging transpositions
+// (pFrontierSize, if supplied, receives the number of unique positions in the frontier)
+constexpr int DEFAULT_FRONTIER_DEPTH = 4;
+void perftFrontierMT(ChessPosition P, int depth, int frontierDepth, nodecount_t& nNodes, size_t* pFrontierSize = nullptr);
+
+// one line of a divide: the perft of the position reached by a root move (or by a pair of moves, when dividing 2 levels deep)
+struct DivideResult
+{
+	ChessMove moves[2];
+	int nMoves{0};			// number of moves in moves[] (1 or 2)
+	bool lastInGroup{true};	// true if this is the last result for moves[0]
+	PerftInfo info;			// (just info.nMoves, when not collecting stats)
+};
+
+// Multi-Threaded divide: every root move (or every pair of moves, with levels = 2) is a task for a single thread pool
+// (split into smaller pieces of work, if there are fewer tasks than threads).
+// onResult() is called once per task, in move-generation order (serialised, as soon as all earlier tasks are done)
+void divideMT(ChessPosition P, int depth, int levels, bool collectStats, const std::function<void(const DivideResult&)>& onResult);
+
+// Monte-Carlo estimate of perft (see perftEstimateMT())
+struct PerftEstimate
+{
+	double estimate{0.0};
+	double standardError{0.0};
+	uint64_t samples{0};
+	double samplesPerSecond{0.0};
+};
+
+// Multi-Threaded Monte-Carlo (random-walk) estimator of perft, stratified by root move
+void perftEstimateMT(ChessPosition P, int depth, uint64_t samples, PerftEstimate& result);
+
 } //namespace juddperft
 
 #endif // _SEARCH_H
@@ -0,0 +1,317 @@
+/*
+
+MIT License
+
+Copyright(c) 2016-2025 Judd Niemann
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files(the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+
+#include "spilltable.h"
+#include "zobristkeyset.h"
+
+#if defined(HT_PERFT_SPILL_TABLE) && defined(HT_PERFT_DEPTH_TALLY)
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#if !defined(_MSC_VER)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace juddperft {
+
+namespace {
+
+struct SpillTableHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t recordSize;
+	uint64_t zobristSeed;
+	uint64_t entries;
+};
+
+constexpr char spillMagic[8] = "JPSPILL";
+constexpr uint32_t spillVersion = 1 + ((PerftRecord::VERIFY_BITS != 0) ? 1 : 0) + ((PerftRecord::GENERATION_BITS != 0) ? 2 : 0);	// (version 2: records carry verification bits; 3: a generation; 4: both)
+constexpr uint64_t SPILL_HEADER_BYTES = 65536;		// (the table itself starts on a page boundary)
+constexpr size_t SPILL_BATCH_RECORDS = 4096;		// records per batch handed to the writer
+constexpr size_t SPILL_MAX_QUEUED_BATCHES = 256;	// (16 MiB of records waiting to be written)
+
+HashTable<PerftRecord> spillTable("Perft spill table");
+std::string spillPath;
+uint64_t spillSeed{0};
+int spillMinDepth{DEFAULT_SPILL_MIN_DEPTH};
+
+// writer thread, and its queue of batches
+std::mutex queueMutex;
+std::condition_variable queueCv;
+std::deque<std::vector<PerftRecord>> queue;
+std::thread writer;
+bool stopWriter{false};
+bool writerRunning{false};
+std::atomic<unsigned int> generation{0};	// incremented on each attach / detach, so that stale batches are discarded
+
+std::atomic<uint64_t> nProbes{0};
+std::atomic<uint64_t> nHits{0};
+std::atomic<uint64_t> nSpilled{0};
+std::atomic<uint64_t> nDropped{0};
+
+void submit(std::vector<PerftRecord>&& records, unsigned int batchGeneration)
+{
+	std::lock_guard<std::mutex> lock(queueMutex);
+	if (!writerRunning || batchGeneration != generation) {
+		return;
+	}
+	if (queue.size() >= SPILL_MAX_QUEUED_BATCHES) {
+		nDropped += records.size();
+		return;
+	}
+	queue.push_back(std::move(records));
+	queueCv.notify_one();
+}
+
+// each thread collects its evicted records into a batch, which is handed to the writer when full (or when the thread exits)
+struct SpillBatch
+{
+	std::vector<PerftRecord> records;
+	unsigned int batchGeneration{0};
+
+	~SpillBatch() {
+		if (!records.empty()) {
+			submit(std::move(records), batchGeneration);
+		}
+	}
+};
+
+thread_local SpillBatch batch;
+
+// writeRecords() : a record replaces one of the same or lesser depth (or the same position)
+void writeRecords(const std::vector<PerftRecord>& records)
+{
+	for (const PerftRecord& r : records) {
+		std::atomic<PerftRecord>* p = spillTable.getAddress(r.hk);
+		const PerftRecord existing = p->load();
+		if (existing.hk == 0 || existing.hk == r.hk || existing.getDepth() <= r.getDepth()) {
+			p->store(r);
+		}
+	}
+	nSpilled += records.size();
+}
+
+void writerLoop()
+{
+	std::unique_lock<std::mutex> lock(queueMutex);
+	for (;;) {
+		queueCv.wait(lock, [] { return stopWriter || !queue.empty(); });
+		if (queue.empty()) {
+			break; // (stopping, and nothing left to write)
+		}
+		std::vector<PerftRecord> records = std::move(queue.front());
+		queue.pop_front();
+		lock.unlock();
+		writeRecords(records);
+		lock.lock();
+	}
+}
+
+} // namespace
+
+int SpillTable::minDepth = INT_MAX;
+
+bool SpillTable::attach(const std::string& path, size_t bytes, int minimumDepth)
+{
+	detach();
+
+#if !defined(_MSC_VER)
+	const int fd = open(path.c_str(), O_RDWR | O_CREAT, 0666);
+	if (fd < 0) {
+		return false;
+	}
+
+	struct stat st;
+	SpillTableHeader h;
+	memset(&h, 0, sizeof(h));
+	bool ok = (fstat(fd, &st) == 0);
+	const bool haveHeader = ok && (pread(fd, &h, sizeof(h), 0) == static_cast<ssize_t>(sizeof(h)));
+
+	uint64_t entries = 0;
+	if (bytes == 0) {
+		entries = haveHeader ? h.entries : 0;
+	} else {
+		for (entries = 1; entries * 2 * sizeof(PerftRecord) <= bytes; entries *= 2)
+			;
+	}
+
+	// keep the existing contents only if they are usable by this build, with the current zobrist keys
+	const bool reusable = haveHeader
+			&& (memcmp(h.magic, spillMagic, sizeof(h.magic)) == 0)
+			&& (h.version == spillVersion)
+			&& (h.recordSize == sizeof(PerftRecord))
+			&& (h.zobristSeed == zobristKeys.getSeed())
+			&& (h.entries == entries)
+			&& (static_cast<uint64_t>(st.st_size) >= SPILL_HEADER_BYTES + entries * sizeof(PerftRecord));
+
+	ok = ok && (entries != 0) && ((entries & (entries - 1)) == 0);
+	if (ok && !reusable) {
+		memset(&h, 0, sizeof(h));
+		memcpy(h.magic, spillMagic, sizeof(h.magic));
+		h.version = spillVersion;
+		h.recordSize = sizeof(PerftRecord);
+		h.zobristSeed = zobristKeys.getSeed();
+		h.entries = entries;
+		ok = (ftruncate(fd, 0) == 0)
+				&& (ftruncate(fd, static_cast<off_t>(SPILL_HEADER_BYTES + entries * sizeof(PerftRecord))) == 0)
+				&& (pwrite(fd, &h, sizeof(h), 0) == static_cast<ssize_t>(sizeof(h)));
+	}
+
+	ok = ok && spillTable.mapFile(fd, SPILL_HEADER_BYTES, entries, true);
+	close(fd);
+	if (!ok) {
+		return false;
+	}
+
+	// lookups are scattered all over the file: don't read ahead
+	madvise(spillTable.getAddress(0), spillTable.getSize(), MADV_RANDOM);
+
+	spillPath = path;
+	spillSeed = h.zobristSeed;
+	spillMinDepth = std::max(2, minimumDepth);
+	nProbes = nHits = nSpilled = nDropped = 0;
+	{
+		std::lock_guard<std::mutex> lock(queueMutex);
+		stopWriter = false;
+		writerRunning = true;
+		generation++;
+	}
+	writer = std::thread(writerLoop);
+	SpillTable::minDepth = spillMinDepth;
+
+	// make sure the writer is finished with before exit() (registered after the table was constructed, so runs before its destructor)
+	static const bool detachAtExit = (std::atexit([] { SpillTable::detach(); }) == 0);
+	(void)detachAtExit;
+	return true;
+#else
+	(void)path; (void)bytes; (void)minimumDepth;
+	return false;
+#endif
+}
+
+void SpillTable::detach()
+{
+	if (!isAttached()) {
+		return;
+	}
+
+	minDepth = INT_MAX;
+	{
+		std::lock_guard<std::mutex> lock(queueMutex);
+		stopWriter = true;
+		generation++;
+	}
+	queueCv.notify_one();
+	writer.join(); // (once the queue has been written)
+	{
+		std::lock_guard<std::mutex> lock(queueMutex);
+		writerRunning = false;
+	}
+	spillTable.deAllocate();
+	spillPath.clear();
+}
+
+bool SpillTable::isAttached()
+{
+	return writer.joinable();
+}
+
+std::string SpillTable::path()
+{
+	return spillPath;
+}
+
+size_t SpillTable::getSize()
+{
+	return spillTable.getSize();
+}
+
+SpillTableStats SpillTable::getStats()
+{
+	SpillTableStats stats;
+	stats.probes = nProbes;
+	stats.hits = nHits;
+	stats.spilled = nSpilled;
+	stats.dropped = nDropped;
+	return stats;
+}
+
+void SpillTable::checkSeed()
+{
+	if (isAttached() && zobristKeys.getSeed() != spillSeed) {
+		const std::string path = spillPath;
+		const size_t bytes = spillTable.getSize();
+		const int depth = spillMinDepth;
+		attach(path, bytes, depth); // (the header no longer matches, so the table starts empty)
+	}
+}
+
+bool SpillTable::probeSlow(HashKey hk, PerftRecord& record)
+{
+	nProbes.fetch_add(1, std::memory_order_relaxed);
+	const PerftRecord r = spillTable.getAddress(hk)->load();
+	if (r.hk != hk) {
+		return false;
+	}
+	nHits.fetch_add(1, std::memory_order_relaxed);
+	record = r;
+	return true;
+}
+
+void SpillTable::spill(const PerftRecord& record)
+{
+	const unsigned int g = generation.load(std::memory_order_relaxed);
+	if (batch.batchGeneration != g) {
+		batch.records.clear();
+		batch.batchGeneration = g;
+	}
+	if (batch.records.capacity() < SPILL_BATCH_RECORDS) {
+		batch.records.reserve(SPILL_BATCH_RECORDS);
+	}
+	batch.records.push_back(record);
+	if (batch.records.size() >= SPILL_BATCH_RECORDS) {
+		submit(std::move(batch.records), g);
+		batch.records = std::vector<PerftRecord>();
+	}
+}
+
+} // namespace juddperft
+
+#endif // defined(HT_PERFT_SPILL_TABLE) && defined(HT_PERFT_DEPTH_TALLY)
@@ -0,0 +1,115 @@
+/*
+
+MIT License
+
+Copyright(c) 2016-2025 Judd Niemann
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files(the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+
+//////////////////////////////////////////////
+// spilltable.h								//
+// Defines:									//
+// Secondary (disk-backed) perft table,		//
+// for records evicted from the RAM table	//
+//////////////////////////////////////////////
+
+#ifndef _SPILLTABLE_H
+#define _SPILLTABLE_H 1
+
+#include "tablegroup.h"
+
+#include <atomic>
+#include <climits>
+#include <cstdint>
+#include <string>
+
+namespace juddperft {
+
+// The RAM perft table is direct-mapped and always-replace, so a deep (expensive) record is simply lost when another
+// position lands in its slot. With a spill table attached, records of at least minDepth which are evicted from the RAM table
+// are collected (per thread, in batches) and written by a background thread to a much larger table in a memory-mapped file
+// (ideally on a local SSD), so that the search threads never wait for the disk when storing.
+// On a RAM miss at depth >= minDepth, the spill table is consulted (which may mean a read from disk),
+// and a record found there is promoted back into the RAM table.
+//
+// The file starts with a SpillTableHeader (padded to 64 KiB), which records the Zobrist seed and the record format;
+// if they don't match this build and session, the file's contents are discarded when it is attached.
+// Within the spill table, a record only replaces another one of the same or lesser depth.
+//
+// The evicted depth must be known, so the spill table requires HT_PERFT_DEPTH_TALLY.
+
+#if defined(HT_PERFT_SPILL_TABLE) && defined(HT_PERFT_DEPTH_TALLY)
+
+constexpr int DEFAULT_SPILL_MIN_DEPTH = 5;
+
+struct SpillTableStats
+{
+	uint64_t probes{0};		// RAM misses which consulted the spill table
+	uint64_t hits{0};
+	uint64_t spilled{0};	// records written to the spill table
+	uint64_t dropped{0};	// evicted records which were discarded because the writer couldn't keep up
+};
+
+class SpillTable
+{
+public:
+	// attach() : use (or create) a spill table of (up to) bytes bytes in the file at path. bytes = 0 means: use the
+	// existing file at its present size
+	static bool attach(const std::string& path, size_t bytes, int minimumDepth);
+	static void detach(); // (waits for outstanding writes)
+	static bool isAttached();
+	static std::string path();
+	static size_t getSize();
+	static SpillTableStats getStats();
+
+	// checkSeed() : discard the table's contents if the Zobrist seed has changed since it was attached
+	static void checkSeed();
+
+	// probe() : look for hk (a perft record key at depth) after a miss in the RAM table
+	static bool probe(HashKey hk, int depth, PerftRecord& record)
+	{
+		if (depth < minDepth) {
+			return false;
+		}
+		return probeSlow(hk, record);
+	}
+
+	// evicted() : a record has been displaced from the RAM table by a record with a different key
+	static void evicted(const PerftRecord& old, HashKey replacedBy)
+	{
+		if (old.getDepth() >= minDepth && old.hk != replacedBy && old.hk != 0) {
+			spill(old);
+		}
+	}
+
+private:
+	static bool probeSlow(HashKey hk, PerftRecord& record);
+	static void spill(const PerftRecord& record);
+
+	static int minDepth; // (INT_MAX when detached)
+};
+
+#endif // defined(HT_PERFT_SPILL_TABLE) && defined(HT_PERFT_DEPTH_TALLY)
+
+} // namespace juddperft
+
+#endif // _SPILLTABLE_H
@@ -0,0 +1,490 @@
+/*
+
+MIT License
+
+Copyright(c) 2016-2025 Judd Niemann
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files(the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include "spool.h"
+#include "extperft.h"
+#include "fen.h"
+#include "search.h"
+#include "utils.h"
+#include "zobristkeyset.h"
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+#if !defined(_MSC_VER)
+#include <unistd.h>
+#endif
+
+namespace juddperft {
+
+namespace fs = std::filesystem;
+
+using KeyValues = std::map<std::string, std::string>;
+
+struct SpoolUnit
+{
+	uint64_t multiplicity{0};
+	int depth{0};
+	std::string fen;
+};
+
+// readKeyValues() : read a file consisting of "<key> <value>" lines
+static bool readKeyValues(const fs::path& path, KeyValues& kv)
+{
+	FILE* f = fopen(path.string().c_str(), "r");
+	if (f == nullptr) {
+		return false;
+	}
+
+	char line[1024];
+	while (fgets(line, sizeof(line), f) != nullptr) {
+		line[strcspn(line, "\r\n")] = '\0';
+		const char* space = strchr(line, ' ');
+		if (space != nullptr) {
+			kv[std::string(line, space - line)] = space + 1;
+		}
+	}
+
+	fclose(f);
+	return !kv.empty();
+}
+
+// toNumber() : strict conversion of a decimal string
+static bool toNumber(const std::string& s, uint64_t& n)
+{
+	char* end = nullptr;
+	n = strtoull(s.c_str(), &end, 10);
+	return !s.empty() && *end == '\0';
+}
+
+// writeFileAtomically() : write contents to a file in tmpDir, make sure it's on disk, and then rename it into place,
+// so that nobody else ever sees a partly-written file
+static bool writeFileAtomically(const fs::path& tmpDir, const fs::path& path, const std::string& contents)
+{
+	const fs::path tmp = tmpDir / path.filename();
+	FILE* f = fopen(tmp.string().c_str(), "w");
+	if (f == nullptr) {
+		return false;
+	}
+
+	bool ok = (fwrite(contents.data(), 1, contents.size(), f) == contents.size());
+	ok = Utils::flushToDisk(f) && ok;
+	ok = (fclose(f) == 0) && ok;
+
+	std::error_code ec;
+	if (ok) {
+		fs::rename(tmp, path, ec);
+		ok = !ec;
+	}
+	if (!ok) {
+		fs::remove(tmp, ec);
+	}
+	return ok;
+}
+
+static std::string unitName(size_t unit)
+{
+	char s[32];
+	snprintf(s, sizeof(s), "%06zu", unit);
+	return s;
+}
+
+// unitOf() : the unit number from the name of a file in claimed/ or done/ (<unit>.<worker>)
+static bool unitOf(const fs::path& p, size_t& unit)
+{
+	const std::string name = p.filename().string();
+	uint64_t n;
+	if (!toNumber(name.substr(0, name.find('.')), n)) {
+		return false;
+	}
+	unit = n;
+	return true;
+}
+
+static std::vector<fs::path> listDirectory(const fs::path& dir)
+{
+	std::vector<fs::path> paths;
+	std::error_code ec;
+	for (fs::directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec)) {
+		paths.push_back(it->path());
+	}
+	return paths;
+}
+
+static std::string makeFen(const ChessPosition& P)
+{
+	char fen[1024] = {0};
+	writeFen(fen, &P);
+	return fen;
+}
+
+// makeUnits() : expand P breadth-first to frontierDepth, merging transpositions
+static std::vector<SpoolUnit> makeUnits(const ChessPosition& P, int depth, int frontierDepth)
+{
+	std::map<PackedPosition, uint64_t> level{{packPosition(P), 1}};
+	for (int d = 0; d < frontierDepth; d++) {
+		std::map<PackedPosition, uint64_t> next;
+		for (const auto& [packed, multiplicity] : level) {
+			const ChessPosition Q = unpackPosition(packed);
+			ChessMove movelist[MOVELIST_SIZE];
+			MoveGenerator::generateMoves(Q, movelist);
+			for (unsigned int i = 0; i < move_count(movelist); i++) {
+				ChessPosition R = Q;
+				R.performMove(movelist[i]).switchSides();
+				next[packPosition(R)] += multiplicity;
+			}
+		}
+		level.swap(next);
+	}
+
+	std::vector<SpoolUnit> units;
+	for (const auto& [packed, multiplicity] : level) {
+		units.push_back({multiplicity, depth - frontierDepth, makeFen(unpackPosition(packed))});
+	}
+	return units;
+}
+
+static bool loadUnits(const fs::path& path, std::vector<SpoolUnit>& units)
+{
+	FILE* f = fopen(path.string().c_str(), "r");
+	if (f == nullptr) {
+		return false;
+	}
+
+	char line[1024];
+	bool ok = true;
+	while (ok && fgets(line, sizeof(line), f) != nullptr) {
+		line[strcspn(line, "\r\n")] = '\0';
+		size_t unit;
+		SpoolUnit u;
+		int n = 0;
+		ok = (sscanf(line, "%zu %" SCNu64 " %d %n", &unit, &u.multiplicity, &u.depth, &n) == 3) && (n > 0) && (unit == units.size())
+				&& (u.depth >= 0) && (u.depth < PERFT_DEPTH_KEYS);
+		u.fen = line + n;
+		units.push_back(u);
+	}
+
+	fclose(f);
+	return ok && !units.empty();
+}
+
+bool coordinateSpool(const ChessPosition& P, int depth, const SpoolOptions& options, nodecount_t& nNodes)
+{
+	nNodes = 0;
+	if (depth < 2) {
+		printf("coordinate: depth must be at least 2\n");
+		return false;
+	}
+
+	const fs::path dir(options.spoolDir);
+	const fs::path todoDir = dir / "todo";
+	const fs::path claimedDir = dir / "claimed";
+	const fs::path doneDir = dir / "done";
+	const fs::path tmpDir = dir / "tmp";
+	const std::string fen = makeFen(P);
+
+	std::vector<SpoolUnit> units;
+	KeyValues job;
+	int timeoutSeconds = std::max(1, options.timeoutSeconds);
+	std::error_code ec;
+
+	if (readKeyValues(dir / "job.txt", job)) {
+		uint64_t jobDepth = 0;
+		uint64_t jobUnits = 0;
+		uint64_t jobTimeout = 0;
+		if (job["fen"] != fen || !toNumber(job["depth"], jobDepth) || static_cast<int>(jobDepth) != depth) {
+			printf("coordinate: %s holds a different job\n", options.spoolDir.c_str());
+			return false;
+		}
+		if (!toNumber(job["units"], jobUnits) || !loadUnits(dir / "units.txt", units) || units.size() != jobUnits) {
+			printf("coordinate: %s is damaged\n", options.spoolDir.c_str());
+			return false;
+		}
+		if (toNumber(job["timeout"], jobTimeout)) {
+			timeoutSeconds = static_cast<int>(std::max<uint64_t>(1, jobTimeout));
+		}
+		printf("coordinate: continuing existing job (%zu units)\n", units.size());
+	} else {
+		// (discard any leftovers from an incomplete setup)
+		for (const fs::path& d : {todoDir, claimedDir, doneDir, tmpDir}) {
+			fs::remove_all(d, ec);
+			fs::create_directories(d, ec);
+		}
+		fs::remove(dir / "result.txt", ec);
+
+		const int frontierDepth = std::max(1, std::min(options.frontierDepth, depth - 1));
+		units = makeUnits(P, depth, frontierDepth);
+
+		std::string unitList;
+		for (size_t i = 0; i < units.size(); i++) {
+			char prefix[64];
+			snprintf(prefix, sizeof(prefix), "%zu %" PRIu64 " %d ", i, units[i].multiplicity, units[i].depth);
+			unitList += prefix + units[i].fen + "\n";
+		}
+
+		bool ok = writeFileAtomically(tmpDir, dir / "units.txt", unitList);
+		for (size_t i = 0; ok && i < units.size(); i++) {
+			ok = writeFileAtomically(tmpDir, todoDir / unitName(i), "fen " + units[i].fen + "\ndepth " + std::to_string(units[i].depth) + "\n");
+		}
+
+		// job.txt goes last: the job only exists once everything else is in place
+		ok = ok && writeFileAtomically(tmpDir, dir / "job.txt",
+									   "juddperft-spool 1\nfen " + fen + "\ndepth " + std::to_string(depth) + "\nfrontier " + std::to_string(frontierDepth)
+									   + "\nunits " + std::to_string(units.size()) + "\ntimeout " + std::to_string(timeoutSeconds) + "\n");
+		if (!ok) {
+			printf("coordinate: unable to set up job in %s\n", options.spoolDir.c_str());
+			return false;
+		}
+		Utils::syncDirectory(dir.string());
+		printf("coordinate: %zu units (unique positions at depth %d)\n", units.size(), frontierDepth);
+	}
+
+	// collect results
+	std::vector<nodecount_t> results(units.size(), 0);
+	std::vector<char> haveResult(units.size(), 0);
+	std::set<std::string> workers;
+	std::set<fs::path> seen;
+	size_t nResults = 0;
+	bool mismatch = false;
+
+	while (nResults < units.size()) {
+		// (note: todo/ and claimed/ are listed before done/, so that a unit which completes during the scan is always seen somewhere)
+		std::vector<char> present(units.size(), 0);
+		for (const fs::path& p : listDirectory(todoDir)) {
+			size_t unit;
+			if (unitOf(p, unit) && unit < units.size()) {
+				present[unit] = 1;
+			}
+		}
+
+		const auto now = fs::file_time_type::clock::now();
+		for (const fs::path& p : listDirectory(claimedDir)) {
+			size_t unit;
+			if (!unitOf(p, unit) || unit >= units.size()) {
+				continue;
+			}
+			present[unit] = 1;
+			const auto lastHeard = fs::last_write_time(p, ec);
+			if (!ec && now - lastHeard > std::chrono::seconds(timeoutSeconds)) {
+				fs::rename(p, todoDir / unitName(unit), ec); // reassign (if the worker has finished in the meantime, the rename fails, which is fine)
+				if (!ec) {
+					printf("\ncoordinate: no heartbeat from %s; unit %s reassigned\n", p.filename().string().c_str(), unitName(unit).c_str());
+				}
+			}
+		}
+
+		for (const fs::path& p : listDirectory(doneDir)) {
+			if (seen.count(p)) {
+				continue;
+			}
+			seen.insert(p);
+
+			KeyValues kv;
+			uint64_t unit = 0;
+			uint64_t resultDepth = 0;
+			nodecount_t count = 0;
+			if (!readKeyValues(p, kv) || !toNumber(kv["unit"], unit) || unit >= units.size()
+					|| kv["fen"] != units[unit].fen || !toNumber(kv["depth"], resultDepth) || static_cast<int>(resultDepth) != units[unit].depth
+					|| !toNumber(kv["count"], count)) {
+				printf("\ncoordinate: ignoring invalid result %s\n", p.string().c_str());
+				continue;
+			}
+
+			workers.insert(kv["worker"]);
+			if (haveResult[unit]) {
+				if (results[unit] != count) {
+					printf("\ncoordinate: MISMATCH for unit %s (%s): %" PRIu64 " vs %" PRIu64 "\n", unitName(unit).c_str(), units[unit].fen.c_str(), results[unit], count);
+					mismatch = true;
+				}
+				continue;
+			}
+
+			results[unit] = count;
+			haveResult[unit] = 1;
+			nResults++;
+			printf("\rUnits done: %zu / %zu", nResults, units.size());
+			fflush(stdout);
+		}
+
+		// put back any unit which has gone missing (eg a worker rejected it)
+		for (size_t unit = 0; unit < units.size(); unit++) {
+			if (!haveResult[unit] && !present[unit]) {
+				writeFileAtomically(tmpDir, todoDir / unitName(unit), "fen " + units[unit].fen + "\ndepth " + std::to_string(units[unit].depth) + "\n");
+			}
+		}
+
+		if (nResults < units.size()) {
+			std::this_thread::sleep_for(std::chrono::seconds(1));
+		}
+	}
+
+	printf("\n");
+
+	if (mismatch) {
+		printf("coordinate: workers disagreed on at least one unit; not trusting the total\n");
+		return false;
+	}
+
+	for (size_t unit = 0; unit < units.size(); unit++) {
+		nNodes += results[unit] * units[unit].multiplicity;
+	}
+
+	printf("coordinate: %zu units done by %zu worker(s)\n", units.size(), workers.size());
+	writeFileAtomically(tmpDir, dir / "result.txt", "perft " + std::to_string(depth) + " " + std::to_string(nNodes) + "\n");
+	return true;
+}
+
+// defaultWorkerName() : <host>-<process id>
+static std::string defaultWorkerName()
+{
+#if !defined(_MSC_VER)
+	char host[256] = {0};
+	gethostname(host, sizeof(host) - 1);
+	return std::string(host) + "-" + std::to_string(getpid());
+#else
+	return "worker-" + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count());
+#endif
+}
+
+bool workSpool(const std::string& spoolDir, const std::string& workerName)
+{
+	const fs::path dir(spoolDir);
+	const fs::path todoDir = dir / "todo";
+	const fs::path claimedDir = dir / "claimed";
+	const fs::path doneDir = dir / "done";
+	const fs::path tmpDir = dir / "tmp";
+
+	// worker names become part of file names, so stick to a safe set of characters (and no dots)
+	std::string name = workerName.empty() ? defaultWorkerName() : workerName;
+	for (char& c : name) {
+		if (!isalnum(static_cast<unsigned char>(c)) && c != '-' && c != '_') {
+			c = '_';
+		}
+	}
+
+	KeyValues job;
+	if (!readKeyValues(dir / "job.txt", job)) {
+		printf("work: no job in %s\n", spoolDir.c_str());
+		return false;
+	}
+
+	uint64_t timeoutSeconds = 60;
+	toNumber(job["timeout"], timeoutSeconds);
+	const auto heartbeatInterval = std::chrono::seconds(std::max<uint64_t>(1, timeoutSeconds / 4));
+
+	size_t nUnits = 0;
+	std::error_code ec;
+	while (!fs::exists(dir / "result.txt", ec)) {
+		// claim a unit
+		fs::path claimed;
+		size_t unit = 0;
+		for (const fs::path& p : listDirectory(todoDir)) {
+			if (!unitOf(p, unit)) {
+				continue;
+			}
+			const fs::path target = claimedDir / (unitName(unit) + "." + name);
+			fs::last_write_time(p, fs::file_time_type::clock::now(), ec); // (so that the claim doesn't look stale straight away)
+			fs::rename(p, target, ec);
+			if (!ec) {
+				claimed = target;
+				break;
+			}
+		}
+
+		if (claimed.empty()) {
+			if (listDirectory(todoDir).empty() && listDirectory(claimedDir).empty()) {
+				break; // nothing left to do, or to wait for
+			}
+			std::this_thread::sleep_for(std::chrono::seconds(1)); // (another worker may yet fail, and have its unit reassigned)
+			continue;
+		}
+
+		KeyValues kv;
+		uint64_t depth = 0;
+		if (!readKeyValues(claimed, kv) || kv["fen"].empty() || !toNumber(kv["depth"], depth)) {
+			printf("work: unit %s is damaged\n", unitName(unit).c_str());
+			fs::remove(claimed, ec); // (the coordinator will replace it)
+			continue;
+		}
+
+		// keep the claim alive while working on it
+		std::mutex heartbeatMutex;
+		std::condition_variable cv;
+		bool finished = false;
+		std::thread heartbeat([&] {
+			std::unique_lock<std::mutex> lock(heartbeatMutex);
+			while (!cv.wait_for(lock, heartbeatInterval, [&] { return finished; })) {
+				std::error_code hec;
+				fs::last_write_time(claimed, fs::file_time_type::clock::now(), hec);
+			}
+		});
+
+		ChessPosition Q;
+		readFen(&Q, kv["fen"].c_str());
+		const auto start = std::chrono::steady_clock::now();
+		nodecount_t count = 0;
+		perftFastMT(Q, static_cast<int>(depth), count);
+		const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+		{
+			std::lock_guard<std::mutex> lock(heartbeatMutex);
+			finished = true;
+		}
+		cv.notify_one();
+		heartbeat.join();
+
+		char result[1024];
+		snprintf(result, sizeof(result), "unit %zu\nfen %s\ndepth %" PRIu64 "\ncount %" PRIu64 "\nworker %s\nms %.0f\n",
+				 unit, kv["fen"].c_str(), depth, count, name.c_str(), ms);
+		if (!writeFileAtomically(tmpDir, doneDir / (unitName(unit) + "." + name), result)) {
+			printf("work: unable to write result for unit %s\n", unitName(unit).c_str());
+			return false;
+		}
+		fs::remove(claimed, ec);
+
+		printf("Unit %s: %" PRIu64 " (%.0f ms)\n", unitName(unit).c_str(), count, ms);
+		fflush(stdout);
+		nUnits++;
+	}
+
+	printf("work: finished (%zu units done by %s)\n", nUnits, name.c_str());
+	return true;
+}
+
+} // namespace juddperft
@@ -0,0 +1,77 @@
+/*
+
+MIT License
+
+Copyright(c) 2016-2025 Judd Niemann
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files(the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+//////////////////////////////////////////////
+// spool.h									//
+// Defines:									//
+// Multi-process perft, co-ordinated		//
+// through a shared spool directory			//
+//////////////////////////////////////////////
+
+#ifndef _SPOOL_H
+#define _SPOOL_H 1
+
+#include "chessposition.h"
+#include "movegen.h"
+
+#include <string>
+
+namespace juddperft {
+
+// A spooled perft job is split into work units (the unique positions at the frontier depth, each with the number of paths
+// leading to it), which are picked up by any number of worker processes (on this machine, or any other machine which can
+// see the spool directory), and the results are collected by the coordinator.
+//
+// Spool directory layout:
+//
+// job.txt				juddperft-spool 1 / fen <fen> / depth <depth> / frontier <frontier depth> / units <n> / timeout <seconds>
+// units.txt			one line per unit: <unit> <multiplicity> <depth> <fen>
+// todo/<unit>			units waiting for a worker (contents: fen <fen> / depth <depth>)
+// claimed/<unit>.<worker>	units being worked on. A worker claims a unit by renaming it from todo/ (which only one worker
+//						can do), and keeps the file's modification time up-to-date while it is working on it
+// done/<unit>.<worker>	results (unit <unit> / fen <fen> / depth <depth> / count <count> / worker <worker> / ms <milliseconds>)
+// result.txt			perft <depth> <total> (written by the coordinator once all units are done)
+//
+// The coordinator puts a claimed unit back into todo/ if its worker hasn't been heard from for the timeout period.
+// If a unit ends up being done more than once, the results must agree.
+
+struct SpoolOptions
+{
+	std::string spoolDir;
+	int frontierDepth{1};		// 1 = one unit per root move
+	int timeoutSeconds{60};		// how long a worker can go without a heartbeat before its unit is reassigned
+};
+
+// coordinateSpool() : set up the job (or pick up an existing one for the same position and depth) and wait for the workers
+// to finish it. Returns false if there is a problem (including disagreeing results)
+bool coordinateSpool(const ChessPosition& P, int depth, const SpoolOptions& options, nodecount_t& nNodes);
+
+// workSpool() : do units from the spool directory, until there are none left
+bool workSpool(const std::string& spoolDir, const std::string& workerName = std::string());
+
+} // namespace juddperft
+
+#endif // _SPOOL_H
@@ -1,25 +1,124 @@
 #include "tablegroup.h"
+#include "engine.h"
+#include "search.h"
+#include "utils.h"
+#include "zobristkeyset.h"
+
+#include <cstdio>
+#include <cstring>
+
+#include <algorithm>
+#include <filesystem>
+#include <thread>
+#include <vector>
+
+#if !defined(_MSC_VER) && !defined(__EMSCRIPTEN__)
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 namespace juddperft {
 
-bool TableGroup::setMemory(size_t requestedBytes)
+// resizeTable() : (for setMemory() with keepRecords) resize a table, keeping its records
+static bool resizeTable(HashTable<PerftRecord>& table, size_t bytes)
+{
+	const unsigned int nThreads = std::min(std::thread::hardware_concurrency(), std::min(theEngine.nNumCores, static_cast<unsigned int>(MAX_THREADS)));
+	return table.resize(bytes, nThreads,
+		[](const PerftRecord& r, size_t) -> HashKey { return r.hk; },
+		[](const PerftRecord& a, const PerftRecord& b) {
+#if defined(HT_PERFT_DEPTH_TALLY)
+			return a.getDepth() > b.getDepth(); // keep the deepest record
+#else
+			return a.getCount() > b.getCount(); // keep the record with the biggest subtree
+#endif
+		});
+}
+
+static bool resizeTable(HashTable<PerftLeafRecord>& table, size_t bytes)
+{
+	// a leaf record holds the top bits of its hash key; the rest are the bottom bits of its slot number
+	// (hence the table must have at least LEAF_MIN_KEPT_ENTRIES entries for its records to be kept)
+	if (table.getNumRecords() < LEAF_MIN_KEPT_ENTRIES) {
+		return table.setSize(bytes);
+	}
+	const unsigned int nThreads = std::min(std::thread::hardware_concurrency(), std::min(theEngine.nNumCores, static_cast<unsigned int>(MAX_THREADS)));
+	return table.resize(bytes, nThreads,
+		[](PerftLeafRecord r, size_t slot) -> HashKey { return (r == 0) ? 0 : ((r & LEAF_HK_MASK) | (slot & ~LEAF_HK_MASK)); },
+		[](PerftLeafRecord, PerftLeafRecord) { return false; });
+}
+
+// halveTable() : (for halve()) halve a table in place, keeping its records
+static bool halveTable(HashTable<PerftRecord>& table)
+{
+	const unsigned int nThreads = std::min(std::thread::hardware_concurrency(), std::min(theEngine.nNumCores, static_cast<unsigned int>(MAX_THREADS)));
+	return table.halve(nThreads,
+		[](const PerftRecord& r, size_t) -> HashKey { return r.hk; },
+		[](const PerftRecord& a, const PerftRecord& b) {
+#if defined(HT_PERFT_DEPTH_TALLY)
+			return a.getDepth() > b.getDepth(); // keep the deepest record
+#else
+			return a.getCount() > b.getCount(); // keep the record with the biggest subtree
+#endif
+		});
+}
+
+static bool halveTable(HashTable<PerftLeafRecord>& table)
+{
+	const unsigned int nThreads = std::min(std::thread::hardware_concurrency(), std::min(theEngine.nNumCores, static_cast<unsigned int>(MAX_THREADS)));
+	const bool ok = table.halve(nThreads,
+		[](PerftLeafRecord r, size_t) -> HashKey { return r; },
+		[](PerftLeafRecord, PerftLeafRecord) { return false; });
+	if (ok && table.getNumRecords() < LEAF_MIN_KEPT_ENTRIES) {
+		table.clear(); // (the slot number no longer supplies the hash key bits missing from the records: see resizeTable())
+	}
+	return ok;
+}
+
+// chooseLeafRatio() : (since both tables are powers of 2 in size) choose the leaf : perft table ratio which makes the
+// most of requestedBytes, preferring 4:1 (then 2:1, 8:1, 1:1) where they are equally good
+static unsigned int chooseLeafRatio(size_t requestedBytes)
+{
+	unsigned int bestRatio = 4;
+	size_t bestTotal = 0;
+	for (unsigned int ratio : {4u, 2u, 8u, 1u}) {
+		for (size_t m = 1ull << 62; m > 1024; m >>= 1) {
+			if (m + m / ratio <= requestedBytes) {
+				if (m + m / ratio > bestTotal) {
+					bestTotal = m + m / ratio;
+					bestRatio = ratio;
+				}
+				break;
+			}
+		}
+	}
+	return bestRatio;
+}
+
+bool TableGroup::setMemory(size_t requestedBytes, bool keepRecords)
 {
 	static constexpr size_t bits = 8 * sizeof (size_t); // hopefully 64
 
+#if defined(HT_PERFT_LEAF_TABLE)
+	const size_t ratio = (leafRatio != 0) ? leafRatio : chooseLeafRatio(requestedBytes);
+#endif
+
 	size_t m = 0;
 	for (size_t i = 0; i < bits; i++) {
 		m = (1ull << (bits - i - 1)); // 1 << 63 .. 1 << 0
 
 #if defined(HT_PERFT_LEAF_TABLE)
-		size_t t = m + m / 4; // 4:1 ratio
-		if (t <= requestedBytes) {
-			if (perftLeafTable.setSize(m) && perftTable.setSize(m / 4)) {
+		size_t t = m + m / ratio;
+		if (t >= m && t <= requestedBytes) { // (t overflows when m = 1 << 63 and ratio = 1)
+			if (keepRecords ? (resizeTable(perftLeafTable, m) && resizeTable(perftTable, m / ratio)) : (perftLeafTable.setSize(m) && perftTable.setSize(m / ratio))) {
 				return true;
 			}
 		}
 #else
 		if (m <= requestedBytes) {
-			if (perftTable.setSize(m)) {
+			if (keepRecords ? resizeTable(perftTable, m) : perftTable.setSize(m)) {
 				return true;
 			}
 		}
@@ -33,6 +132,289 @@ bool TableGroup::setMemory(size_t requestedBytes)
 	return false;
 }
 
+bool TableGroup::halve()
+{
+#if defined(HT_PERFT_LEAF_TABLE)
+	return halveTable(perftLeafTable) && halveTable(perftTable);
+#else
+	return halveTable(perftTable);
+#endif
+}
+
+// Snapshot file format (version 3):
+// a TableSnapshotHeader, followed by the raw perft table at perftOffset, and then the raw leaf table (if any) at leafOffset.
+// The offsets are multiples of SNAPSHOT_ALIGNMENT, so that the tables can be memory-mapped straight from the file.
+
+struct TableSnapshotHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t recordFormat;		// see SNAPSHOT_FORMAT_xxx
+	uint64_t zobristSeed;
+	uint64_t perftRecordSize;
+	uint64_t perftEntries;
+	uint64_t perftOffset;
+	uint64_t leafRecordSize;
+	uint64_t leafEntries;
+	uint64_t leafOffset;
+};
+
+static constexpr char snapshotMagic[8] = "JPTABLE";
+static constexpr uint32_t snapshotVersion = 3;	// (version 3 added the extended depth form)
+static constexpr uint64_t SNAPSHOT_ALIGNMENT = 65536;	// (covers 4K, 16K and 64K pages)
+static constexpr uint32_t SNAPSHOT_FORMAT_DEPTH_TALLY = 1;	// PerftRecord is hk + (4-bit depth, 60-bit count)
+static constexpr uint32_t SNAPSHOT_FORMAT_EXTENDED_DEPTH = 8;	// ... or, for depth >= 15, the extended form (see PerftRecord)
+static constexpr uint32_t SNAPSHOT_FORMAT_LEAF_TABLE = 2;	// a leaf table is present
+static constexpr uint32_t SNAPSHOT_FORMAT_CANONICAL_HASH = 4;	// records are keyed by ChessPosition::getCanonicalHash()
+static constexpr uint32_t SNAPSHOT_FORMAT_VERIFY_KEY = 16;	// the top 16 bits of PerftRecord's count are verification bits
+static constexpr uint32_t SNAPSHOT_FORMAT_GENERATION = 32;	// perft records carry a 4-bit generation
+static constexpr uint32_t SNAPSHOT_FORMAT_LEAF_GENERATION = 64;	// leaf records are 52-bit hk + 4-bit generation + 8-bit count
+static constexpr size_t snapshotBlockRecords = 65536;
+
+static uint64_t alignUp(uint64_t n)
+{
+	return (n + SNAPSHOT_ALIGNMENT - 1) & ~(SNAPSHOT_ALIGNMENT - 1);
+}
+
+// writeTable() : copy each record out of the table atomically, and write in blocks, starting at offset
+template<class T>
+static bool writeTable(FILE* f, uint64_t offset, const HashTable<T>& table)
+{
+	// pad up to offset
+	static const char zeros[4096] = {0};
+	for (uint64_t pos = ftell(f); pos < offset; ) {
+		const size_t n = static_cast<size_t>(std::min<uint64_t>(sizeof(zeros), offset - pos));
+		if (fwrite(zeros, 1, n, f) != n) {
+			return false;
+		}
+		pos += n;
+	}
+
+	std::vector<T> block(snapshotBlockRecords);
+	const size_t n = table.getNumRecords();
+	for (size_t i = 0; i < n; i += snapshotBlockRecords) {
+		const size_t count = std::min(snapshotBlockRecords, n - i);
+		const std::atomic<T>* p = table.getAddress(i);
+		for (size_t j = 0; j < count; j++) {
+			block[j] = p[j].load();
+		}
+		if (fwrite(block.data(), sizeof(T), count, f) != count) {
+			return false;
+		}
+	}
+	return true;
+}
+
+#if defined(_MSC_VER)
+// readTable() : (for systems without mmap()) allocate the table, and read it in from offset
+template<class T>
+static bool readTable(FILE* f, uint64_t offset, uint64_t nEntries, HashTable<T>& table)
+{
+	if (!table.setSize(nEntries * sizeof(std::atomic<T>)) || table.getNumRecords() != nEntries || _fseeki64(f, offset, SEEK_SET) != 0) {
+		return false;
+	}
+
+	std::vector<T> block(snapshotBlockRecords);
+	for (size_t i = 0; i < nEntries; i += snapshotBlockRecords) {
+		const size_t count = std::min<size_t>(snapshotBlockRecords, nEntries - i);
+		if (fread(block.data(), sizeof(T), count, f) != count) {
+			return false;
+		}
+		std::atomic<T>* p = table.getAddress(i);
+		for (size_t j = 0; j < count; j++) {
+			p[j].store(block[j]);
+		}
+	}
+	return true;
+}
+#endif
+
+static TableSnapshotHeader currentSnapshotHeader()
+{
+	TableSnapshotHeader h;
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, snapshotMagic, sizeof(h.magic));
+	h.version = snapshotVersion;
+	h.zobristSeed = zobristKeys.getSeed();
+	h.perftRecordSize = sizeof(PerftRecord);
+	h.perftEntries = TableGroup::perftTable.getNumRecords();
+	h.perftOffset = alignUp(sizeof(TableSnapshotHeader));
+#if defined(HT_PERFT_DEPTH_TALLY)
+	h.recordFormat |= (SNAPSHOT_FORMAT_DEPTH_TALLY | SNAPSHOT_FORMAT_EXTENDED_DEPTH);
+#if defined(HT_PERFT_VERIFY_KEY)
+	h.recordFormat |= SNAPSHOT_FORMAT_VERIFY_KEY;
+#endif
+#endif
+#if defined(HT_PERFT_GENERATION_TAG)
+	h.recordFormat |= SNAPSHOT_FORMAT_GENERATION;
+#endif
+#if defined(CP_CANONICAL_HASH)
+	h.recordFormat |= SNAPSHOT_FORMAT_CANONICAL_HASH;
+#endif
+#if defined(HT_PERFT_LEAF_TABLE)
+	h.recordFormat |= (SNAPSHOT_FORMAT_LEAF_TABLE | SNAPSHOT_FORMAT_LEAF_GENERATION);
+	h.leafRecordSize = sizeof(PerftLeafRecord);
+	h.leafEntries = TableGroup::perftLeafTable.getNumRecords();
+	h.leafOffset = alignUp(h.perftOffset + h.perftEntries * h.perftRecordSize);
+#endif
+	return h;
+}
+
+// isUsableHeader() : check that a snapshot (or shared table file) of fileSize bytes is in the format that this build uses.
+// Files from older versions, or with a different record layout, can't be used (records can't be converted without their
+// positions), so they are rejected with an explanation
+static bool isUsableHeader(const TableSnapshotHeader& h, uint64_t fileSize)
+{
+	const TableSnapshotHeader expected = currentSnapshotHeader();
+	if (memcmp(h.magic, expected.magic, sizeof(h.magic)) != 0) {
+		return false;
+	}
+	if (h.version != expected.version || h.recordFormat != expected.recordFormat) {
+		printf("Hash table file is version %u, record format 0x%x; this build uses version %u, record format 0x%x "
+			   "(the file must be rebuilt, or used by a matching build)\n",
+			   h.version, h.recordFormat, expected.version, expected.recordFormat);
+		return false;
+	}
+	return (h.perftRecordSize == expected.perftRecordSize)
+			&& (h.leafRecordSize == expected.leafRecordSize)
+			&& (h.perftEntries != 0) && ((h.perftEntries & (h.perftEntries - 1)) == 0)
+			&& ((h.leafEntries & (h.leafEntries - 1)) == 0)
+			&& (h.perftOffset % SNAPSHOT_ALIGNMENT == 0) && (h.leafOffset % SNAPSHOT_ALIGNMENT == 0)
+			&& (fileSize >= h.perftOffset + h.perftEntries * h.perftRecordSize)
+			&& (fileSize >= h.leafOffset + h.leafEntries * h.leafRecordSize);
+}
+
+bool TableGroup::saveSnapshot(const std::string& path)
+{
+	// write to a temporary file, and rename into place once it is safely on disk
+	const std::string tmp = path + ".tmp";
+	FILE* f = fopen(tmp.c_str(), "wb");
+	if (f == nullptr) {
+		return false;
+	}
+
+	const TableSnapshotHeader h = currentSnapshotHeader();
+	bool ok = (fwrite(&h, sizeof(h), 1, f) == 1) && writeTable(f, h.perftOffset, perftTable);
+#if defined(HT_PERFT_LEAF_TABLE)
+	ok = ok && writeTable(f, h.leafOffset, perftLeafTable);
+#endif
+	ok = ok && Utils::flushToDisk(f);
+	ok = (fclose(f) == 0) && ok;
+
+	std::error_code ec;
+	if (ok) {
+		std::filesystem::rename(tmp, path, ec);
+		ok = !ec;
+	}
+	if (!ok) {
+		std::filesystem::remove(tmp, ec);
+		return false;
+	}
+
+	Utils::syncDirectory(std::filesystem::path(path).parent_path().string());
+	return true;
+}
+
+bool TableGroup::loadSnapshot(const std::string& path)
+{
+	FILE* f = fopen(path.c_str(), "rb");
+	if (f == nullptr) {
+		return false;
+	}
+
+	TableSnapshotHeader h;
+	std::error_code ec;
+	const uint64_t fileSize = std::filesystem::file_size(path, ec);
+	bool ok = (fread(&h, sizeof(h), 1, f) == 1) && !ec && isUsableHeader(h, fileSize);
+
+	if (ok) {
+		const size_t previousBytes = perftTable.getSize() + perftLeafTable.getSize();
+
+		// the tables take on the size recorded in the snapshot
+#if !defined(_MSC_VER)
+		// map copy-on-write: records are paged in from the file on demand, so the tables are usable straight away
+		ok = perftTable.mapFile(fileno(f), h.perftOffset, h.perftEntries, false);
+#if defined(HT_PERFT_LEAF_TABLE)
+		ok = ok && perftLeafTable.mapFile(fileno(f), h.leafOffset, h.leafEntries, false);
+#endif
+#else
+		ok = readTable(f, h.perftOffset, h.perftEntries, perftTable);
+#if defined(HT_PERFT_LEAF_TABLE)
+		ok = ok && readTable(f, h.leafOffset, h.leafEntries, perftLeafTable);
+#endif
+#endif
+		if (ok) {
+			zobristKeys.setSeed(h.zobristSeed);
+		} else {
+			setMemory(previousBytes); // (put back some empty tables)
+		}
+	}
+
+	fclose(f);
+	return ok;
+}
+
+// Shared tables use the snapshot file format, except that the tables are mapped read/write and shared (MAP_SHARED),
+// so that every process which attaches to the same file sees (and adds to) the same records.
+// The records are only ever accessed atomically (in the same way as when several threads share the tables),
+// so no further locking is needed, provided that the atomics are lock-free (which, for the 16-byte PerftRecord on x86-64,
+// means cmpxchg16b; hence -mcx16). flock() serialises the creation of the header, so that only one process initialises it.
+
+bool TableGroup::attachShared(const std::string& name)
+{
+#if !defined(_MSC_VER) && !defined(__EMSCRIPTEN__)
+	const bool isFile = (name.find('/') != std::string::npos);
+	const int fd = isFile ? open(name.c_str(), O_RDWR | O_CREAT, 0666) : shm_open(("/" + name).c_str(), O_RDWR | O_CREAT, 0666);
+	if (fd < 0) {
+		return false;
+	}
+
+	flock(fd, LOCK_EX);
+
+	TableSnapshotHeader h;
+	struct stat st;
+	bool ok = (fstat(fd, &st) == 0);
+	if (ok && st.st_size == 0) {
+		// first process to attach: size the file to fit tables like ours, which are initially empty (all zeros)
+		h = currentSnapshotHeader();
+		const uint64_t bytes = std::max(h.perftOffset + h.perftEntries * h.perftRecordSize, h.leafOffset + h.leafEntries * h.leafRecordSize);
+		ok = (ftruncate(fd, static_cast<off_t>(bytes)) == 0)
+				&& (pwrite(fd, &h, sizeof(h), 0) == static_cast<ssize_t>(sizeof(h)));
+	} else {
+		ok = ok && (pread(fd, &h, sizeof(h), 0) == static_cast<ssize_t>(sizeof(h)))
+				&& isUsableHeader(h, static_cast<uint64_t>(st.st_size));
+	}
+
+	if (ok) {
+		const size_t previousBytes = perftTable.getSize() + perftLeafTable.getSize();
+		ok = perftTable.mapFile(fd, h.perftOffset, h.perftEntries, true);
+#if defined(HT_PERFT_LEAF_TABLE)
+		ok = ok && perftLeafTable.mapFile(fd, h.leafOffset, h.leafEntries, true);
+#endif
+		if (ok) {
+			zobristKeys.setSeed(h.zobristSeed);
+		} else {
+			setMemory(previousBytes); // (put back some private tables)
+		}
+	}
+
+	flock(fd, LOCK_UN);
+	close(fd);
+	return ok;
+#else
+	(void)name;
+	return false;
+#endif
+}
+
+void TableGroup::newGeneration()
+{
+	generation++;
+}
+
+std::mutex TableGroup::useMutex;
+unsigned int TableGroup::generation = 0;
+unsigned int TableGroup::leafRatio = 0;
 HashTable <PerftRecord> TableGroup::perftTable("Perft table");
 HashTable <PerftLeafRecord> TableGroup::perftLeafTable("Perft leaf node table");
 
@@ -3,11 +3,18 @@
 
 #include "hash_table.h"
 
+#include <mutex>
+#include <string>
+
 // tablegroup.h : container for owning and managing a collection of various hash tables,
 // and controlling how all the memory is divided-up and allocated
 
 #define HT_PERFT_DEPTH_TALLY
 #define HT_PERFT_LEAF_TABLE
+#define HT_PERFT_SPILL_TABLE		// allow deep records evicted from the perft table to be kept in a disk-backed table (see spilltable.h)
+#define HT_PERFT_TABLE_STATS		// keep per-thread counts of table probes, hits, stores etc (see tablestats.h)
+// #define HT_PERFT_VERIFY_KEY		// reserve 16 bits of each perft record's count for a verification key (see hashverifier.h; requires HT_PERFT_DEPTH_TALLY)
+// #define HT_PERFT_GENERATION_TAG	// reserve 4 bits of each perft record's count for the generation in which it was written (see showhash; requires HT_PERFT_DEPTH_TALLY)
 
 namespace juddperft {
 
@@ -16,32 +23,159 @@ struct PerftRecord
 	HashKey hk;
 
 #ifdef HT_PERFT_DEPTH_TALLY
-	// 60 bits of nodecount + 4 bits of depth
-	union {
-		struct {
-			// warning: limitations are: max depth = 15, max count = 2^60 = 1,152,921,504,606,846,976
-			// which only allows up to perft 12 from start position
-			uint64_t depth : 4;
-			uint64_t count : 60;
-		};
-		uint64_t data{0};
-	};
+	// depth and nodecount, packed into 64 bits (use the accessors below):
+	// compact form (depth < 15): 4 bits of depth + 60 bits of nodecount (max count = 2^60 - 1)
+	// extended form (depth >= 15): 4 bits = 15, then 6 bits of (depth - 15) + 54 bits of nodecount (max count = 2^54 - 1)
+	// The compact form is all that is needed up to perft 12 from the start position. Beyond that, the subtrees nearest the root
+	// have too many nodes for a record, and are simply not stored (see set()); deeper records only fit for positions with few moves
+	// (eg endgames), so the extended form trades count bits for depth bits.
+	// Optionally, the top bits of the count are taken for tags: the top VERIFY_BITS bits hold the top bits of the position's
+	// verification key (with HT_PERFT_VERIFY_KEY), and the GENERATION_BITS bits below them hold the generation in which the record
+	// was written (with HT_PERFT_GENERATION_TAG; see TableGroup::generation). With both, the compact form covers perft 9 from the
+	// start position.
+	uint64_t data{0};
+
+#ifdef HT_PERFT_VERIFY_KEY
+	static constexpr int VERIFY_BITS = 16;
+#else
+	static constexpr int VERIFY_BITS = 0;
+#endif
+#ifdef HT_PERFT_GENERATION_TAG
+	static constexpr int GENERATION_BITS = 4;
+#else
+	static constexpr int GENERATION_BITS = 0;
+#endif
+	static constexpr int GENERATION_SHIFT = 64 - VERIFY_BITS - GENERATION_BITS; // (also: the number of bits left for depth + count)
+	static constexpr uint64_t VERIFY_MASK = ~(~0ull >> VERIFY_BITS);
+	static constexpr uint64_t GENERATION_MASK = (GENERATION_BITS == 0) ? 0 : ((1ull << GENERATION_BITS) - 1) << (GENERATION_SHIFT % 64);
+	static constexpr uint64_t TAG_MASK = VERIFY_MASK | GENERATION_MASK;
+
+	int getDepth() const
+	{
+		const int d = static_cast<int>(data & 0xf);
+		return (d < 15) ? d : 15 + static_cast<int>((data >> 4) & 0x3f);
+	}
+
+	uint64_t getCount() const
+	{
+		return ((data & 0xf) < 15) ? ((data & ~TAG_MASK) >> 4) : ((data & ~TAG_MASK) >> 10);
+	}
+
+	unsigned int getGeneration() const
+	{
+		return static_cast<unsigned int>((data & GENERATION_MASK) >> (GENERATION_SHIFT % 64));
+	}
+
+	// verifies() : whether the record's verification bits match verification key vk
+	bool verifies(uint64_t vk) const
+	{
+		return ((data ^ vk) & VERIFY_MASK) == 0;
+	}
+
+	// set() : set depth, count, verification key and generation; returns false (leaving the record unchanged) if count doesn't fit
+	bool set(int depth, uint64_t count, uint64_t vk, unsigned int generation)
+	{
+		if (depth < 15) {
+			if (count >> (GENERATION_SHIFT - 4)) {
+				return false;
+			}
+			data = (count << 4) | static_cast<uint64_t>(depth);
+		} else {
+			if ((count >> (GENERATION_SHIFT - 10)) || depth > 15 + 0x3f) {
+				return false;
+			}
+			data = (count << 10) | (static_cast<uint64_t>(depth - 15) << 4) | 0xf;
+		}
+		data |= (vk & VERIFY_MASK) | ((static_cast<uint64_t>(generation) << (GENERATION_SHIFT % 64)) & GENERATION_MASK);
+		return true;
+	}
 #else
 	// 64 bits of nodecount
 	uint64_t count{0};
+
+	static constexpr int VERIFY_BITS = 0; // (no room for verification bits, or a generation)
+	static constexpr int GENERATION_BITS = 0;
+
+	int getDepth() const
+	{
+		return 0;
+	}
+
+	uint64_t getCount() const
+	{
+		return count;
+	}
+
+	unsigned int getGeneration() const
+	{
+		return 0;
+	}
+
+	bool verifies(uint64_t vk) const
+	{
+		(void)vk;
+		return true;
+	}
+
+	bool set(int depth, uint64_t n, uint64_t vk, unsigned int generation)
+	{
+		(void)depth; (void)vk; (void)generation;
+		count = n;
+		return true;
+	}
 #endif
 
 };
 
-// for leaf nodes, we can simply cram the upper 56 bits of the hashkey and 8 bits of movecount into 64 bits
+// for leaf nodes, we can simply cram the upper 52 bits of the hashkey, a 4-bit generation and 8 bits of movecount into 64 bits
+// (the bottom 12 bits of the hashkey are the bottom 12 bits of the slot number, so in tables of at least 4096 entries, nothing is lost).
+// The generation costs nothing here, so leaf records always carry it (unlike perft records: see HT_PERFT_GENERATION_TAG).
 // limitation: cannot handle more than 255 legal moves, if that is even possible (accepted max seems to be 218)
 using PerftLeafRecord = uint64_t;
+constexpr uint64_t LEAF_HK_MASK = 0xfffffffffffff000;
+constexpr uint64_t LEAF_GENERATION_MASK = 0x0000000000000f00;
+constexpr int LEAF_GENERATION_SHIFT = 8;
+constexpr size_t LEAF_MIN_KEPT_ENTRIES = ~LEAF_HK_MASK + 1; // (the smallest table whose slot numbers supply the rest of the hashkey)
+constexpr uint64_t LEAF_COUNT_MASK = 0x00000000000000ff;
 
 
 class TableGroup
 {
 public:
-	static bool setMemory(size_t requestedBytes);
+	// setMemory() : (re)allocate the tables, using no more than requestedBytes in total.
+	// If keepRecords, the existing records are rehashed into the new tables (as many as will fit); otherwise, the tables start empty
+	static bool setMemory(size_t requestedBytes, bool keepRecords = false);
+
+	// halve() : halve both tables in place, keeping as many records as will fit (without allocating anything, unlike setMemory())
+	static bool halve();
+
+	// leafRatio : size of the leaf table relative to the perft table (a power of 2, from 1 to 16),
+	// or 0 to choose whichever ratio makes the most of the memory available (see setMemory())
+	static unsigned int leafRatio;
+
+	// snapshots: the raw contents of all tables, preceded by a versioned header recording the record format, the table sizes,
+	// and the Zobrist seed (see tablegroup.cpp).
+	// saveSnapshot() may be called while a perft is in progress (each record is copied atomically).
+	// loadSnapshot() replaces the tables with the snapshot's tables (memory-mapped copy-on-write, where possible),
+	// and adopts the snapshot's Zobrist seed (so any hash keys calculated beforehand must be recalculated).
+	static bool saveSnapshot(const std::string& path);
+	static bool loadSnapshot(const std::string& path);
+
+	// attachShared() : replace the tables with tables shared with any other process attached to the same name
+	// (a POSIX shared memory object if name contains no '/', otherwise a file).
+	// If name doesn't exist yet, it is created with the same sizes as the current tables, and the current Zobrist seed;
+	// otherwise, the tables take on its sizes, and its Zobrist seed (so hash keys must be recalculated, as for loadSnapshot()).
+	// The shared tables are detached by the next setMemory() or loadSnapshot()
+	static bool attachShared(const std::string& name);
+
+	// generation : advanced whenever the root position changes, so that records written while searching from earlier positions
+	// can be told apart (as "stale") from the current ones (the bottom 4 bits are kept in leaf records, and with
+	// HT_PERFT_GENERATION_TAG, in perft records too; see showhash)
+	static unsigned int generation;
+	static void newGeneration();
+
+	// useMutex is held while the tables are in use (ie while a command is running), so that they aren't resized underneath a search
+	static std::mutex useMutex;
 
 	static HashTable <PerftRecord> perftTable;
 	static HashTable <PerftLeafRecord> perftLeafTable;
@@ -0,0 +1,409 @@
+/*
+
+MIT License
+
+Copyright(c) 2016-2025 Judd Niemann
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files(the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+
+#include "tablestats.h"
+#include "engine.h"
+#include "search.h"
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+namespace juddperft {
+
+namespace {
+
+// bitLength() : the number of bits needed to hold x
+inline int bitLength(uint64_t x)
+{
+#if defined(_MSC_VER)
+	unsigned long i;
+	return _BitScanReverse64(&i, x) ? static_cast<int>(i) + 1 : 0;
+#else
+	return x ? 64 - __builtin_clzll(x) : 0;
+#endif
+}
+
+// scanTable() : tally each slot examined (see TableStats::scanPerftTable()) into a TableOccupancy, using tally(record, occupancy)
+template<typename T, typename F>
+TableOccupancy scanTable(const HashTable<T>& table, uint64_t samples, F tally)
+{
+	static constexpr uint64_t chunkSize = 65536;
+
+	const uint64_t slots = table.getNumRecords();
+	const bool sampled = (samples != 0 && samples < slots);
+	const uint64_t n = sampled ? samples : slots;
+	const uint64_t nChunks = (n + chunkSize - 1) / chunkSize;
+	std::atomic<T>* base = table.getAddress(0);
+
+	const unsigned int nThreads = std::max(1u, std::min(std::thread::hardware_concurrency(), std::min(theEngine.nNumCores, static_cast<unsigned int>(MAX_THREADS))));
+	std::vector<TableOccupancy> partial(nThreads);
+	std::atomic<uint64_t> nextChunk{0};
+	std::atomic<uint64_t> chunksDone{0};
+	std::mutex progressMutex;
+	uint64_t progressDots = 0;
+
+	printf("tallying");
+	std::vector<std::thread> threads;
+	for (unsigned int t = 0; t < nThreads; t++) {
+		threads.emplace_back([&, t] {
+			TableOccupancy& o = partial[t];
+			for (uint64_t c = nextChunk++; c < nChunks; c = nextChunk++) {
+				const uint64_t begin = c * chunkSize;
+				const uint64_t end = std::min(n, begin + chunkSize);
+				std::mt19937_64 rng(c); // (each chunk has its own sequence, so that the sample doesn't depend on the number of threads)
+				for (uint64_t i = begin; i < end; i++) {
+					const uint64_t slot = sampled ? (rng() & (slots - 1)) : i; // (slots is a power of 2)
+					tally(base[slot].load(std::memory_order_relaxed), o);
+				}
+				o.examined += end - begin;
+
+				// show progress (in tenths)
+				const uint64_t done = ++chunksDone;
+				std::lock_guard<std::mutex> lock(progressMutex);
+				while (progressDots < done * 10 / nChunks) {
+					printf(".");
+					progressDots++;
+				}
+			}
+		});
+	}
+	for (auto& th : threads) {
+		th.join();
+	}
+	printf("\n");
+
+	TableOccupancy total;
+	for (const TableOccupancy& o : partial) {
+		total += o;
+	}
+	total.slots = slots;
+	return total;
+}
+
+} // namespace
+
+TableOccupancy& TableOccupancy::operator+=(const TableOccupancy& o)
+{
+	examined += o.examined;
+	occupied += o.occupied;
+	stale += o.stale;
+	for (int d = 0; d < PERFT_DEPTH_KEYS; d++) {
+		depths[d] += o.depths[d];
+	}
+	for (int b = 0; b < 65; b++) {
+		counts[b] += o.counts[b];
+	}
+	return *this;
+}
+
+TableOccupancy TableStats::scanPerftTable(uint64_t samples)
+{
+	const unsigned int generationMask = (1u << PerftRecord::GENERATION_BITS) - 1;
+	const unsigned int generation = TableGroup::generation & generationMask;
+	return scanTable(TableGroup::perftTable, samples, [=](const PerftRecord& r, TableOccupancy& o) {
+		if (r.hk != 0) {
+			o.occupied++;
+			o.depths[std::min(r.getDepth(), PERFT_DEPTH_KEYS - 1)]++;
+			o.counts[bitLength(r.getCount())]++;
+			if (r.getGeneration() != generation) {
+				o.stale++;
+			}
+		}
+	});
+}
+
+TableOccupancy TableStats::scanLeafTable(uint64_t samples)
+{
+	const uint64_t generation = TableGroup::generation & (LEAF_GENERATION_MASK >> LEAF_GENERATION_SHIFT);
+	return scanTable(TableGroup::perftLeafTable, samples, [=](PerftLeafRecord r, TableOccupancy& o) {
+		if (r != 0) {
+			o.occupied++;
+			o.depths[1]++;
+			o.counts[bitLength(r & LEAF_COUNT_MASK)]++;
+			if (((r & LEAF_GENERATION_MASK) >> LEAF_GENERATION_SHIFT) != generation) {
+				o.stale++;
+			}
+		}
+	});
+}
+
+#if defined(HT_PERFT_TABLE_STATS)
+
+namespace {
+
+std::mutex registryMutex;
+std::vector<const TableCounters*> liveCounters;
+TableCounts finishedCounts[STATS_TABLES][PERFT_DEPTH_KEYS];	// (threads which have exited)
+TableCounts baselineCounts[STATS_TABLES][PERFT_DEPTH_KEYS];	// (the counts at the last reset())
+
+// each thread's counters are registered for as long as the thread exists
+struct ThreadRegistration
+{
+	TableCounters counters;
+
+	ThreadRegistration() {
+		std::lock_guard<std::mutex> lock(registryMutex);
+		liveCounters.push_back(&counters);
+	}
+
+	~ThreadRegistration() {
+		std::lock_guard<std::mutex> lock(registryMutex);
+		counters.addTo(finishedCounts);
+		liveCounters.erase(std::find(liveCounters.begin(), liveCounters.end(), &counters));
+	}
+};
+
+// getRawCounts() : the counts since the program started (registryMutex must be held)
+void getRawCounts(TableCounts counts[STATS_TABLES][PERFT_DEPTH_KEYS])
+{
+	std::copy(&finishedCounts[0][0], &finishedCounts[0][0] + STATS_TABLES * PERFT_DEPTH_KEYS, &counts[0][0]);
+	for (const TableCounters* c : liveCounters) {
+		c->addTo(counts);
+	}
+}
+
+uint64_t totalProbes()
+{
+	TableCounts counts[STATS_TABLES][PERFT_DEPTH_KEYS];
+	TableStats::getCounts(counts);
+	uint64_t n = 0;
+	for (int t = 0; t < STATS_TABLES; t++) {
+		for (int d = 0; d < PERFT_DEPTH_KEYS; d++) {
+			n += counts[t][d].probes;
+		}
+	}
+	return n;
+}
+
+void printRow(const char* depth, const TableCounts& c)
+{
+	printf("%6s %15" PRIu64 " %15" PRIu64 " %6.2f %15" PRIu64 " %12" PRIu64 " %12" PRIu64 "\n",
+		   depth, c.probes, c.hits, c.probes ? 100.0 * c.hits / c.probes : 0.0, c.stores, c.overwrites, c.casRetries);
+}
+
+// reporter thread
+std::thread reporter;
+std::mutex reporterMutex;
+std::condition_variable reporterCv;
+bool stopping{false};
+unsigned int reportInterval{0};
+uint64_t probesAtLastReport{0};
+
+// reportIfChanged() : print the counts, if there have been any probes since they were last printed (reporterMutex must be held)
+void reportIfChanged()
+{
+	const uint64_t probes = totalProbes();
+	if (probes != probesAtLastReport) {
+		probesAtLastReport = probes;
+		printf("\n");
+		TableStats::print();
+	}
+}
+
+void reporterLoop()
+{
+	std::unique_lock<std::mutex> lock(reporterMutex);
+	while (!reporterCv.wait_for(lock, std::chrono::seconds(reportInterval), [] { return stopping; })) {
+		reportIfChanged();
+	}
+}
+
+} // namespace
+
+void TableCounters::addTo(TableCounts counts[STATS_TABLES][PERFT_DEPTH_KEYS]) const
+{
+	for (int t = 0; t < STATS_TABLES; t++) {
+		for (int d = 0; d < PERFT_DEPTH_KEYS; d++) {
+			const Counters& from = c[t][d];
+			TableCounts& to = counts[t][d];
+			to.hits += from.hits.load(std::memory_order_relaxed);
+			to.probes += from.hits.load(std::memory_order_relaxed) + from.misses.load(std::memory_order_relaxed);
+			to.stores += from.stores.load(std::memory_order_relaxed);
+			to.overwrites += from.overwrites.load(std::memory_order_relaxed);
+			to.casRetries += from.casRetries.load(std::memory_order_relaxed);
+		}
+	}
+}
+
+TableCounters& TableStats::attachThread()
+{
+	thread_local ThreadRegistration registration;
+	counters = &registration.counters;
+	return *counters;
+}
+
+void TableStats::getCounts(TableCounts counts[STATS_TABLES][PERFT_DEPTH_KEYS])
+{
+	std::lock_guard<std::mutex> lock(registryMutex);
+	getRawCounts(counts);
+	for (int t = 0; t < STATS_TABLES; t++) {
+		for (int d = 0; d < PERFT_DEPTH_KEYS; d++) {
+			const TableCounts& b = baselineCounts[t][d];
+			TableCounts& c = counts[t][d];
+			c.probes -= b.probes;
+			c.hits -= b.hits;
+			c.stores -= b.stores;
+			c.overwrites -= b.overwrites;
+			c.casRetries -= b.casRetries;
+		}
+	}
+}
+
+void TableStats::reset()
+{
+	{
+		std::lock_guard<std::mutex> lock(registryMutex);
+		getRawCounts(baselineCounts);
+	}
+	std::lock_guard<std::mutex> lock(reporterMutex);
+	probesAtLastReport = 0;
+}
+
+void TableStats::print()
+{
+	TableCounts counts[STATS_TABLES][PERFT_DEPTH_KEYS];
+	getCounts(counts);
+
+	static const char* const tableNames[STATS_TABLES] = {"Perft table", "Perft leaf table"};
+	bool any = false;
+	for (int t = 0; t < STATS_TABLES; t++) {
+		TableCounts total;
+		for (int d = 0; d < PERFT_DEPTH_KEYS; d++) {
+			total.probes += counts[t][d].probes;
+			total.hits += counts[t][d].hits;
+			total.stores += counts[t][d].stores;
+			total.overwrites += counts[t][d].overwrites;
+			total.casRetries += counts[t][d].casRetries;
+		}
+		if (total.probes == 0 && total.stores == 0) {
+			continue;
+		}
+		any = true;
+
+		printf("%s:\n%6s %15s %15s %6s %15s %12s %12s\n", tableNames[t], "depth", "probes", "hits", "hit%", "stores", "overwrites", "CAS retries");
+		for (int d = 0; d < PERFT_DEPTH_KEYS; d++) {
+			if (counts[t][d].probes != 0 || counts[t][d].stores != 0) {
+				char depth[8];
+				snprintf(depth, sizeof(depth), "%d", d);
+				printRow(depth, counts[t][d]);
+			}
+		}
+		printRow("all", total);
+	}
+
+	if (!any) {
+		printf("No hash table activity since the statistics were last reset\n");
+	}
+}
+
+void TableStats::startReporting(unsigned int intervalSeconds)
+{
+	stopReporting();
+
+	reportInterval = std::max(intervalSeconds, 1u);
+	stopping = false;
+	probesAtLastReport = totalProbes();
+	reporter = std::thread(reporterLoop);
+
+	// make sure the reporter is finished with before exit()
+	static const bool stopAtExit = (std::atexit([] { TableStats::stopReporting(); }) == 0);
+	(void)stopAtExit;
+}
+
+void TableStats::stopReporting()
+{
+	if (!reporter.joinable()) {
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(reporterMutex);
+		stopping = true;
+	}
+	reporterCv.notify_one();
+	reporter.join();
+}
+
+bool TableStats::isReporting()
+{
+	return reporter.joinable();
+}
+
+void TableStats::commandFinished()
+{
+	if (isReporting()) {
+		std::lock_guard<std::mutex> lock(reporterMutex);
+		reportIfChanged();
+	}
+}
+
+#else
+
+void TableStats::getCounts(TableCounts counts[STATS_TABLES][PERFT_DEPTH_KEYS])
+{
+	std::fill(&counts[0][0], &counts[0][0] + STATS_TABLES * PERFT_DEPTH_KEYS, TableCounts());
+}
+
+void TableStats::reset()
+{
+}
+
+void TableStats::print()
+{
+	printf("Table statistics are not available in this build (requires HT_PERFT_TABLE_STATS)\n");
+}
+
+void TableStats::startReporting(unsigned int intervalSeconds)
+{
+	(void)intervalSeconds;
+}
+
+void TableStats::stopReporting()
+{
+}
+
+bool TableStats::isReporting()
+{
+	return false;
+}
+
+void TableStats::commandFinished()
+{
+}
+
+#endif // defined(HT_PERFT_TABLE_STATS)
+
+} // namespace juddperft
@@ -0,0 +1,191 @@
+/*
+
+MIT License
+
+Copyright(c) 2016-2025 Judd Niemann
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files(the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+
+//////////////////////////////////////////////
+// tablestats.h								//
+// Defines:									//
+// Per-thread counters of hash table		//
+// probes, hits, stores etc, by table and	//
+// depth, and table occupancy scans			//
+//////////////////////////////////////////////
+
+#ifndef _TABLESTATS_H
+#define _TABLESTATS_H 1
+
+#include "tablegroup.h"
+#include "zobristkeyset.h"
+
+#include <atomic>
+#include <cstdint>
+
+namespace juddperft {
+
+// perftFast() and perftFastMulti() count, for each table and depth:
+// probes, hits, stores, overwrites (stores which displaced a record of another position of greater depth, or in the leaf table,
+// where every record is of depth 1, of any other position) and compare_exchange_weak() retries (stores which raced with
+// another thread, or found the slot changed since it was probed).
+// Each thread has its own counters, so counting costs no more than an increment (probes are counted as hits plus misses,
+// so that a hit costs just the one); they are only added up when a report is asked for (which can be done while a search is running). With HT_PERFT_TABLE_STATS undefined, the counters compile to nothing.
+
+enum StatsTable {
+	STATS_PERFT_TABLE,
+	STATS_LEAF_TABLE,
+	STATS_TABLES
+};
+
+struct TableCounts
+{
+	uint64_t probes{0};
+	uint64_t hits{0};
+	uint64_t stores{0};
+	uint64_t overwrites{0};
+	uint64_t casRetries{0};
+};
+
+// TableCounters : one thread's counters
+class TableCounters
+{
+public:
+	void missed(StatsTable t, int depth)
+	{
+		(void)t; (void)depth;
+#if defined(HT_PERFT_TABLE_STATS)
+		bump(c[t][depth].misses);
+#endif
+	}
+
+	void hit(StatsTable t, int depth)
+	{
+		(void)t; (void)depth;
+#if defined(HT_PERFT_TABLE_STATS)
+		bump(c[t][depth].hits);
+#endif
+	}
+
+	void casRetry(StatsTable t, int depth)
+	{
+		(void)t; (void)depth;
+#if defined(HT_PERFT_TABLE_STATS)
+		bump(c[t][depth].casRetries);
+#endif
+	}
+
+	void stored(StatsTable t, int depth, bool overwrite)
+	{
+		(void)t; (void)depth; (void)overwrite;
+#if defined(HT_PERFT_TABLE_STATS)
+		bump(c[t][depth].stores);
+		if (overwrite) {
+			bump(c[t][depth].overwrites);
+		}
+#endif
+	}
+
+#if defined(HT_PERFT_TABLE_STATS)
+	// addTo() : add these counters into counts (which may be done from another thread)
+	void addTo(TableCounts counts[STATS_TABLES][PERFT_DEPTH_KEYS]) const;
+
+private:
+	// the owning thread is the only writer, so a plain load and store is enough (the atomic just makes reading from other threads safe)
+	static void bump(std::atomic<uint64_t>& n)
+	{
+		n.store(n.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	}
+
+	struct Counters
+	{
+		std::atomic<uint64_t> hits{0};
+		std::atomic<uint64_t> misses{0};
+		std::atomic<uint64_t> stores{0};
+		std::atomic<uint64_t> overwrites{0};
+		std::atomic<uint64_t> casRetries{0};
+	};
+
+	Counters c[STATS_TABLES][PERFT_DEPTH_KEYS];
+#endif
+};
+
+// Occupancy scans (see showhash): every slot of a table, or a random sample of its slots, is examined by the thread pool,
+// tallying the occupied slots, the depths and counts of their records, and how many are stale (written in an earlier
+// generation: see TableGroup::generation). Scans don't stop a search, but a table mustn't be resized during one.
+
+constexpr uint64_t DEFAULT_SCAN_SAMPLES = 1000000;
+
+struct TableOccupancy
+{
+	uint64_t slots{0};		// slots in the table
+	uint64_t examined{0};	// slots examined (all of them, unless sampled)
+	uint64_t occupied{0};
+	uint64_t stale{0};
+	uint64_t depths[PERFT_DEPTH_KEYS]{};
+	uint64_t counts[65]{};	// by the bit length of the record's count (0: 0, 1: 1, 2: 2-3, 3: 4-7 ...)
+
+	TableOccupancy& operator+=(const TableOccupancy& o);
+};
+
+class TableStats
+{
+public:
+	// scanPerftTable(), scanLeafTable() : samples = 0 to examine every slot (otherwise, that many slots chosen at random)
+	static TableOccupancy scanPerftTable(uint64_t samples);
+	static TableOccupancy scanLeafTable(uint64_t samples);
+
+	// forThisThread() : get the calling thread's counters
+	static TableCounters& forThisThread()
+	{
+#if defined(HT_PERFT_TABLE_STATS)
+		TableCounters* p = counters;
+		return p ? *p : attachThread();
+#else
+		static TableCounters none;
+		return none;
+#endif
+	}
+
+	// getCounts() : add up the counters of all threads (including those which have finished), since the last reset()
+	static void getCounts(TableCounts counts[STATS_TABLES][PERFT_DEPTH_KEYS]);
+	static void reset();
+	static void print();
+
+	// startReporting() : print the counts every intervalSeconds while they are changing (ie during a search), and at the end
+	// of each command (see commandFinished())
+	static void startReporting(unsigned int intervalSeconds);
+	static void stopReporting();
+	static bool isReporting();
+	static void commandFinished();
+
+private:
+#if defined(HT_PERFT_TABLE_STATS)
+	// attachThread() : create and register the calling thread's counters (which are added to the totals when the thread exits)
+	static TableCounters& attachThread();
+	static inline thread_local TableCounters* counters = nullptr;
+#endif
+};
+
+} // namespace juddperft
+
+#endif // _TABLESTATS_H
@@ -0,0 +1,33 @@
+# frontier_matches_distinct.cmake : check that the number of unique frontier positions found by perftfrontier
+# is the number of distinct positions at that depth (as counted by distinct), at depths 3 and 4 from the start position.
+# usage: cmake -DJUDDPERFT=<path to juddperft> -DWORKDIR=<scratch directory> -P frontier_matches_distinct.cmake
+
+file(REMOVE_RECURSE ${WORKDIR})
+file(MAKE_DIRECTORY ${WORKDIR})
+file(WRITE ${WORKDIR}/commands.txt "perftfrontier 4 3\nperftfrontier 5 4\ndistinct 4\nquit\n")
+
+execute_process(
+	COMMAND ${JUDDPERFT} --memory 64MiB
+	INPUT_FILE ${WORKDIR}/commands.txt
+	OUTPUT_VARIABLE output
+	WORKING_DIRECTORY ${WORKDIR}
+	RESULT_VARIABLE result
+)
+if(NOT result EQUAL 0)
+	message(FATAL_ERROR "juddperft failed (${result}):\n${output}")
+endif()
+
+foreach(depth 3 4)
+	if(NOT output MATCHES "unique frontier positions at depth ${depth}: ([0-9]+)")
+		message(FATAL_ERROR "no frontier size for depth ${depth}:\n${output}")
+	endif()
+	set(frontier ${CMAKE_MATCH_1})
+	if(NOT output MATCHES "Depth ${depth}: ([0-9]+) distinct positions")
+		message(FATAL_ERROR "no distinct count for depth ${depth}:\n${output}")
+	endif()
+	set(distinct ${CMAKE_MATCH_1})
+	if(NOT frontier EQUAL distinct)
+		message(FATAL_ERROR "depth ${depth}: ${frontier} unique frontier positions, but ${distinct} distinct positions")
+	endif()
+	message(STATUS "depth ${depth}: ${frontier} frontier positions = ${distinct} distinct positions")
+endforeach()
@@ -0,0 +1,58 @@
+#!/bin/sh
+# spool_workers.sh : run a spooled perft 6 from the start position with one coordinator and two workers on this machine,
+# with one unit claimed by a worker which never reports back (so it must be reassigned), and check the total.
+# usage: sh spool_workers.sh <path to juddperft> <scratch directory>
+
+JUDDPERFT=$1
+WORKDIR=$2
+SPOOL=$WORKDIR/spool
+
+fail() {
+	echo "FAIL: $*"
+	for log in "$WORKDIR"/*.log; do
+		echo "--- $log"
+		cat "$log"
+	done
+	kill $COORDINATOR $WORKER1 $WORKER2 2>/dev/null
+	exit 1
+}
+
+rm -rf "$WORKDIR"
+mkdir -p "$WORKDIR" || exit 1
+cd "$WORKDIR" || exit 1
+
+# coordinator: frontier depth 2, 10 second timeout
+printf 'coordinate 6 %s 2 10\nquit\n' "$SPOOL" | "$JUDDPERFT" --memory 64MiB > coordinator.log 2>&1 &
+COORDINATOR=$!
+
+# (workers give up if there is no job yet)
+n=0
+while [ ! -f "$SPOOL/job.txt" ]; do
+	n=$((n + 1))
+	[ $n -le 60 ] || fail "no job after 60 seconds"
+	sleep 1
+done
+
+# a worker which claims a unit and then dies: its claim is already older than the timeout
+unit=$(ls "$SPOOL/todo" | head -n 1)
+[ -n "$unit" ] || fail "no units in todo/"
+mv "$SPOOL/todo/$unit" "$SPOOL/claimed/$unit.dead" || fail "unable to claim $unit"
+touch -d '1 minute ago' "$SPOOL/claimed/$unit.dead"
+
+printf 'work %s w1\nquit\n' "$SPOOL" | "$JUDDPERFT" --memory 64MiB > worker1.log 2>&1 &
+WORKER1=$!
+printf 'work %s w2\nquit\n' "$SPOOL" | "$JUDDPERFT" --memory 64MiB > worker2.log 2>&1 &
+WORKER2=$!
+
+wait $COORDINATOR || fail "coordinator failed"
+wait $WORKER1 || fail "worker 1 failed"
+wait $WORKER2 || fail "worker 2 failed"
+
+grep -q "Perft 6: 119060324 " coordinator.log || fail "wrong or missing perft 6 total"
+grep -q "no heartbeat from $unit.dead; unit $unit reassigned" coordinator.log || fail "the dead worker's unit was not reassigned"
+ls "$SPOOL/done" | grep -q '\.w1$' || fail "worker 1 did no units"
+ls "$SPOOL/done" | grep -q '\.w2$' || fail "worker 2 did no units"
+grep -q "perft 6 119060324" "$SPOOL/result.txt" || fail "wrong or missing result.txt"
+
+echo "perft 6 = 119060324 from $(ls "$SPOOL/done" | wc -l) results, with unit $unit reassigned"
+exit 0
@@ -1,8 +1,24 @@
 #include "utils.h"
 
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
 #include <map>
 #include <regex>
 #include <sstream>
+#include <thread>
+
+#if defined(_MSC_VER)
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#if defined(__linux__)
+#include <sched.h>
+#endif
 
 namespace juddperft {
 
@@ -95,5 +111,190 @@ size_t Utils::bytes(const std::string& memorySizeWithBinaryPrefix, bool *ok)
 	return 0ull;
 }
 
+bool Utils::flushToDisk(FILE* f)
+{
+	if (fflush(f) != 0) {
+		return false;
+	}
+#if defined(_MSC_VER)
+	return _commit(_fileno(f)) == 0;
+#else
+	return fsync(fileno(f)) == 0;
+#endif
+}
+
+void Utils::syncDirectory(const std::string& dir)
+{
+#if !defined(_MSC_VER)
+	const int fd = open(dir.empty() ? "." : dir.c_str(), O_RDONLY);
+	if (fd >= 0) {
+		fsync(fd);
+		close(fd);
+	}
+#else
+	(void)dir;
+#endif
+}
+
+std::string Utils::cgroupFile(const std::string& name)
+{
+#if defined(__linux__)
+	// the cgroup v2 entry in /proc/self/cgroup is "0::<path>"
+	std::ifstream cgroups("/proc/self/cgroup");
+	std::string line;
+	while (std::getline(cgroups, line)) {
+		if (line.compare(0, 3, "0::") != 0) {
+			continue;
+		}
+		const std::string path = line.substr(3);
+		// (the v2 hierarchy is mounted at /sys/fs/cgroup, or at /sys/fs/cgroup/unified on "hybrid" systems)
+		for (const char* mount : {"/sys/fs/cgroup", "/sys/fs/cgroup/unified"}) {
+			const std::string file = std::string(mount) + (path == "/" ? "" : path) + "/" + name;
+			std::error_code ec;
+			if (std::filesystem::exists(file, ec)) {
+				return file;
+			}
+		}
+	}
+#else
+	(void)name;
+#endif
+	return std::string();
+}
+
+// cgroupV1File() : the full path of an interface file of this process's cgroup (v1) for the given controller (eg "memory"),
+// or an empty string if there is no such file
+static std::string cgroupV1File(const std::string& controller, const std::string& name)
+{
+#if defined(__linux__)
+	// v1 entries in /proc/self/cgroup are "<id>:<controller>[,<controller>...]:<path>"
+	std::ifstream cgroups("/proc/self/cgroup");
+	std::string line;
+	while (std::getline(cgroups, line)) {
+		const size_t a = line.find(':');
+		const size_t b = line.find(':', a + 1);
+		if (a == std::string::npos || b == std::string::npos) {
+			continue;
+		}
+		const std::string controllers = "," + line.substr(a + 1, b - a - 1) + ",";
+		if (controllers.find("," + controller + ",") == std::string::npos) {
+			continue;
+		}
+		// (inside a container, the controller is often mounted at the process's own cgroup)
+		const std::string path = line.substr(b + 1);
+		for (const std::string& dir : {"/sys/fs/cgroup/" + controller + (path == "/" ? "" : path), "/sys/fs/cgroup/" + controller}) {
+			const std::string file = dir + "/" + name;
+			std::error_code ec;
+			if (std::filesystem::exists(file, ec)) {
+				return file;
+			}
+		}
+	}
+#else
+	(void)controller; (void)name;
+#endif
+	return std::string();
+}
+
+unsigned int Utils::usableCpuCount()
+{
+	unsigned int n = std::max(1u, std::thread::hardware_concurrency());
+
+#if defined(__linux__)
+	// cpus this process may run on (covers taskset, and cgroup cpusets)
+	cpu_set_t cpus;
+	CPU_ZERO(&cpus);
+	if (sched_getaffinity(0, sizeof(cpus), &cpus) == 0) {
+		n = std::min(n, static_cast<unsigned int>(std::max(1, CPU_COUNT(&cpus))));
+	}
+
+	// cgroup cpu quota, rounded up to whole cpus ("max" = no quota)
+	double quota = 0.0;
+	double period = 0.0;
+	const std::string cpuMax = cgroupFile("cpu.max");
+	if (!cpuMax.empty()) {
+		std::ifstream f(cpuMax);
+		std::string q;
+		if (f >> q >> period && q != "max") {
+			quota = std::stod(q);
+		}
+	} else {
+		std::ifstream fq(cgroupV1File("cpu", "cpu.cfs_quota_us"));
+		std::ifstream fp(cgroupV1File("cpu", "cpu.cfs_period_us"));
+		if (!(fq >> quota && fp >> period)) {
+			quota = 0.0; // (-1 = no quota)
+		}
+	}
+	if (quota > 0.0 && period > 0.0) {
+		n = std::min(n, static_cast<unsigned int>(std::max(1.0, std::ceil(quota / period))));
+	}
+#endif
+
+	return n;
+}
+
+// cgroupStat() : the value of key in a cgroup memory.stat file, or nothing if it isn't there
+static std::optional<size_t> cgroupStat(const std::string& file, const std::string& key)
+{
+	std::ifstream f(file);
+	std::string k;
+	size_t value;
+	while (f >> k >> value) {
+		if (k == key) {
+			return value;
+		}
+	}
+	return std::nullopt;
+}
+
+std::optional<size_t> Utils::usableMemory()
+{
+	std::optional<size_t> n;
+
+#if defined(__linux__)
+	auto limit = [&n](size_t bytes) {
+		n = n.has_value() ? std::min(*n, bytes) : bytes;
+	};
+
+	// memory which can be allocated without swapping
+	std::ifstream meminfo("/proc/meminfo");
+	std::string key;
+	size_t value;
+	std::string unit;
+	while (meminfo >> key >> value >> unit) {
+		if (key == "MemAvailable:") {
+			limit(value * 1024);
+			break;
+		}
+	}
+
+	// cgroup limit, less what the cgroup can't give back ("max", or a huge v1 value = no limit).
+	// (the usage figure includes page cache, which is reclaimed under the limit, so count only anonymous memory where possible)
+	std::string max;
+	size_t current = 0;
+	std::optional<size_t> anon;
+	std::ifstream fMax(cgroupFile("memory.max"));
+	if (fMax >> max) {
+		std::ifstream fCurrent(cgroupFile("memory.current"));
+		fCurrent >> current;
+		anon = cgroupStat(cgroupFile("memory.stat"), "anon");
+	} else {
+		std::ifstream fMaxV1(cgroupV1File("memory", "memory.limit_in_bytes"));
+		std::ifstream fCurrentV1(cgroupV1File("memory", "memory.usage_in_bytes"));
+		fMaxV1 >> max;
+		fCurrentV1 >> current;
+		anon = cgroupStat(cgroupV1File("memory", "memory.stat"), "total_rss");
+	}
+	if (!max.empty() && max != "max") {
+		const size_t bytes = std::stoull(max);
+		const size_t used = anon.value_or(current);
+		if (bytes < (1ull << 60)) {
+			limit(bytes > used ? bytes - used : 0);
+		}
+	}
+#endif
+
+	return n;
+}
 
 } // namespace juddperft
@@ -2,6 +2,8 @@
 #define UTILS_H
 
 #include <cstdint>
+#include <cstdio>
+#include <optional>
 #include <string>
 
 namespace juddperft {
@@ -12,6 +14,24 @@ public:
 	// convert a large number of bytes into "B", "KiB", "MiB", "GiB" ... etc
 	static std::string memorySizeWithBinaryPrefix(size_t bytes);
 	static size_t bytes(const std::string& memorySizeWithBinaryPrefix, bool* ok = nullptr);
+
+	// make sure everything written to f has reached the disk
+	static bool flushToDisk(FILE* f);
+
+	// make a rename within directory dir durable
+	static void syncDirectory(const std::string& dir);
+
+	// cgroupFile() : the full path of an interface file (eg "memory.events") of this process's (v2) cgroup,
+	// or an empty string if there is no such file
+	static std::string cgroupFile(const std::string& name);
+
+	// usableCpuCount() : the number of cpus this process can actually use (hardware concurrency, limited by
+	// the cpu affinity mask, and by any cgroup cpu quota)
+	static unsigned int usableCpuCount();
+
+	// usableMemory() : bytes of memory this process can allocate without trouble (the smaller of MemAvailable,
+	// and the headroom under any cgroup memory limit), or nothing if it can't be determined
+	static std::optional<size_t> usableMemory();
 };
 
 } // namespace juddperft
@@ -28,13 +28,24 @@ SOFTWARE.
 
 #include "winboard.h"
 #include "juddperft.h"
+#include "mempressure.h"
+#include "checkpoint.h"
 #include "diagnostics.h"
+#include "distinct.h"
 #include "engine.h"
+#include "enumerate.h"
+#include "extperft.h"
 #include "fen.h"
 #include "tablegroup.h"
 #include "movegen.h"
 #include "raiitimer.h"
+#include "resultsdb.h"
 #include "search.h"
+#include "spilltable.h"
+#include "hashverifier.h"
+#include "tablestats.h"
+#include "spool.h"
+#include "zobristkeyset.h"
 
 #include <cinttypes>
 #include <cstdint>
@@ -46,7 +57,9 @@ SOFTWARE.
 #include <atomic>
 #include <cassert>
 #include <chrono>
+#include <cmath>
 #include <iostream>
+#include <mutex>
 #include <numeric>
 #include <sstream>
 #include <string>
@@ -100,7 +113,7 @@ WinboardInputCommandDefinition winboardInputCommands[]=
 	{"ics", parse_input_ics, false}, 								/* HOSTNAME */
 	{"computer", parse_input_computer, false},
 	{"pause", parse_input_pause, false},
-	{"resume", parse_input_resume, false},
+	{"resume", parse_input_resume, true},
 	// New in WinBoard 4.4:
 	{"memory", parse_input_memory, true },
 	{"cores", parse_input_cores, true},
@@ -113,11 +126,26 @@ WinboardInputCommandDefinition winboardInputCommands[]=
 	{"showhash", parse_input_showhash, true},
 	{"perft", parse_input_perft, true},
 	{"perftfast", parse_input_perftfast, true},
+	{"perftfrontier", parse_input_perftfrontier, true},
+	{"perftestimate", parse_input_perftestimate, true},
+	{"perftcheckpoint", parse_input_perftcheckpoint, true},
+	{"coordinate", parse_input_coordinate, true},
+	{"work", parse_input_work, true},
+	{"extperft", parse_input_extperft, true},
+	{"distinct", parse_input_distinct, true},
+	{"enumerate", parse_input_enumerate, true},
 	{"divide", parse_input_divide, true},
 	{ "dividefast", parse_input_dividefast, true },
-	{"writehash", parse_input_writehash, false},
-	{"lookuphash", parse_input_lookuphash, false},
-	{"test-external", parse_input_testExternal, true}
+	{"writehash", parse_input_writehash, true},
+	{"lookuphash", parse_input_lookuphash, true},
+	{"sharehash", parse_input_sharehash, true},
+	{"spillhash", parse_input_spillhash, true},
+	{"verifyhash", parse_input_verifyhash, true},
+	{"hashstats", parse_input_hashstats, true},
+	{"resultsdb", parse_input_resultsdb, true},
+	{"autoshrink", parse_input_autoshrink, true},
+	{"test-external", parse_input_testExternal, true},
+	{"bench", parse_input_bench, true}
 };
 
 int winBoard(Engine* pE)
@@ -172,7 +200,14 @@ bool waitForInput(Engine* pE)
 					}
 					// separate command from remainder of string
 					args = strtok(NULL, "\n" /* note: deliberately ignore spaces */);
+					std::lock_guard<std::mutex> lock(TableGroup::useMutex); // (the tables mustn't be resized while a command is running)
+					const HashKey hkBefore = pE->currentPosition.getCanonicalHash();
 					winboardInputCommands[i].pF(args, pE); // invoke handler for function
+					HashVerifier::drain(); // (any outstanding recounts use the tables too)
+					TableStats::commandFinished();
+					if (pE->currentPosition.getCanonicalHash() != hkBefore) {
+						TableGroup::newGeneration(); // (a new root position: records from earlier searches become stale)
+					}
 					return true;
 				}
 			}
@@ -282,7 +317,6 @@ void parse_input_rating(const char* s, Engine* pE){}
 void parse_input_ics(const char* s, Engine* pE){}
 void parse_input_computer(const char* s, Engine* pE){}
 void parse_input_pause(const char* s, Engine* pE){}
-void parse_input_resume(const char* s, Engine* pE){}
 
 // extended input commands
 void parse_input_movelist(const char* s, Engine* pE)
@@ -297,151 +331,471 @@ void parse_input_showposition(const char* s, Engine* pE)
 	pE->currentPosition.printPosition();
 }
 
-void parse_input_showhash(const char* s, Engine* pE)
+// proportionOf() : describe k out of n, where n is all or (if sampled) a random sample of a population of the given size:
+// the estimated number of the population like k, its percentage, and (if sampled) the 95% confidence interval of the estimate.
+// (a Wilson score interval, which, unlike the usual p +/- 1.96 * sqrt(p(1 - p) / n), still gives an honest upper bound when k is 0)
+static std::string proportionOf(uint64_t k, uint64_t n, uint64_t population, bool sampled, const char* ofWhat)
 {
-#if defined(HT_PERFT_LEAF_TABLE)
-	{
-		printf("Perft Leaf Table (depth=1) Size: %" PRIu64 " bytes\n", TableGroup::perftLeafTable.getSize());
-		size_t leafTableSize = TableGroup::perftLeafTable.getNumRecords();
-		std::atomic<PerftLeafRecord> *pBaseAddress = TableGroup::perftLeafTable.getAddress(0);
-		std::atomic<PerftLeafRecord> *pAtomicRecord;
-
-		size_t incSize = leafTableSize / 10;
-		size_t nextProgUpdate = incSize;
-
-		size_t t = 0;
-		printf("tallying");
-		for (size_t x = 0; x < leafTableSize; x++) {
-			pAtomicRecord = pBaseAddress + x;
-			PerftLeafRecord retrievedRecord = pAtomicRecord->load();
-
-			if (x >= nextProgUpdate) {
-				printf(".");
-				nextProgUpdate += incSize;
-			}
+	char s[160];
+	const double p = (n != 0) ? static_cast<double>(k) / n : 0.0;
+	const uint64_t estimate = static_cast<uint64_t>(p * population + 0.5);
+	if (sampled && n != 0) {
+		static constexpr double z = 1.96;
+		const double z2n = z * z / n;
+		const double centre = (p + z2n / 2.0) / (1.0 + z2n);
+		const double halfWidth = z * std::sqrt(p * (1.0 - p) / n + z2n / (4.0 * n)) / (1.0 + z2n);
+		snprintf(s, sizeof(s), "%" PRIu64 " (%2.1f%%%s; 95%% CI %" PRIu64 " - %" PRIu64 ")", estimate, 100.0 * p, ofWhat,
+			static_cast<uint64_t>(std::max(0.0, centre - halfWidth) * population),
+			static_cast<uint64_t>(std::ceil(std::min(1.0, centre + halfWidth) * population)));
+	} else {
+		snprintf(s, sizeof(s), "%" PRIu64 " (%2.1f%%%s)", estimate, 100.0 * p, ofWhat);
+	}
+	return s;
+}
 
-			if (retrievedRecord & 0xffull) {
-				t++;
+// printOccupancy() : print the results of a table scan (for a sampled scan, the numbers are estimates for the whole table)
+static void printOccupancy(const TableOccupancy& o, bool showDepths, bool showStale)
+{
+	const bool sampled = (o.examined < o.slots);
+	if (sampled) {
+		printf("(estimated from a random sample of %" PRIu64 " slots)\n", o.examined);
+	}
+
+	// (the count histogram and the stale fraction are of occupied slots, so their population is the number of those)
+	const uint64_t occupied = (o.examined != 0) ? static_cast<uint64_t>(static_cast<double>(o.occupied) * o.slots / o.examined + 0.5) : 0;
+
+	if (showDepths) {
+		for (int d = 0; d < PERFT_DEPTH_KEYS; d++) {
+			if (d >= 16 && o.depths[d] == 0) {
+				continue; // (only show the extended depths which are in use)
 			}
+			printf("Depth %d: %s\n", d, proportionOf(o.depths[d], o.examined, o.slots, sampled, "").c_str());
 		}
+	}
 
-		printf("\nTotal: %" PRIu64 " / %"  PRIu64 " (%2.1f%%)\n\n", t, leafTableSize, 100.0 * static_cast<float>(t) / leafTableSize);
+	printf("Counts:\n");
+	for (int b = 0; b < 65; b++) {
+		if (o.counts[b] == 0) {
+			continue;
+		}
+		char range[64];
+		if (b < 2) {
+			snprintf(range, sizeof(range), "%d", b);
+		} else {
+			snprintf(range, sizeof(range), "%" PRIu64 "-%" PRIu64, uint64_t{1} << (b - 1), (b < 64) ? (uint64_t{1} << b) - 1 : ~uint64_t{0});
+		}
+		printf("  %s: %s\n", range, proportionOf(o.counts[b], o.occupied, occupied, sampled, " of occupied").c_str());
 	}
-#endif
 
+	if (showStale) {
+		printf("Stale (from earlier generations): %s\n", proportionOf(o.stale, o.occupied, occupied, sampled, " of occupied").c_str());
+	}
 
-	printf("Perft Table Size: %" PRIu64 " bytes\n", TableGroup::perftTable.getSize());
-	size_t table_size = TableGroup::perftTable.getNumRecords();
-	std::vector<size_t> depthTally(16, 0);
-	std::atomic<PerftRecord> *pBaseAddress = TableGroup::perftTable.getAddress(0);
-	std::atomic<PerftRecord> *pAtomicRecord;
-
-	size_t incSize = table_size / 10;
-	size_t nextProgUpdate = incSize;
-
-	printf("tallying");
-	for (size_t x = 0; x < table_size; x++) {
-		pAtomicRecord = pBaseAddress + x;
-		PerftRecord retrievedRecord = pAtomicRecord->load();
-
-		if (x >= nextProgUpdate) {
-			printf(".");
-			nextProgUpdate += incSize;
-		}
+	char ofSlots[64];
+	snprintf(ofSlots, sizeof(ofSlots), " of %" PRIu64 " slots", o.slots);
+	printf("Total: %s\n", proportionOf(o.occupied, o.examined, o.slots, sampled, ofSlots).c_str());
+}
 
-		if (retrievedRecord.count) {
-#if defined (HT_PERFT_DEPTH_TALLY)
-			++depthTally[retrievedRecord.depth];
-#else
-			++depthTally[0];
-#endif
-		}
+// showhash [sample [slots]]
+void parse_input_showhash(const char* s, Engine* pE)
+{
+	char mode[16] = {0};
+	unsigned long long samples = DEFAULT_SCAN_SAMPLES;
+	const int nArgs = (s == nullptr) ? 0 : sscanf(s, "%15s %llu", mode, &samples);
+	if (nArgs < 1) {
+		samples = 0; // (every slot)
+	} else if (strcmp(mode, "sample") != 0 || samples == 0) {
+		printf("usage: showhash [sample [slots]]\n");
+		return;
 	}
 
+#if defined(HT_PERFT_LEAF_TABLE)
+	printf("Perft Leaf Table (depth=1) Size: %" PRIu64 " bytes\n", TableGroup::perftLeafTable.getSize());
+	printOccupancy(TableStats::scanLeafTable(samples), false, true);
 	printf("\n");
+#endif
 
+	printf("Perft Table Size: %" PRIu64 " bytes\n", TableGroup::perftTable.getSize());
 #if defined (HT_PERFT_DEPTH_TALLY)
-	for (unsigned int d = 0; d < 16; d++) {
-		printf("Depth %d: %" PRIu64 " (%2.1f%%)\n", d, depthTally[d], 100.0 * static_cast<float>(depthTally[d]) / table_size);
-	}
+	printOccupancy(TableStats::scanPerftTable(samples), true, PerftRecord::GENERATION_BITS != 0);
+#else
+	printOccupancy(TableStats::scanPerftTable(samples), false, PerftRecord::GENERATION_BITS != 0);
 #endif
-	const nodecount_t t = std::accumulate(depthTally.begin(), depthTally.end(), 0ull);
-	printf("Total: %" PRIu64 " / %"  PRIu64 " (%2.1f%%)\n", t, table_size, 100.0 * static_cast<float>(t) / table_size);
 }
 
+// parseDepth() : read the depth at the start of a depth-taking command's arguments, and check that it can be searched
+// (each depth has its own hash key: see ZobristKeySet::zkPerftDepth). Returns the rest of the arguments, or nullptr
+// (having printed usage, or why the depth is no good) if there is no usable depth
+static const char* parseDepth(const char* s, int* pDepth, const char* usage)
+{
+	char* rest = nullptr;
+	const long depth = (s != nullptr) ? strtol(s, &rest, 10) : 0;
+	if (s == nullptr || rest == s) {
+		printf("%s\n", usage);
+		return nullptr;
+	}
+	if (depth < 1 || depth >= PERFT_DEPTH_KEYS) {
+		printf("depth must be from 1 to %d\n", PERFT_DEPTH_KEYS - 1);
+		return nullptr;
+	}
+	*pDepth = static_cast<int>(depth);
+	return rest;
+}
+
+// parseDivideLevels() : get the optional levels=1 | levels=2 argument of divide and dividefast (default 1: one line per root move).
+// Prints a message and returns false if it is out of range (levels=2 needs a depth of at least 3)
+static bool parseDivideLevels(const char* s, int depth, int* pLevels)
+{
+	const char* l = strstr(s, "levels=");
+	const long levels = (l != nullptr) ? strtol(l + 7, nullptr, 10) : 1;
+	if (levels != 1 && levels != 2) {
+		printf("levels must be 1 or 2\n");
+		return false;
+	}
+	if (levels == 2 && depth < 3) {
+		printf("levels=2 needs a depth of at least 3\n");
+		return false;
+	}
+	*pLevels = static_cast<int>(levels);
+	return true;
+}
+
+// perft <depth>
 void parse_input_perft(const char* s, Engine* pE)
 {
-	if (s == nullptr)
+	int depth = 0;
+	if (parseDepth(s, &depth, "usage: perft <depth>") == nullptr) {
 		return;
+	}
 
-	for (int q = 1; q <= atoi(s); q++)
-	{
-		{
-			RaiiTimer timer;
-			PerftInfo t;
+	// depths which are already in the results database don't need to be searched
+	std::vector<PerftInfo> info(depth + 1);
+	int searchDepth = 0;
+	for (int q = 1; q <= depth; q++) {
+		if (!ResultsDB::lookup(pE->currentPosition, q, true, info[q])) {
+			searchDepth = q;
+		}
+	}
+
+	RaiiTimer timer;
 
+	// all remaining depths are tallied in a single pass
+	if (searchDepth > 0) {
+		std::vector<PerftInfo> searched(searchDepth + 1);
 #if !defined(__EMSCRIPTEN__)
-			perftMT(pE->currentPosition, q, 1, &t);
+		perftMultiMT(pE->currentPosition, searchDepth, searched.data());
 #else
-			perft(pE->currentPosition, q, 1, &t);
+		perftMulti(pE->currentPosition, searchDepth, 1, searched.data());
 #endif
-
-			printf("Perft %d: %" PRIu64 " \nTotal Captures= %" PRIu64 " Castles= %" PRIu64 " CastleLongs= %" PRIu64 " EPCaptures= %" PRIu64 " Promotions= %" PRIu64 " Checks= %" PRIu64 " Checkmates= %" PRIu64 "\n",
-				   q,
-				   t.nMoves,
-				   t.nCapture + t.nEPCapture,
-				   t.nCastle,
-				   t.nCastleLong,
-				   t.nEPCapture,
-				   t.nPromotion,
-				   t.nCheck,
-				   t.nCheckmate
-				   );
-			timer.setNodes(t.nMoves);
+		for (int q = 1; q <= searchDepth; q++) {
+			info[q] = searched[q];
+			ResultsDB::store(pE->currentPosition, q, true, info[q]);
 		}
 	}
+
+	nodecount_t nTotal = 0;
+	for (int q = 1; q <= depth; q++) {
+		const PerftInfo& t = info[q];
+		printf("Perft %d: %" PRIu64 " \nTotal Captures= %" PRIu64 " Castles= %" PRIu64 " CastleLongs= %" PRIu64 " EPCaptures= %" PRIu64 " Promotions= %" PRIu64 " Checks= %" PRIu64 " Checkmates= %" PRIu64 "\n",
+			   q,
+			   t.nMoves,
+			   t.nCapture + t.nEPCapture,
+			   t.nCastle,
+			   t.nCastleLong,
+			   t.nEPCapture,
+			   t.nPromotion,
+			   t.nCheck,
+			   t.nCheckmate
+			   );
+		nTotal += t.nMoves;
+	}
+	timer.setNodes(nTotal);
 }
 
+// perftfast <depth>
 void parse_input_perftfast(const char* s, Engine* pE) {
 
-	if (s == nullptr) {
+	int depth = 0;
+	if (parseDepth(s, &depth, "usage: perftfast <depth>") == nullptr) {
 		return;
 	}
 
-	for (int q = 1; q <= atoi(s); q++) {
-		RaiiTimer timer;
-		nodecount_t nNumPositions = 0;
-		perftFastMT(pE->currentPosition, q, nNumPositions);
-		printf("Perft %d: %" PRIu64 " \n",
-			   q, nNumPositions
+	// depths which are already in the results database don't need to be searched
+	std::vector<WideNodeCount> nNumPositions(depth + 1);
+	int searchDepth = 0;
+	for (int q = 1; q <= depth; q++) {
+		PerftInfo stored;
+		if (ResultsDB::lookup(pE->currentPosition, q, false, stored)) {
+			nNumPositions[q] += stored.nMoves;
+		} else {
+			searchDepth = q;
+		}
+	}
+
+	RaiiTimer timer;
+
+	// all remaining depths are counted in a single pass
+	if (searchDepth > 0) {
+		std::vector<WideNodeCount> searched(searchDepth + 1);
+		perftFastMultiMT(pE->currentPosition, searchDepth, searched.data());
+		for (int q = 1; q <= searchDepth; q++) {
+			nNumPositions[q] = searched[q];
+			if (searched[q].fits()) {
+				ResultsDB::store(pE->currentPosition, q, searched[q].lo);
+			}
+		}
+	}
+
+	WideNodeCount nTotal;
+	for (int q = 1; q <= depth; q++) {
+		printf("Perft %d: %s \n",
+			   q, nNumPositions[q].toString().c_str()
 			   );
+		nTotal += nNumPositions[q];
+	}
+	timer.setNodes(nTotal.toDouble());
+}
+
+// perftfrontier <depth> [frontier depth]
+void parse_input_perftfrontier(const char* s, Engine* pE) {
+
+	int depth = 0;
+	int frontierDepth = DEFAULT_FRONTIER_DEPTH;
+	const char* args = parseDepth(s, &depth, "usage: perftfrontier <depth> [frontier depth]");
+	if (args == nullptr) {
+		return;
+	}
+	sscanf(args, "%d", &frontierDepth);
+
+	// (only the requested depth: each depth would need its own frontier, and its own searches of it)
+	RaiiTimer timer;
+	nodecount_t nNumPositions = 0;
+	size_t frontierSize = 0;
+	perftFrontierMT(pE->currentPosition, depth, frontierDepth, nNumPositions, &frontierSize);
+	printf("Perft %d: %" PRIu64 " (unique frontier positions at depth %d: %zu)\n",
+		   depth, nNumPositions, std::max(0, std::min(frontierDepth, depth - 1)), frontierSize
+		   );
+	timer.setNodes(nNumPositions);
+}
+
+// perftestimate <depth> [samples]
+void parse_input_perftestimate(const char* s, Engine* pE)
+{
+	int depth = 0;
+	unsigned long long samples = 1000000;
+	const char* args = parseDepth(s, &depth, "usage: perftestimate <depth> [samples]");
+	if (args == nullptr) {
+		return;
+	}
+	sscanf(args, "%llu", &samples);
+
+	PerftEstimate e;
+	perftEstimateMT(pE->currentPosition, depth, samples, e);
+	printf("Perft %d estimate: %.6g +/- %.3g (standard error: %.3f%%) from %" PRIu64 " samples (%.4g samples/sec)\n",
+		   depth, e.estimate, e.standardError, 100.0 * e.standardError / std::max(1.0, e.estimate), e.samples, e.samplesPerSecond);
+}
+
+// perftcheckpoint <depth> <journal file> [snapshot minutes]
+void parse_input_perftcheckpoint(const char* s, Engine* pE)
+{
+	static const char* usage = "usage: perftcheckpoint <depth> <journal file> [snapshot minutes]";
+	int depth = 0;
+	char path[1024] = {0};
+	CheckpointOptions options;
+	const char* args = parseDepth(s, &depth, usage);
+	if (args == nullptr) {
+		return;
+	}
+	if (sscanf(args, "%1023s %d", path, &options.snapshotMinutes) < 1) {
+		printf("%s\n", usage);
+		return;
+	}
+	options.journalPath = path;
+
+	RaiiTimer timer;
+	nodecount_t nNumPositions = 0;
+	const bool ok = perftCheckpointed(pE->currentPosition, depth, options, nNumPositions);
+	pE->currentPosition.calculateHash(); // (a table snapshot may have changed the zobrist keys)
+	if (ok) {
+		printf("Perft %d: %" PRIu64 " \n", depth, nNumPositions);
 		timer.setNodes(nNumPositions);
 	}
 }
 
-void parse_input_divide(const char* s, Engine* pE)
+// resume <journal file> [snapshot minutes] : continue a perftcheckpoint job
+// (with no arguments, this is the xboard "resume" command, which is ignored)
+void parse_input_resume(const char* s, Engine* pE)
 {
-	if (s == nullptr) {
+	char path[1024] = {0};
+	CheckpointOptions options;
+	if (s == nullptr || sscanf(s, "%1023s %d", path, &options.snapshotMinutes) < 1) {
+		return;
+	}
+	options.journalPath = path;
+
+	RaiiTimer timer;
+	nodecount_t nNumPositions = 0;
+	int depth = 0;
+	ChessPosition P;
+	const bool ok = perftResume(options, &P, &depth, nNumPositions);
+	pE->currentPosition.calculateHash(); // (a table snapshot may have changed the zobrist keys)
+	if (ok) {
+		pE->currentPosition = P;
+		printf("Perft %d: %" PRIu64 " \n", depth, nNumPositions);
+		timer.setNodes(nNumPositions);
+	}
+}
+
+// coordinate <depth> <spool directory> [frontier depth] [timeout seconds]
+void parse_input_coordinate(const char* s, Engine* pE)
+{
+	static const char* usage = "usage: coordinate <depth> <spool directory> [frontier depth] [timeout seconds]";
+	int depth = 0;
+	char dir[1024] = {0};
+	SpoolOptions options;
+	const char* args = parseDepth(s, &depth, usage);
+	if (args == nullptr) {
 		return;
 	}
+	if (sscanf(args, "%1023s %d %d", dir, &options.frontierDepth, &options.timeoutSeconds) < 1) {
+		printf("%s\n", usage);
+		return;
+	}
+	options.spoolDir = dir;
 
-	int depth;
-	depth = std::max(2, atoi(s));
+	RaiiTimer timer;
+	nodecount_t nNumPositions = 0;
+	if (coordinateSpool(pE->currentPosition, depth, options, nNumPositions)) {
+		printf("Perft %d: %" PRIu64 " \n", depth, nNumPositions);
+		timer.setNodes(nNumPositions);
+	}
+}
+
+// work <spool directory> [worker name]
+void parse_input_work(const char* s, Engine* pE)
+{
+	char dir[1024] = {0};
+	char name[256] = {0};
+	if (s == nullptr || sscanf(s, "%1023s %255s", dir, name) < 1) {
+		printf("usage: work <spool directory> [worker name]\n");
+		return;
+	}
+
+	RaiiTimer timer;
+	workSpool(dir, name);
+}
+
+// extperft <depth> <work directory> [frontier depth] [memory MiB]
+void parse_input_extperft(const char* s, Engine* pE)
+{
+	static const char* usage = "usage: extperft <depth> <work directory> [frontier depth] [memory MiB]";
+	int depth = 0;
+	char dir[1024] = {0};
+	int frontierDepth = 0;
+	unsigned long long memoryMiB = 1024;
+	const char* args = parseDepth(s, &depth, usage);
+	if (args == nullptr) {
+		return;
+	}
+	if (sscanf(args, "%1023s %d %llu", dir, &frontierDepth, &memoryMiB) < 1) {
+		printf("%s\n", usage);
+		return;
+	}
+
+	ExtPerftOptions options;
+	options.workDir = dir;
+	options.frontierDepth = frontierDepth;
+	options.memoryBytes = memoryMiB << 20;
+
+	RaiiTimer timer;
+	nodecount_t nNumPositions = 0;
+	if (perftExternal(pE->currentPosition, depth, options, nNumPositions)) {
+		printf("Perft %d: %" PRIu64 " \n", depth, nNumPositions);
+		timer.setNodes(nNumPositions);
+	}
+}
+
+// distinct <depth> [memory MiB] [spill directory]
+void parse_input_distinct(const char* s, Engine* pE)
+{
+	int depth = 0;
+	unsigned long long memoryMiB = 1024;
+	char dir[1024] = "distinct-spill";
+	const char* args = parseDepth(s, &depth, "usage: distinct <depth> [memory MiB] [spill directory]");
+	if (args == nullptr) {
+		return;
+	}
+	sscanf(args, "%llu %1023s", &memoryMiB, dir);
+
+	RaiiTimer timer;
+	countDistinctPositions(pE->currentPosition, depth, memoryMiB << 20, dir, [](const DistinctLevelInfo& info) {
+		printf("Depth %d: %" PRIu64 " distinct positions (Perft %d: %" PRIu64 ") %.0f ms",
+			   info.depth, info.distinctPositions, info.depth, info.paths, info.milliseconds);
+		if (info.generated != 0) {
+			printf(", %.4g positions/sec", 1000.0 * info.generated / std::max(1.0, info.milliseconds));
+		}
+		printf(", %.1f MiB %s\n", info.memoryBytes / 1048576.0, info.onDisk ? "on disk" : "in memory");
+	});
+}
+
+// enumerate <depth> <file | -> [bin | fen] [path]
+void parse_input_enumerate(const char* s, Engine* pE)
+{
+	static const char* usage = "usage: enumerate <depth> <file | -> [bin | fen] [path]";
+	int depth = 0;
+	char output[1024] = {0};
+	char format[16] = "bin";
+	char path[16] = {0};
+	const char* args = parseDepth(s, &depth, usage);
+	if (args == nullptr) {
+		return;
+	}
+	if (sscanf(args, "%1023s %15s %15s", output, format, path) < 1) {
+		printf("%s\n", usage);
+		return;
+	}
+
+	EnumerateOptions options;
+	options.output = output;
+	options.format = (strcmp(format, "fen") == 0) ? EnumerateFormat::Fen : EnumerateFormat::Binary;
+	options.includePath = (strcmp(path, "path") == 0);
+
+	// (when streaming to stdout, the summary goes to stderr, to keep the stream clean)
+	FILE* summary = (options.output == "-") ? stderr : stdout;
+	const auto start = std::chrono::steady_clock::now();
+	nodecount_t nPositions = 0;
+	if (!enumeratePositions(pE->currentPosition, depth, options, nPositions)) {
+		fprintf(summary, "enumerate: unable to write to %s\n", output);
+		return;
+	}
+
+	const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	fprintf(summary, "Enumerated %" PRIu64 " positions at depth %d in %.0f ms (%.4g positions/sec)\n",
+			nPositions, depth, ms, 1000.0 * nPositions / std::max(1.0, ms));
+}
+
+// divide <depth> [levels=2]
+void parse_input_divide(const char* s, Engine* pE)
+{
+	int depth = 0;
+	if (parseDepth(s, &depth, "usage: divide <depth> [levels=2]") == nullptr) {
+		return;
+	}
+	depth = std::max(2, depth);
+	int levels = 1;
+	if (!parseDivideLevels(s, depth, &levels)) {
+		return;
+	}
 
-	ChessMove MoveList[MOVELIST_SIZE];
-	MoveGenerator::generateMoves(pE->currentPosition, MoveList);
-	ChessMove* pM = MoveList;
 	PerftInfo gt;
-	ChessPosition Q;
+	PerftInfo groupTotal;
 	RaiiTimer timer;
 
-	while (!get_flag(pM, endOfMoveList)) {
-		Q = pE->currentPosition;
-		Q.performMove(*pM);
-		Q.switchSides();
-		printMove(*pM, LongAlgebraicNoNewline);
-		PerftInfo t;
-		perftMT(Q, depth-1, 1, &t);
+	divideMT(pE->currentPosition, depth, levels, true, [&](const DivideResult& r) {
+		const PerftInfo& t = r.info;
+		for (int m = 0; m < r.nMoves; m++) {
+			printMove(r.moves[m], LongAlgebraicNoNewline);
+		}
 		printf("%" PRIu64 " \nTotal Captures= %" PRIu64 " Castles= %" PRIu64 " CastleLongs= %" PRIu64 " EPCaptures= %" PRIu64 " Promotions= %" PRIu64 " Checks= %" PRIu64 " Checkmates= %" PRIu64 "\n",
 			t.nMoves,
 			t.nCapture + t.nEPCapture,
@@ -453,7 +807,17 @@ void parse_input_divide(const char* s, Engine* pE)
 			t.nCheckmate
 			);
 
+		groupTotal.nMoves += t.nMoves;
+		if (r.nMoves == 2 && r.lastInGroup) {
+			printMove(r.moves[0], LongAlgebraicNoNewline);
+			printf("total: %" PRIu64 " \n", groupTotal.nMoves);
+		}
+		if (r.lastInGroup) {
+			groupTotal = PerftInfo{};
+		}
+
 		printf("\n");
+		fflush(stdout);
 
 		gt.nMoves += t.nMoves;
 		gt.nCapture += t.nCapture;
@@ -463,10 +827,10 @@ void parse_input_divide(const char* s, Engine* pE)
 		gt.nPromotion += t.nPromotion;
 		gt.nCheck += t.nCheck;
 		gt.nCheckmate += t.nCheckmate;
+	});
 
-		pM++;
-	}
-
+	timer.setNodes(gt.nMoves);
+	ResultsDB::store(pE->currentPosition, depth, true, gt);
 	printf("Summary:\nPerft %d: %" PRIu64 " \nTotal Captures= %" PRIu64 " Castles= %" PRIu64 " CastleLongs= %" PRIu64 " EPCaptures= %" PRIu64 " Promotions= %" PRIu64 " Checks= %" PRIu64 " Checkmates= %" PRIu64 "\n",
 		depth,
 		gt.nMoves,
@@ -480,49 +844,230 @@ void parse_input_divide(const char* s, Engine* pE)
 		);
 }
 
+// dividefast <depth> [levels=2]
 void parse_input_dividefast(const char* s, Engine* pE)
 {
-	if (s == nullptr) {
+	int depth = 0;
+	if (parseDepth(s, &depth, "usage: dividefast <depth> [levels=2]") == nullptr) {
+		return;
+	}
+	depth = std::max(2, depth);
+	int levels = 1;
+	if (!parseDivideLevels(s, depth, &levels)) {
 		return;
 	}
 
-	int depth;
-	depth = std::max(2, atoi(s));
-
-	ChessMove MoveList[MOVELIST_SIZE];
-	MoveGenerator::generateMoves(pE->currentPosition, MoveList);
-	ChessMove* pM = MoveList;
-	ChessPosition Q;
 	nodecount_t grandtotal = 0;
+	nodecount_t groupTotal = 0;
 	RaiiTimer timer;
 
-	while (!get_flag(pM, endOfMoveList)) {
-		Q = pE->currentPosition;
-		Q.performMove(*pM).switchSides();
-
-		printMove(*pM, LongAlgebraicNoNewline);
-		nodecount_t nNumPositions = 0;
-		perftFastMT(Q, depth - 1, nNumPositions);
+	divideMT(pE->currentPosition, depth, levels, false, [&](const DivideResult& r) {
+		for (int m = 0; m < r.nMoves; m++) {
+			printMove(r.moves[m], LongAlgebraicNoNewline);
+		}
 		printf(" %" PRIu64 " \n",
-			nNumPositions
+			r.info.nMoves
 			);
-		grandtotal += nNumPositions;
-		pM++;
-	}
+
+		groupTotal += r.info.nMoves;
+		if (r.nMoves == 2 && r.lastInGroup) {
+			printMove(r.moves[0], LongAlgebraicNoNewline);
+			printf("total: %" PRIu64 " \n\n", groupTotal);
+		}
+		if (r.lastInGroup) {
+			groupTotal = 0;
+		}
+
+		fflush(stdout);
+		grandtotal += r.info.nMoves;
+	});
+
 	timer.setNodes(grandtotal);
+	ResultsDB::store(pE->currentPosition, depth, grandtotal);
 	printf("\nPerft %d: %" PRIu64 "\n", depth, grandtotal);
 }
 
+// writehash <file>
 void parse_input_writehash(const char* s, Engine* pE)
 {
+	char path[1024] = {0};
+	if (s == nullptr || sscanf(s, "%1023s", path) < 1) {
+		printf("usage: writehash <file>\n");
+		return;
+	}
 
+	RaiiTimer timer;
+	if (TableGroup::saveSnapshot(path)) {
+		printf("Hash tables saved to %s\n", path);
+	} else {
+		printf("Unable to save hash tables to %s\n", path);
+	}
 }
 
+// lookuphash <file>
 void parse_input_lookuphash(const char* s, Engine* pE)
 {
+	char path[1024] = {0};
+	if (s == nullptr || sscanf(s, "%1023s", path) < 1) {
+		printf("usage: lookuphash <file>\n");
+		return;
+	}
 
+	if (TableGroup::loadSnapshot(path)) {
+		printf("Hash tables loaded from %s (zobrist seed: %" PRIx64 ")\n", path, zobristKeys.getSeed());
+	} else {
+		printf("Unable to load hash tables from %s (missing, damaged, or from a build with a different record format)\n", path);
+	}
+#if defined(HT_PERFT_SPILL_TABLE) && defined(HT_PERFT_DEPTH_TALLY)
+	SpillTable::checkSeed();
+#endif
+	pE->currentPosition.calculateHash(); // (the zobrist keys may have changed)
 }
 
+// sharehash <name | file>
+void parse_input_sharehash(const char* s, Engine* pE)
+{
+	char name[1024] = {0};
+	if (s == nullptr || sscanf(s, "%1023s", name) < 1) {
+		printf("usage: sharehash <name | file>\n");
+		return;
+	}
+
+	if (TableGroup::attachShared(name)) {
+		printf("Hash tables shared via %s (zobrist seed: %" PRIx64 ")\n", name, zobristKeys.getSeed());
+	} else {
+		printf("Unable to share hash tables via %s (not accessible, or created by a build with a different record format)\n", name);
+	}
+#if defined(HT_PERFT_SPILL_TABLE) && defined(HT_PERFT_DEPTH_TALLY)
+	SpillTable::checkSeed();
+#endif
+	pE->currentPosition.calculateHash(); // (the zobrist keys may have changed)
+}
+
+// spillhash [<file> <bytes> [min depth] | off]
+void parse_input_spillhash(const char* s, Engine* pE)
+{
+#if defined(HT_PERFT_SPILL_TABLE) && defined(HT_PERFT_DEPTH_TALLY)
+	char path[1024] = {0};
+	char size[64] = {0};
+	int minDepth = DEFAULT_SPILL_MIN_DEPTH;
+	const int nArgs = (s == nullptr) ? 0 : sscanf(s, "%1023s %63s %d", path, size, &minDepth);
+
+	if (nArgs < 1) {
+		if (SpillTable::isAttached()) {
+			const SpillTableStats stats = SpillTable::getStats();
+			printf("Spill table: %s (%s)\nprobes: %" PRIu64 " hits: %" PRIu64 " records spilled: %" PRIu64 " dropped: %" PRIu64 "\n",
+				SpillTable::path().c_str(), Utils::memorySizeWithBinaryPrefix(SpillTable::getSize()).c_str(),
+				stats.probes, stats.hits, stats.spilled, stats.dropped);
+		} else {
+			printf("No spill table attached\nusage: spillhash [<file> <bytes> [min depth] | off]\n");
+		}
+		return;
+	}
+
+	if (strcmp(path, "off") == 0) {
+		SpillTable::detach();
+		printf("Spill table detached\n");
+		return;
+	}
+
+	const size_t bytes = (nArgs >= 2) ? Utils::bytes(size) : 0; // (0: use the existing file as it is)
+	if (SpillTable::attach(path, bytes, minDepth)) {
+		printf("Spill table: %s (%s) for records of depth %d and over\n", path, Utils::memorySizeWithBinaryPrefix(SpillTable::getSize()).c_str(), std::max(2, minDepth));
+	} else {
+		printf("Unable to attach spill table %s\n", path);
+	}
+#else
+	printf("spillhash: not available in this build (requires HT_PERFT_SPILL_TABLE and HT_PERFT_DEPTH_TALLY)\n");
+#endif
+}
+
+// verifyhash [on [fraction] | off]
+void parse_input_verifyhash(const char* s, Engine* pE)
+{
+	char mode[16] = {0};
+	double fraction = DEFAULT_VERIFY_FRACTION;
+	const int nArgs = (s == nullptr) ? 0 : sscanf(s, "%15s %lf", mode, &fraction);
+
+	if (nArgs >= 1 && strcmp(mode, "on") == 0) {
+		if (PerftRecord::VERIFY_BITS == 0 && fraction <= 0.0) {
+			// (without verification keys, hardened mode is just the recounting)
+			printf("verification keys are not available in this build (requires HT_PERFT_VERIFY_KEY), so a fraction of 0 would check nothing\n");
+			return;
+		}
+		HashVerifier::enable(fraction);
+	} else if (nArgs >= 1 && strcmp(mode, "off") == 0) {
+		HashVerifier::disable();
+	} else if (nArgs >= 1) {
+		printf("usage: verifyhash [on [fraction] | off]\n");
+		return;
+	}
+
+	if (HashVerifier::isEnabled()) {
+		const HashVerifierStats stats = HashVerifier::getStats();
+		printf("Collision-hardened mode on: verification keys %s, recounting %g%% of hits\n",
+			(PerftRecord::VERIFY_BITS != 0) ? "checked" : "not available in this build (requires HT_PERFT_VERIFY_KEY)",
+			HashVerifier::getFraction() * 100.0);
+		printf("sampled: %" PRIu64 " recounted: %" PRIu64 " mismatches: %" PRIu64 " dropped: %" PRIu64 "\n",
+			stats.sampled, stats.checked, stats.mismatches, stats.dropped);
+	} else {
+		printf("Collision-hardened mode off\n");
+	}
+}
+
+// hashstats [reset | <seconds> | off]
+void parse_input_hashstats(const char* s, Engine* pE)
+{
+	char arg[32] = {0};
+	const int nArgs = (s == nullptr) ? 0 : sscanf(s, "%31s", arg);
+
+	if (nArgs < 1) {
+		TableStats::print();
+	} else if (strcmp(arg, "reset") == 0) {
+		TableStats::reset();
+		printf("Table statistics reset\n");
+	} else if (strcmp(arg, "off") == 0) {
+		TableStats::stopReporting();
+		printf("Table statistics reports off\n");
+	} else if (atoi(arg) > 0) {
+		TableStats::startReporting(static_cast<unsigned int>(atoi(arg)));
+		if (TableStats::isReporting()) {
+			printf("Table statistics will be reported every %d seconds during a search, and at the end of each command\n", atoi(arg));
+		} else {
+			TableStats::print(); // (explains that they aren't available)
+		}
+	} else {
+		printf("usage: hashstats [reset | <seconds> | off]\n");
+	}
+}
+
+// resultsdb [<file> | off]
+void parse_input_resultsdb(const char* s, Engine* pE)
+{
+	char path[1024] = {0};
+	if (s == nullptr || sscanf(s, "%1023s", path) < 1) {
+		if (ResultsDB::isOpen()) {
+			printf("Results database: %s (%zu results)\n", ResultsDB::path().c_str(), ResultsDB::size());
+		} else {
+			printf("No results database open\nusage: resultsdb [<file> | off]\n");
+		}
+		return;
+	}
+
+	if (strcmp(path, "off") == 0) {
+		ResultsDB::close();
+		printf("Results database closed\n");
+		return;
+	}
+
+	if (ResultsDB::open(path)) {
+		printf("Results database: %s (%zu results)\n", path, ResultsDB::size());
+	} else {
+		printf("Unable to open results database %s\n", path);
+	}
+}
+
+// memory <bytes> [clear]
 void parse_input_memory(const char* s, Engine* pE) {
 	if (s == nullptr) {
 		return;
@@ -530,7 +1075,34 @@ void parse_input_memory(const char* s, Engine* pE) {
 
 	size_t BytesRequested = Utils::bytes(s);
 
-	setMemory(BytesRequested);
+	// the existing records are moved into the resized tables, unless asked not to
+	setMemory(BytesRequested, strstr(s, "clear") == nullptr);
+}
+
+// autoshrink [on [psi threshold] [minimum bytes] | off]
+void parse_input_autoshrink(const char* s, Engine* pE)
+{
+	char onOff[16] = {0};
+	double psiThreshold = DEFAULT_PSI_THRESHOLD;
+	char minimum[64] = {0};
+	const int nArgs = (s == nullptr) ? 0 : sscanf(s, "%15s %lf %63s", onOff, &psiThreshold, minimum);
+
+	if (nArgs >= 1 && strcmp(onOff, "on") == 0) {
+		const size_t minimumBytes = (nArgs >= 3) ? Utils::bytes(minimum) : DEFAULT_AUTOSHRINK_MINIMUM;
+		if (MemoryPressureMonitor::start(psiThreshold, minimumBytes)) {
+			printf("Autoshrink on (watching %s; psi threshold %.1f%%; minimum %s)\n",
+				MemoryPressureMonitor::sources().c_str(), psiThreshold, Utils::memorySizeWithBinaryPrefix(minimumBytes).c_str());
+		} else {
+			printf("Autoshrink unavailable: no cgroup memory.events or memory pressure (PSI) file found\n");
+		}
+	} else if (nArgs >= 1 && strcmp(onOff, "off") == 0) {
+		MemoryPressureMonitor::stop();
+		printf("Autoshrink off\n");
+	} else if (MemoryPressureMonitor::isRunning()) {
+		printf("Autoshrink on (watching %s); tables shrunk %u time(s)\n", MemoryPressureMonitor::sources().c_str(), MemoryPressureMonitor::shrinkCount());
+	} else {
+		printf("Autoshrink off\nusage: autoshrink [on [psi threshold] [minimum bytes] | off]\n");
+	}
 }
 void parse_input_cores(const char* s, Engine* pE) {
 
@@ -581,6 +1153,48 @@ void parse_input_testExternal(const char* s, Engine* pE) {
 #endif // INCLUDE_DIAGNOSTICS
 }
 
+void parse_input_bench(const char* s, Engine* pE)
+{
+	// single-threaded, hashless perft (with full stats) over a fixed set of positions;
+	// intended for comparing raw move generator throughput between builds
+
+	struct BenchPosition {
+		const char* fen;
+		int depth;
+	};
+
+	static const BenchPosition benchPositions[] = {
+		{"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1", 5},
+		{"r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1", 4},
+		{"8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1", 5},
+		{"r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1", 4},
+		{"rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8", 4}
+	};
+
+#if defined(CP_DERIVED_BITBOARDS)
+	printf("Position layout: quad bitboards + derived bitboards (CP_DERIVED_BITBOARDS)\n");
+#else
+	printf("Position layout: quad bitboards\n");
+#endif
+
+	nodecount_t totalNodes = 0;
+	double totalSeconds = 0.0;
+
+	for (const BenchPosition& b : benchPositions) {
+		ChessPosition P;
+		readFen(&P, b.fen);
+		PerftInfo t;
+		const auto begin = std::chrono::high_resolution_clock::now();
+		perft(P, b.depth, 1, &t);
+		const std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - begin;
+		totalNodes += t.nMoves;
+		totalSeconds += elapsed.count();
+		printf("%s depth %d: %" PRIu64 " nodes %.0f nodes/sec\n", b.fen, b.depth, t.nMoves, t.nMoves / std::max(elapsed.count(), 1e-6));
+	}
+
+	printf("Total: %" PRIu64 " nodes in %.3f s (%.0f nodes/sec)\n\n", totalNodes, totalSeconds, totalNodes / std::max(totalSeconds, 1e-6));
+}
+
 // ---------------- Output Functions -------------------------------
 void  send_output_feature(Engine* pE)
 {
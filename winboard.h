@@ -133,11 +133,26 @@ void parse_input_showposition(const char * s, Engine * pE);
 void parse_input_showhash(const char* s, Engine* pE);
 void parse_input_perft(const char* s, Engine* pE);
 void parse_input_perftfast(const char * s, Engine * pE);
+void parse_input_perftfrontier(const char* s, Engine* pE);
+void parse_input_perftestimate(const char* s, Engine* pE);
+void parse_input_perftcheckpoint(const char* s, Engine* pE);
+void parse_input_coordinate(const char* s, Engine* pE);
+void parse_input_work(const char* s, Engine* pE);
+void parse_input_extperft(const char* s, Engine* pE);
+void parse_input_distinct(const char* s, Engine* pE);
+void parse_input_enumerate(const char* s, Engine* pE);
 void parse_input_divide(const char* s, Engine* pE);
 void parse_input_dividefast(const char * s, Engine * pE);
 void parse_input_writehash(const char* s, Engine* pE);
 void parse_input_lookuphash(const char* s, Engine* pE);
+void parse_input_sharehash(const char* s, Engine* pE);
+void parse_input_spillhash(const char* s, Engine* pE);
+void parse_input_verifyhash(const char* s, Engine* pE);
+void parse_input_hashstats(const char* s, Engine* pE);
+void parse_input_resultsdb(const char* s, Engine* pE);
+void parse_input_autoshrink(const char* s, Engine* pE);
 void parse_input_testExternal(const char * s, Engine * pE);
+void parse_input_bench(const char* s, Engine* pE);
 
 // functions for sending output commands
 void send_output_feature(Engine* pE);
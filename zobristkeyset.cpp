@@ -20,6 +20,16 @@ ZobristKeySet::ZobristKeySet()
 	generate();
 }
 
+uint64_t ZobristKeySet::getSeed() const
+{
+	return currentSeed;
+}
+
+void ZobristKeySet::setSeed(uint64_t seed)
+{
+	generate(seed);
+}
+
 uint64_t ZobristKeySet::generate(std::optional<uint64_t> seed)
 {
 	if (!seed.has_value()) {
@@ -29,6 +39,8 @@ uint64_t ZobristKeySet::generate(std::optional<uint64_t> seed)
 		// seed = 0x4a1b5d94; // for consistency during dev. "best" seed yet to be found
 	}
 
+	currentSeed = seed.value();
+
 	// Create a Random Number Generator, using the 64-bit Mersenne Twister Algorithm
 	// with a uniform distribution of ints;
 	// avoid zero
@@ -48,9 +60,14 @@ uint64_t ZobristKeySet::generate(std::optional<uint64_t> seed)
 	zkBlackCanCastle = dist(rng);
 	zkBlackCanCastleLong = dist(rng);
 
-	for (int m = 0; m < 24; ++m) {
+	for (int m = 0; m < PERFT_DEPTH_KEYS; ++m) {
 		zkPerftDepth[m] = dist(rng);
 	}
+
+	std::mt19937_64 verifyRng(seed.value() ^ 0x9e3779b97f4a7c15ull);
+	for (int m = 0; m < 5; ++m) {
+		zkVerify[m] = dist(verifyRng);
+	}
 	// ends random key generation
 
 
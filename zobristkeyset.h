@@ -8,6 +8,8 @@ namespace juddperft {
 
 typedef uint64_t ZobristKey;
 
+constexpr int PERFT_DEPTH_KEYS = 64; // number of depth keys (perft hash records are keyed by hk ^ zkPerftDepth[depth])
+
 // class ZobristKeySet: a set of random 64-bit keys for generating a hash key from a given position
 
 class ZobristKeySet
@@ -21,7 +23,11 @@ public:
 	ZobristKey zkWhiteCanCastleLong;
 	ZobristKey zkBlackCanCastle;
 	ZobristKey zkBlackCanCastleLong;
-	ZobristKey zkPerftDepth[24];
+	ZobristKey zkPerftDepth[PERFT_DEPTH_KEYS];
+
+	// salts for ChessPosition::calculateVerificationKey(), drawn from a separately-seeded generator
+	// (so that the verification key is independent of the Zobrist keys above)
+	ZobristKey zkVerify[5];
 
 	// pre-fabricated combinations of keys for castling:
 	ZobristKey zkDoBlackCastle;
@@ -29,11 +35,18 @@ public:
 	ZobristKey zkDoWhiteCastle;
 	ZobristKey zkDoWhiteCastleLong;
 
+	// the seed from which the keys were generated (hash table contents are only meaningful for the same seed)
+	uint64_t getSeed() const;
+
+	// regenerate all keys from the given seed (note: any hash keys already calculated become invalid)
+	void setSeed(uint64_t seed);
+
 	// utility:
 	static void findBestSeed(const std::optional<unsigned int>& prev_best_seed = {}, const std::optional<int>& maxAttempts = {});
 
 private:
 	uint64_t generate(std::optional<uint64_t> seed = {});
+	uint64_t currentSeed{0};
 };
 
 // Global instances: